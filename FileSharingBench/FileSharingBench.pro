@@ -0,0 +1,28 @@
+QT       += core network testlib
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+SERVER = ../FileSharingServer
+INCLUDEPATH += $$SERVER
+
+SOURCES += \
+    $$SERVER/connection.cpp \
+    $$SERVER/contentindex.cpp \
+    $$SERVER/dataroots.cpp \
+    $$SERVER/filetree.cpp \
+    $$SERVER/iopool.cpp \
+    $$SERVER/metadatastore.cpp \
+    $$SERVER/storage.cpp \
+    serverbenchmark.cpp
+
+HEADERS += \
+    $$SERVER/connection.h \
+    $$SERVER/contentindex.h \
+    $$SERVER/dataroots.h \
+    $$SERVER/filetree.h \
+    $$SERVER/iopool.h \
+    $$SERVER/metadatastore.h \
+    $$SERVER/storage.h \
+    $$SERVER/structs.h
@@ -0,0 +1,402 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "connection.h"
+#include "filetree.h"
+#include "metadatastore.h"
+#include "structs.h"
+
+// Every heap allocation in the process goes through here, so a benchmark can
+// report how many allocations one call of the code under test costs.
+static std::atomic<quint64> allocations(0);
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+template <typename Function>
+static void reportAllocations(Function function) {
+    quint64 before = allocations.load();
+    function();
+    qInfo("allocations: %llu", static_cast<unsigned long long>(allocations.load() - before));
+}
+
+// Feeds bytes straight into Connection's framing code, without a socket.
+class MemoryConnection : public Connection {
+public:
+    MemoryConnection() : Connection(0, nullptr) {
+    }
+
+    void feed(const QByteArray& bytes) {
+        input = bytes;
+        position = 0;
+        onReadyRead();
+    }
+
+    bool isOpen() const override { return true; }
+    void abort() override {}
+
+protected:
+    qint64 bytesAvailable() override {
+        return input.size() - position;
+    }
+
+    qint64 readData(char* data, qint64 maxSize) override {
+        qint64 length = qMin(maxSize, bytesAvailable());
+        memcpy(data, input.constData() + position, length);
+        position += length;
+        return length;
+    }
+
+    void writeData(const QByteArray& bytes) override {
+        Q_UNUSED(bytes);
+    }
+
+    qint64 bytesToWrite() const override {
+        return 0;
+    }
+
+    void closeSocket() override {
+    }
+
+private:
+    QByteArray input;
+    qint64 position = 0;
+};
+
+class ServerBenchmark : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void getData_data();
+    void getData();
+    void serializeTree_data();
+    void serializeTree();
+    void toJson_data();
+    void toJson();
+    void framing_data();
+    void framing();
+    void isValidGroupName_data();
+    void isValidGroupName();
+    void membership_data();
+    void membership();
+    void journalTornTail();
+    void journalSkipsCheckpointed();
+
+    void cleanupTestCase();
+
+private:
+    QString makeTree(int depth, int fanOut);
+    void makeTreeLevel(const QString& path, int depth, int fanOut);
+    void treeRows();
+
+    QTemporaryDir workDir;
+    QString previousDir;
+};
+
+void ServerBenchmark::initTestCase() {
+    QVERIFY(workDir.isValid());
+    previousDir = QDir::currentPath();
+
+    // FileTree works on paths relative to the server's working directory.
+    QDir::setCurrent(workDir.path());
+    QDir().mkpath("data");
+    QDir().mkpath("database");
+}
+
+void ServerBenchmark::cleanupTestCase() {
+    QDir::setCurrent(previousDir);
+}
+
+QString ServerBenchmark::makeTree(int depth, int fanOut) {
+    QString path = QString("data") + QDir::separator() + QString("tree_%1_%2").arg(depth).arg(fanOut);
+    if (!QDir(path).exists()) {
+        QDir().mkpath(path);
+        makeTreeLevel(path, depth, fanOut);
+    }
+    return path;
+}
+
+void ServerBenchmark::makeTreeLevel(const QString& path, int depth, int fanOut) {
+    for (int i = 0; i < fanOut; i++) {
+        QFile file(path + QDir::separator() + QString("file%1.txt").arg(i));
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write("x");
+        }
+    }
+
+    if (depth <= 1) {
+        return;
+    }
+
+    for (int i = 0; i < fanOut; i++) {
+        QString child = path + QDir::separator() + QString("folder%1").arg(i);
+        QDir().mkdir(child);
+        makeTreeLevel(child, depth - 1, fanOut);
+    }
+}
+
+void ServerBenchmark::treeRows() {
+    QTest::addColumn<int>("depth");
+    QTest::addColumn<int>("fanOut");
+
+    QTest::newRow("flat-10") << 1 << 10;
+    QTest::newRow("flat-1000") << 1 << 1000;
+    QTest::newRow("depth3-fan8") << 3 << 8;
+    QTest::newRow("depth5-fan4") << 5 << 4;
+}
+
+void ServerBenchmark::getData_data() {
+    treeRows();
+}
+
+void ServerBenchmark::getData() {
+    QFETCH(int, depth);
+    QFETCH(int, fanOut);
+
+    QString path = makeTree(depth, fanOut);
+    reportAllocations([&]() { FileTree::getData(path, "leader"); });
+
+    QBENCHMARK {
+        FileTree::getData(path, "leader");
+    }
+}
+
+void ServerBenchmark::serializeTree_data() {
+    treeRows();
+}
+
+void ServerBenchmark::serializeTree() {
+    QFETCH(int, depth);
+    QFETCH(int, fanOut);
+
+    FileTree::Roots roots;
+    roots.append(qMakePair(makeTree(depth, fanOut), QString("leader")));
+    reportAllocations([&]() { FileTree::serialize(roots); });
+
+    QBENCHMARK {
+        FileTree::serialize(roots);
+    }
+}
+
+void ServerBenchmark::toJson_data() {
+    treeRows();
+}
+
+void ServerBenchmark::toJson() {
+    QFETCH(int, depth);
+    QFETCH(int, fanOut);
+
+    QJsonDocument document(FileTree::getData(makeTree(depth, fanOut), "leader"));
+    reportAllocations([&]() { document.toJson(QJsonDocument::Compact); });
+
+    QBENCHMARK {
+        document.toJson(QJsonDocument::Compact);
+    }
+}
+
+void ServerBenchmark::framing_data() {
+    QTest::addColumn<int>("payloadSize");
+    QTest::addColumn<int>("frames");
+
+    QTest::newRow("1000x16B") << 16 << 1000;
+    QTest::newRow("1000x1KiB") << 1024 << 1000;
+    QTest::newRow("100x64KiB") << 64 * 1024 << 100;
+}
+
+void ServerBenchmark::framing() {
+    QFETCH(int, payloadSize);
+    QFETCH(int, frames);
+
+    QByteArray message = QByteArray::number(RequestCreateFolder).leftJustified(8, '\0', true) + QByteArray(payloadSize, 'a');
+    QByteArray stream;
+    QDataStream out(&stream, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_15);
+    for (int i = 0; i < frames; i++) {
+        out << message;
+    }
+
+    MemoryConnection connection;
+    int received = 0;
+    // Mirrors the request-code split at the top of MainWindow::handleMessage.
+    connect(&connection, &Connection::messageReceived, this, [&received](Connection*, QByteArray bytes) {
+        int request = bytes.mid(0, 8).toInt();
+        bytes = bytes.mid(8);
+        if (request == RequestCreateFolder) {
+            received++;
+        }
+    });
+
+    reportAllocations([&]() { connection.feed(stream); });
+    QCOMPARE(received, frames);
+
+    QBENCHMARK {
+        connection.feed(stream);
+    }
+}
+
+void ServerBenchmark::isValidGroupName_data() {
+    QTest::addColumn<QString>("name");
+
+    QTest::newRow("short") << "group1";
+    QTest::newRow("long") << QString("group name ").repeated(20);
+    QTest::newRow("invalid") << "group/../name";
+}
+
+void ServerBenchmark::isValidGroupName() {
+    QFETCH(QString, name);
+
+    reportAllocations([&]() { FileTree::isValidGroupName(name); });
+
+    QBENCHMARK {
+        FileTree::isValidGroupName(name);
+    }
+}
+
+void ServerBenchmark::membership_data() {
+    QTest::addColumn<int>("groupCount");
+    QTest::addColumn<int>("memberCount");
+
+    QTest::newRow("10x10") << 10 << 10;
+    QTest::newRow("100x100") << 100 << 100;
+    QTest::newRow("1000x10") << 1000 << 10;
+}
+
+void ServerBenchmark::membership() {
+    QFETCH(int, groupCount);
+    QFETCH(int, memberCount);
+
+    QString database = QString("database") + QDir::separator();
+    QFile::remove(database + "metadata.journal");
+    QFile::remove(database + "metadata.snapshot");
+
+    IoPool pool(1);
+    MetadataStore store(database + "metadata.journal", database + "metadata.snapshot", &pool);
+    QVERIFY2(store.open(), qPrintable(store.errorString()));
+
+    QMap<QString, MetadataTable*> groupMembers;
+    for (int g = 0; g < groupCount; g++) {
+        QString name = QString("group%1").arg(g);
+        MetadataTable* members = store.table("members/" + name);
+        members->clear();
+        for (int m = 0; m < memberCount; m++) {
+            members->setValue(QString("user%1").arg(m), m == 0 ? "1" : "0");
+        }
+        groupMembers.insert(name, members);
+    }
+
+    DataRoots dataRoots(QStringList() << "data", DataRoots::Hash, &store, &pool);
+
+    // The last member of every group: the worst case for a linear key scan.
+    QString user = QString("user%1").arg(memberCount - 1);
+    reportAllocations([&]() { FileTree::roots(groupMembers, user, &dataRoots); });
+    QCOMPARE(FileTree::roots(groupMembers, user, &dataRoots).size(), groupCount);
+
+    QBENCHMARK {
+        FileTree::roots(groupMembers, user, &dataRoots);
+    }
+}
+
+// Not benchmarks: MetadataStore::open() recovering from a crash.
+void ServerBenchmark::journalTornTail() {
+    QString journal = QString("database") + QDir::separator() + "torn.journal";
+    QString snapshot = QString("database") + QDir::separator() + "torn.snapshot";
+    QFile::remove(journal);
+    QFile::remove(snapshot);
+
+    {
+        IoPool pool(1);
+        MetadataStore store(journal, snapshot, &pool);
+        QVERIFY2(store.open(), qPrintable(store.errorString()));
+        store.table("users")->setValue("alice", "1");
+        store.table("users")->setValue("bob", "2");
+
+        bool durable = false;
+        store.whenDurable(this, [&durable]() { durable = true; });
+        QTRY_VERIFY(durable);
+    }
+    qint64 intact = QFileInfo(journal).size();
+
+    // A crash in the middle of a write: the header promises more bytes than follow.
+    {
+        QFile file(journal);
+        QVERIFY(file.open(QIODevice::Append));
+        file.write(QByteArray("\x00\x00\x01\x00\x12\x34\x56\x78{\"seq", 13));
+    }
+
+    IoPool pool(1);
+    MetadataStore store(journal, snapshot, &pool);
+    QVERIFY2(store.open(), qPrintable(store.errorString()));
+    QCOMPARE(store.sequence(), quint64(2));
+    QCOMPARE(store.table("users")->value("alice").toString(), QString("1"));
+    QCOMPARE(store.table("users")->value("bob").toString(), QString("2"));
+    QCOMPARE(QFileInfo(journal).size(), intact);
+}
+
+void ServerBenchmark::journalSkipsCheckpointed() {
+    QString journal = QString("database") + QDir::separator() + "skip.journal";
+    QString snapshot = QString("database") + QDir::separator() + "skip.snapshot";
+    QFile::remove(journal);
+    QFile::remove(snapshot);
+
+    {
+        IoPool pool(1);
+        MetadataStore store(journal, snapshot, &pool);
+        QVERIFY2(store.open(), qPrintable(store.errorString()));
+        store.table("users")->setValue("alice", "journal");
+        store.table("users")->setValue("bob", "2");
+
+        bool durable = false;
+        store.whenDurable(this, [&durable]() { durable = true; });
+        QTRY_VERIFY(durable);
+    }
+
+    // A checkpoint that folded in the first record but crashed before truncating the journal.
+    {
+        QFile file(snapshot);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(R"({"sequence":1,"tables":{"users":{"alice":"snapshot"}}})");
+    }
+
+    IoPool pool(1);
+    MetadataStore store(journal, snapshot, &pool);
+    QVERIFY2(store.open(), qPrintable(store.errorString()));
+    QCOMPARE(store.sequence(), quint64(2));
+    QCOMPARE(store.table("users")->value("alice").toString(), QString("snapshot"));
+    QCOMPARE(store.table("users")->value("bob").toString(), QString("2"));
+}
+
+QTEST_GUILESS_MAIN(ServerBenchmark)
+
+#include "serverbenchmark.moc"
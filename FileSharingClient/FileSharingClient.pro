@@ -1,4 +1,4 @@
-QT       += core gui network
+QT       += core gui network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -9,17 +9,30 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
-    itemfile.cpp \
+    blobcache.cpp \
+    fileitemdelegate.cpp \
+    filelistmodel.cpp \
+    filetreeindex.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    serverconnection.cpp \
+    transferdialog.cpp \
+    transfermanager.cpp \
+    treecache.cpp
 
 HEADERS += \
-    itemfile.h \
+    blobcache.h \
+    fileitemdelegate.h \
+    filelistmodel.h \
+    filetreeindex.h \
     mainwindow.h \
-    structs.h
+    serverconnection.h \
+    structs.h \
+    transferdialog.h \
+    transfermanager.h \
+    treecache.h
 
 FORMS += \
-    itemfile.ui \
     mainwindow.ui
 
 # Default rules for deployment.
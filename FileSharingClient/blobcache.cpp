@@ -0,0 +1,132 @@
+#include "blobcache.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QStandardPaths>
+
+BlobCache::BlobCache(const QString& directory, qint64 maxSize) : directory(directory), maxSize(maxSize) {
+    totalSize = 0;
+    QDir().mkpath(directory);
+
+    foreach (const QFileInfo& info, QDir(directory).entryInfoList(QStringList() << "*.blob", QDir::Files)) {
+        QString hash = info.completeBaseName();
+        if (!isValidHash(hash)) {
+            continue;
+        }
+
+        Blob blob;
+        blob.size = info.size();
+        blob.used = info.lastModified().toMSecsSinceEpoch();
+        blobs.insert(hash, blob);
+        totalSize += blob.size;
+    }
+
+    QMutexLocker locker(&mutex);
+    evict();
+}
+
+bool BlobCache::contains(const QString& hash) const {
+    QMutexLocker locker(&mutex);
+    return blobs.contains(hash);
+}
+
+bool BlobCache::copyTo(const QString& hash, const QString& target) {
+    QString source;
+    {
+        QMutexLocker locker(&mutex);
+        QHash<QString, Blob>::iterator it = blobs.find(hash);
+        if (it == blobs.end()) {
+            return false;
+        }
+
+        it->used = QDateTime::currentMSecsSinceEpoch();
+        source = fileName(hash);
+    }
+
+    QFile blob(source);
+    if (blob.open(QIODevice::ReadWrite)) {
+        blob.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        blob.close();
+    }
+
+    QFile::remove(target);
+    return QFile::copy(source, target);
+}
+
+void BlobCache::store(const QString& hash, const QString& source) {
+    if (!isValidHash(hash)) {
+        return;
+    }
+
+    qint64 size = QFileInfo(source).size();
+    if (size > maxSize) {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        if (blobs.contains(hash)) {
+            return;
+        }
+    }
+
+    // Copied under a temporary name so a half-written blob is never found.
+    QString name = fileName(hash);
+    QString partial = name + ".part";
+    QFile::remove(partial);
+    if (!QFile::copy(source, partial) || !QFile::rename(partial, name)) {
+        QFile::remove(partial);
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+    if (blobs.contains(hash)) {
+        return;
+    }
+
+    Blob blob;
+    blob.size = size;
+    blob.used = QDateTime::currentMSecsSinceEpoch();
+    blobs.insert(hash, blob);
+    totalSize += size;
+    evict();
+}
+
+QString BlobCache::defaultDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QDir::separator() + "blobs";
+}
+
+bool BlobCache::isValidHash(const QString& hash) {
+    if (hash.size() != 64) {
+        return false;
+    }
+
+    for (QChar c : hash) {
+        if (!c.isDigit() && (c < 'a' || c > 'f')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QString BlobCache::fileName(const QString& hash) const {
+    return directory + QDir::separator() + hash + ".blob";
+}
+
+void BlobCache::evict() {
+    while (totalSize > maxSize && !blobs.isEmpty()) {
+        QHash<QString, Blob>::iterator oldest = blobs.begin();
+        for (QHash<QString, Blob>::iterator it = blobs.begin(); it != blobs.end(); ++it) {
+            if (it->used < oldest->used) {
+                oldest = it;
+            }
+        }
+
+        QFile::remove(fileName(oldest.key()));
+        totalSize -= oldest->size;
+        blobs.erase(oldest);
+    }
+}
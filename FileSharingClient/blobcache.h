@@ -0,0 +1,42 @@
+#ifndef BLOBCACHE_H
+#define BLOBCACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// Downloaded files kept by SHA-256, so fetching the same content again, from
+// any group and under any name, is a local copy. The cache is bounded in
+// total size and evicts the least recently used blobs first; recency is the
+// blob's modification time, so it survives restarts. All methods may be
+// called from worker threads.
+class BlobCache {
+public:
+    static constexpr qint64 DefaultMaxSize = 1024LL * 1024 * 1024;
+
+    BlobCache(const QString& directory, qint64 maxSize);
+
+    bool contains(const QString& hash) const;
+    bool copyTo(const QString& hash, const QString& target);
+    void store(const QString& hash, const QString& source);
+
+    static QString defaultDirectory();
+    static bool isValidHash(const QString& hash);
+
+private:
+    struct Blob {
+        qint64 size;
+        qint64 used;
+    };
+
+    QString fileName(const QString& hash) const;
+    void evict();
+
+    mutable QMutex mutex;
+    QString directory;
+    qint64 maxSize;
+    qint64 totalSize;
+    QHash<QString, Blob> blobs;
+};
+
+#endif // BLOBCACHE_H
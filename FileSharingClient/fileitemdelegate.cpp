@@ -0,0 +1,40 @@
+#include "fileitemdelegate.h"
+
+#include <QApplication>
+#include <QPainter>
+
+FileItemDelegate::FileItemDelegate(QObject* parent) : QStyledItemDelegate(parent) {
+}
+
+void FileItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    QStyleOptionViewItem background = option;
+    initStyleOption(&background, index);
+    background.text = QString();
+    background.icon = QIcon();
+
+    QStyle* style = option.widget ? option.widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &background, painter, option.widget);
+
+    painter->save();
+
+    QPixmap icon = index.data(Qt::DecorationRole).value<QPixmap>();
+    painter->drawPixmap(option.rect.x() + 12, option.rect.y() + (option.rect.height() - 24) / 2, icon);
+
+    QFont font = option.font;
+    font.setPointSize(11);
+    painter->setFont(font);
+    painter->setPen(option.palette.color(option.state & QStyle::State_Selected ? QPalette::HighlightedText : QPalette::Text));
+
+    QRect textRect = option.rect.adjusted(50, 0, -10, 0);
+    QString name = QFontMetrics(font).elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideMiddle, textRect.width());
+    painter->drawText(textRect, Qt::AlignVCenter | Qt::AlignLeft, name);
+
+    painter->restore();
+}
+
+QSize FileItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    Q_UNUSED(option);
+    Q_UNUSED(index);
+
+    return QSize(480, 48);
+}
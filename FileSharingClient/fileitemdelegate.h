@@ -0,0 +1,18 @@
+#ifndef FILEITEMDELEGATE_H
+#define FILEITEMDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+// Paints a FileListModel row, the cached icon followed by the name, in a
+// fixed 48 px row so the view can lay out any number of rows without asking.
+class FileItemDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+
+public:
+    explicit FileItemDelegate(QObject* parent = nullptr);
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+};
+
+#endif // FILEITEMDELEGATE_H
@@ -0,0 +1,135 @@
+#include "filelistmodel.h"
+
+#include <QPixmapCache>
+#include <algorithm>
+
+FileListModel::FileListModel(QObject* parent) : QAbstractListModel(parent) {
+    sortKey = SortByName;
+    sortOrder = Qt::AscendingOrder;
+}
+
+void FileListModel::setFolder(const QJsonObject& folder) {
+    children = folder.value("children").toArray();
+
+    entries.clear();
+    entries.reserve(children.count());
+    for (int i = 0; i < children.count(); i++) {
+        QJsonObject child = children.at(i).toObject();
+
+        Entry entry;
+        entry.name = child.value("name").toString();
+        entry.path = child.value("path").toString();
+        entry.type = child.value("type").toString();
+        entry.size = child.value("size").toVariant().toLongLong();
+        entry.empty = entry.type != "file" && child.value("children").toArray().isEmpty();
+        entries.append(entry);
+    }
+
+    rebuild();
+}
+
+void FileListModel::setFilter(const QString& filter) {
+    if (this->filter == filter) {
+        return;
+    }
+
+    this->filter = filter;
+    rebuild();
+}
+
+void FileListModel::setSort(SortKey key, Qt::SortOrder order) {
+    sortKey = key;
+    sortOrder = order;
+    rebuild();
+}
+
+QJsonObject FileListModel::object(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QJsonObject();
+    }
+    return children.at(rows[index.row()]).toObject();
+}
+
+int FileListModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : rows.size();
+}
+
+QVariant FileListModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QVariant();
+    }
+
+    const Entry& entry = entries[rows[index.row()]];
+    switch (role) {
+        case Qt::DisplayRole:
+            return entry.name;
+        case Qt::DecorationRole:
+            return icon(entry.type, entry.empty);
+        case ObjectRole:
+            return object(index);
+        case PathRole:
+            return entry.path;
+        case TypeRole:
+            return entry.type;
+        case SizeRole:
+            return entry.size;
+    }
+    return QVariant();
+}
+
+void FileListModel::sort(int column, Qt::SortOrder order) {
+    Q_UNUSED(column);
+    setSort(SortByName, order);
+}
+
+QPixmap FileListModel::icon(const QString& type, bool empty) {
+    QString resource = ":images/folder.png";
+    if (type == "file") {
+        resource = ":images/file.png";
+    } else if (empty) {
+        resource = ":images/folder_empty.png";
+    }
+
+    // Every row shares one scaled pixmap per icon.
+    QPixmap pixmap;
+    if (!QPixmapCache::find(resource, &pixmap)) {
+        pixmap = QPixmap(resource).scaled(24, 24, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        QPixmapCache::insert(resource, pixmap);
+    }
+    return pixmap;
+}
+
+bool FileListModel::lessThan(const Entry& left, const Entry& right) const {
+    // Folders stay on top whatever the order, as in the server's listing.
+    bool leftFile = left.type == "file";
+    bool rightFile = right.type == "file";
+    if (leftFile != rightFile) {
+        return rightFile;
+    }
+
+    int result = 0;
+    if (sortKey == SortBySize && left.size != right.size) {
+        result = left.size < right.size ? -1 : 1;
+    } else {
+        result = left.name.compare(right.name, Qt::CaseInsensitive);
+    }
+    return sortOrder == Qt::AscendingOrder ? result < 0 : result > 0;
+}
+
+void FileListModel::rebuild() {
+    beginResetModel();
+
+    rows.clear();
+    rows.reserve(entries.size());
+    for (int i = 0; i < entries.size(); i++) {
+        if (filter.isEmpty() || entries[i].name.contains(filter, Qt::CaseInsensitive)) {
+            rows.append(i);
+        }
+    }
+
+    std::stable_sort(rows.begin(), rows.end(), [this](int left, int right) {
+        return lessThan(entries[left], entries[right]);
+    });
+
+    endResetModel();
+}
@@ -0,0 +1,63 @@
+#ifndef FILELISTMODEL_H
+#define FILELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QPixmap>
+#include <QVector>
+
+// The children of the folder being browsed. Each child is reduced once to the
+// few values the view needs; filtering and sorting only rebuild a vector of
+// row indices, and the view asks for nothing but the rows on screen.
+class FileListModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    enum Roles {
+        ObjectRole = Qt::UserRole + 1,
+        PathRole,
+        TypeRole,
+        SizeRole,
+    };
+
+    enum SortKey {
+        SortByName,
+        SortBySize,
+    };
+
+    explicit FileListModel(QObject* parent = nullptr);
+
+    void setFolder(const QJsonObject& folder);
+    void setFilter(const QString& filter);
+    void setSort(SortKey key, Qt::SortOrder order);
+
+    QJsonObject object(const QModelIndex& index) const;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    static QPixmap icon(const QString& type, bool empty);
+
+private:
+    struct Entry {
+        QString name;
+        QString path;
+        QString type;
+        qint64 size;
+        bool empty;
+    };
+
+    bool lessThan(const Entry& left, const Entry& right) const;
+    void rebuild();
+
+    QJsonArray children;
+    QVector<Entry> entries;
+    QVector<int> rows;
+    QString filter;
+    SortKey sortKey;
+    Qt::SortOrder sortOrder;
+};
+
+#endif // FILELISTMODEL_H
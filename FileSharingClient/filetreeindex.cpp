@@ -0,0 +1,45 @@
+#include "filetreeindex.h"
+
+#include <QDir>
+#include <QJsonArray>
+
+void FileTreeIndex::rebuild(const QJsonObject& root) {
+    nodes.clear();
+    insert(root, QString());
+}
+
+bool FileTreeIndex::contains(const QString& path) const {
+    return nodes.contains(path);
+}
+
+QJsonObject FileTreeIndex::node(const QString& path) const {
+    return nodes.value(path).object;
+}
+
+QString FileTreeIndex::parentPath(const QString& path) const {
+    QHash<QString, Node>::const_iterator it = nodes.constFind(path);
+    return it != nodes.constEnd() ? it->parent : parentOf(path);
+}
+
+QJsonObject FileTreeIndex::root() const {
+    return node(QString());
+}
+
+QString FileTreeIndex::parentOf(const QString& path) {
+    int index = path.lastIndexOf(QDir::separator());
+    return index == -1 ? QString() : path.left(index);
+}
+
+void FileTreeIndex::insert(const QJsonObject& object, const QString& parent) {
+    QString path = object.value("path").toString();
+
+    Node node;
+    node.object = object;
+    node.parent = parent;
+    nodes.insert(path, node);
+
+    QJsonArray children = object.value("children").toArray();
+    for (int i = 0; i < children.count(); i++) {
+        insert(children.at(i).toObject(), path);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef FILETREEINDEX_H
+#define FILETREEINDEX_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+
+// Path-keyed index over the tree sent by the server. Each node keeps its JSON
+// object and the path of its parent, so looking up a folder or going up one
+// level is a hash lookup instead of a walk over the whole tree.
+class FileTreeIndex {
+public:
+    void rebuild(const QJsonObject& root);
+
+    bool contains(const QString& path) const;
+    QJsonObject node(const QString& path) const;
+    QString parentPath(const QString& path) const;
+    QJsonObject root() const;
+
+private:
+    struct Node {
+        QJsonObject object;
+        QString parent;
+    };
+
+    static QString parentOf(const QString& path);
+
+    void insert(const QJsonObject& object, const QString& parent);
+
+    QHash<QString, Node> nodes;
+};
+
+#endif // FILETREEINDEX_H
@@ -3,16 +3,17 @@
 
 #include <QDebug>
 #include <QDir>
-#include <QQueue>
 #include <QMessageBox>
 #include <QInputDialog>
-#include <QListWidgetItem>
 #include <QJsonValue>
 #include <QFileDialog>
+#include <QSet>
+#include <QSettings>
 #include <QStandardPaths>
+#include <QThreadPool>
 
 #include "structs.h"
-#include "itemfile.h"
+#include "fileitemdelegate.h"
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow) {
     ui->setupUi(this);
@@ -21,20 +22,51 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
 
     ui->pages->setCurrentIndex(1);
 
-    socket = new QTcpSocket(this);
-
-    connect(socket, &QTcpSocket::readyRead, this, &MainWindow::onReadyRead);
-    connect(socket, &QTcpSocket::disconnected, this, &MainWindow::onSocketDisconnected);
-    connect(socket, &QAbstractSocket::errorOccurred, this, &MainWindow::onErrorOccurred);
+    fileModel = new FileListModel(this);
+    ui->listView->setModel(fileModel);
+    ui->listView->setItemDelegate(new FileItemDelegate(ui->listView));
+
+    baseTitle = windowTitle();
+    searching = false;
+
+    QSettings settings("client.ini", QSettings::IniFormat);
+    connection = new ServerConnection(settings.value("server/host", "127.0.0.1").toString(),
+                                      settings.value("server/port", ServerConnection::DefaultPort).toUInt(),
+                                      settings.value("reconnect/initialDelay", ServerConnection::DefaultInitialDelay).toInt(),
+                                      settings.value("reconnect/maxDelay", ServerConnection::DefaultMaxDelay).toInt(),
+                                      this);
+    connection->setHeartbeat(settings.value("heartbeat/interval", ServerConnection::DefaultHeartbeatInterval).toInt(),
+                             settings.value("heartbeat/timeout", ServerConnection::DefaultHeartbeatTimeout).toInt());
+
+    connect(connection, &ServerConnection::messageReceived, this, &MainWindow::handleMessage);
+    connect(connection, &ServerConnection::stateChanged, this, &MainWindow::onConnectionStateChanged);
+    connect(connection, &ServerConnection::reauthenticationFailed, this, &MainWindow::onReauthenticationFailed);
+
+    treeCache = nullptr;
+    if (settings.value("cache/enabled", true).toBool()) {
+        treeCache = new TreeCache(settings.value("cache/directory", TreeCache::defaultDirectory()).toString(), connection->host(), connection->port());
+    }
 
-    socket->connectToHost(QHostAddress::LocalHost, 1234);
-    if (socket->waitForConnected()) {
-        qDebug() << "Connected to Server";
-    } else {
-        QMessageBox::critical(this, "QTcpClient", QString("The following error occurred: %1.").arg(socket->errorString()));
-        exit(EXIT_FAILURE);
+    transferManager = new TransferManager(connection,
+                                          settings.value("transfers/concurrent", TransferManager::DefaultConcurrent).toInt(),
+                                          settings.value("transfers/chunkSize", TransferManager::DefaultChunkSize).toLongLong(),
+                                          settings.value("transfers/window", TransferManager::DefaultWindow).toInt(),
+                                          settings.value("transfers/offerHashes", true).toBool(),
+                                          this);
+    transferDialog = new TransferDialog(transferManager, this);
+
+    blobCache = nullptr;
+    if (settings.value("cache/enabled", true).toBool()) {
+        blobCache = new BlobCache(settings.value("cache/blobDirectory", BlobCache::defaultDirectory()).toString(),
+                                  settings.value("cache/blobMaxSize", BlobCache::DefaultMaxSize).toLongLong());
+        transferManager->setBlobCache(blobCache);
     }
 
+    connect(transferManager, &TransferManager::treeReceived, this, &MainWindow::processGet);
+    connect(transferManager, &TransferManager::transferAdded, transferDialog, &QDialog::show);
+
+    connection->start();
+
     connect(ui->btnSignIn, &QPushButton::clicked, this, [this]() {
         sendSignIn();
     });
@@ -47,6 +79,11 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
         sendSignOut();
     });
 
+    connect(ui->btnTransfers, &QPushButton::clicked, this, [this]() {
+        transferDialog->show();
+        transferDialog->raise();
+    });
+
     connect(ui->btnRefresh, &QPushButton::clicked, this, [this]() {
         sendGet();
     });
@@ -68,14 +105,9 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     });
 
     connect(ui->btnDownload, &QPushButton::clicked, this, [this]() {
-        QListWidgetItem* item = ui->listWidget->currentItem();
-        if (item) {
-            for (int i = 0; i < ui->listWidget->count(); i++) {
-                if (ui->listWidget->item(i) == item) {
-                    sendDownload(items[i]->getData());
-                    break;
-                }
-            }
+        QModelIndex index = ui->listView->currentIndex();
+        if (index.isValid()) {
+            sendDownload(fileModel->object(index));
         } else {
             qDebug() << ("Download: Please select a file");
             QMessageBox::information(this, "Information", "Please select a file");
@@ -83,66 +115,63 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     });
 
     connect(ui->btnDelete, &QPushButton::clicked, this, [this]() {
-        QListWidgetItem* item = ui->listWidget->currentItem();
-        if (item) {
-            for (int i = 0; i < ui->listWidget->count(); i++) {
-                if (ui->listWidget->item(i) == item) {
-                    sendDelete(items[i]->getData());
-                    break;
-                }
-            }
+        QModelIndex index = ui->listView->currentIndex();
+        if (index.isValid()) {
+            sendDelete(fileModel->object(index));
         } else {
             qDebug() << ("Download: Please select a file");
             QMessageBox::information(this, "Information", "Please select a file");
         }
     });
 
-    connect(ui->listWidget, &QListWidget::itemDoubleClicked, this, [this](QListWidgetItem* item) {
-        for (int i = 0; i < ui->listWidget->count(); i++) {
-            if (ui->listWidget->item(i) == item) {
-                if (items[i]->getData().value("type").toString() == "dir") {
-                    current = items[i]->getData();
-                    updateListWidget();
-                }
-                break;
-            }
+    connect(ui->listView, &QListView::doubleClicked, this, [this](const QModelIndex& index) {
+        if (index.data(FileListModel::TypeRole).toString() == "dir") {
+            searching = false;
+            current = fileModel->object(index);
+            updateListWidget();
         }
     });
 
-    connect(ui->btnBack, &QPushButton::clicked, this, [this]() {
-        QString path = current.value("path").toString();
-        QString parentPath;
-        if (path.lastIndexOf(QDir::separator()) != -1) {
-            parentPath = path.mid(0, path.lastIndexOf(QDir::separator()));
+    connect(ui->edtFilter, &QLineEdit::textChanged, this, [this](const QString& text) {
+        fileModel->setFilter(text);
+        if (searching && text.trimmed() != searchQuery) {
+            searching = false;
+            updateListWidget();
         }
+    });
 
-        QQueue<QJsonObject> queue;
-        queue.enqueue(jsonData);
-        while (!queue.isEmpty()) {
-            QJsonObject object = queue.dequeue();
-            if (object.value("path").toString() == parentPath) {
-                current = object;
-                updateListWidget();
-                break;
-            }
+    // Enter looks for the text in every group instead of just the folder shown.
+    connect(ui->edtFilter, &QLineEdit::returnPressed, this, [this]() {
+        sendSearch(ui->edtFilter->text());
+    });
 
-            QJsonArray children = object.value("children").toArray();
-            for (int i = 0; i < children.count(); i++) {
-                QJsonObject child = children.at(i).toObject();
-                if (child.value("type").toString() == "dir") {
-                    queue.enqueue(child);
-                }
-            }
+    connect(ui->cbSort, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int index) {
+        FileListModel::SortKey key = index < 2 ? FileListModel::SortByName : FileListModel::SortBySize;
+        fileModel->setSort(key, index % 2 == 0 ? Qt::AscendingOrder : Qt::DescendingOrder);
+    });
+
+    connect(ui->btnBack, &QPushButton::clicked, this, [this]() {
+        if (searching) {
+            searching = false;
+            updateListWidget();
+            return;
         }
+
+        QString path = current.value("path").toString();
+        if (path.isEmpty()) {
+            return;
+        }
+
+        current = treeIndex.node(treeIndex.parentPath(path));
+        updateListWidget();
     });
 }
 
 MainWindow::~MainWindow() {
-    if (socket->isOpen()) {
-        socket->close();
-        socket->deleteLater();
-    }
-
+    // Copies into and out of the blob cache run on the global pool.
+    QThreadPool::globalInstance()->waitForDone();
+    delete blobCache;
+    delete treeCache;
     delete ui;
 }
 
@@ -155,37 +184,22 @@ void MainWindow::updateCurrent() {
         return;
     }
 
-    QString path = current.value("path").toString();
-
-    QQueue<QJsonObject> queue;
-    queue.enqueue(jsonData);
-    while (!queue.isEmpty()) {
-        QJsonObject object = queue.dequeue();
-        if (object.value("path").toString() == path) {
-            current = object;
-            return;
-        }
-
-        QJsonArray children = object.value("children").toArray();
-        for (int i = 0; i < children.count(); i++) {
-            QJsonObject child = children.at(i).toObject();
-            if (child.value("type").toString() == "dir") {
-                queue.enqueue(child);
-            }
-        }
-    }
-
-    current = QJsonObject();
+    current = treeIndex.node(current.value("path").toString());
 }
 
 void MainWindow::updateListWidget() {
+    if (searching) {
+        showSearchResults();
+        return;
+    }
+
     ui->btnCreateFolder->hide();
     ui->btnUpload->hide();
     ui->btnDownload->hide();
     ui->btnDelete->hide();
 
     if (current.isEmpty() || current.value("path").toString().isEmpty()) {
-        current = jsonData;
+        current = treeIndex.root();
         ui->btnBack->setEnabled(false);
         ui->lbPath->setText(QString(">"));
     } else {
@@ -200,173 +214,100 @@ void MainWindow::updateListWidget() {
         }
     }
 
-    items.clear();
-    ui->listWidget->clear();
-
-    QJsonArray children = current.value("children").toArray();
-    for (int i = 0; i < children.count(); i++) {
-        auto widget = new ItemFile(this);
-        widget->setData(children.at(i).toObject());
-
-        items.append(widget);
-
-        auto item = new QListWidgetItem();
-        item->setSizeHint(QSize(480, 48));
-
-        ui->listWidget->addItem(item);
-        ui->listWidget->setItemWidget(item, widget);
-    }
-}
-
-void MainWindow::onReadyRead() {
-    QByteArray buffer;
-
-    QDataStream socketStream(socket);
-    socketStream.setVersion(QDataStream::Qt_5_15);
-
-    socketStream.startTransaction();
-    socketStream >> buffer;
-
-    if(!socketStream.commitTransaction()) {
-        QString message = QString("%1> Waiting for more data to come..").arg(socket->socketDescriptor());
-        qDebug() << message;
-        return;
-    }
-
-    handleMessage(buffer);
+    fileModel->setFolder(current);
 }
 
-void MainWindow::onSocketDisconnected() {
-    socket->deleteLater();
-    socket = nullptr;
-    qDebug() << "Disconnected";
+void MainWindow::showSearchResults() {
+    ui->btnCreateFolder->hide();
+    ui->btnUpload->hide();
+    ui->btnDelete->hide();
+    ui->btnDownload->show();
+    ui->btnBack->setEnabled(true);
+    ui->lbPath->setText(QString("> Search: %1").arg(searchQuery));
+
+    QJsonObject results;
+    results.insert("name", "");
+    results.insert("path", "");
+    results.insert("type", "search");
+    results.insert("children", searchHits);
+    fileModel->setFolder(results);
 }
 
-void MainWindow::onErrorOccurred(QAbstractSocket::SocketError error) {
-    switch (error) {
-        case QAbstractSocket::RemoteHostClosedError:
-            break;
+void MainWindow::onConnectionStateChanged(ServerConnection::State state) {
+    QString address = QString("%1:%2").arg(connection->host()).arg(connection->port());
 
-        case QAbstractSocket::HostNotFoundError:
-            QMessageBox::information(this, "QTcpClient", "The host was not found. Please check the host name and port settings.");
+    switch (state) {
+        case ServerConnection::Connected:
+            qDebug() << ("Connected to " + address);
+            setWindowTitle(baseTitle);
             break;
 
-        case QAbstractSocket::ConnectionRefusedError:
-            QMessageBox::information(this, "QTcpClient", "The connection was refused by the peer. Make sure QTCPServer is running, and check that the host name and port settings are correct.");
+        case ServerConnection::Connecting:
+            setWindowTitle(QString("%1 - Connecting to %2...").arg(baseTitle, address));
             break;
 
-        default:
-            QMessageBox::information(this, "QTcpClient", QString("The following error occurred: %1.").arg(socket->errorString()));
+        case ServerConnection::Disconnected:
+            qDebug() << ("Disconnected: " + connection->errorString());
+            setWindowTitle(QString("%1 - Offline, retrying %2").arg(baseTitle, address));
             break;
     }
 }
 
-void MainWindow::sendSignIn() {
-    if(socket) {
-        if(socket->isOpen()) {
-            QString username = ui->edtUsername->text();
-            QString password = ui->edtPassword->text();
-            if (username.isEmpty() || password.isEmpty()) {
-                QMessageBox::warning(this, "Warning", "Please fill all required fields");
-                return;
-            }
-
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestSignIn;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QString str = username + ";" + password;
-            QByteArray byteArray = str.toUtf8();
-            byteArray.prepend(typeArray);
+void MainWindow::onReauthenticationFailed(QString message) {
+    qDebug() << ("Reauthentication failed: " + message);
+    currentUser = QString();
+    transferManager->cancelAll();
+    ui->pages->setCurrentIndex(1);
+    displayError(QString("You have been signed out: %1").arg(message));
+}
 
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
+void MainWindow::sendSignIn() {
+    QString username = ui->edtUsername->text();
+    QString password = ui->edtPassword->text();
+    if (username.isEmpty() || password.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "Please fill all required fields");
+        return;
     }
+
+    QString str = username + ";" + password;
+    connection->send(RequestSignIn, str.toUtf8());
 }
 
 void MainWindow::sendSignUp() {
-    if(socket) {
-        if(socket->isOpen()) {
-            QString username = ui->edtUsername->text();
-            QString password = ui->edtPassword->text();
-            if (username.isEmpty() || password.isEmpty()) {
-                QMessageBox::warning(this, "Warning", "Please fill all required fields");
-                return;
-            }
-
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestSignUp;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QString str = username + ";" + password;
-            QByteArray byteArray = str.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
+    QString username = ui->edtUsername->text();
+    QString password = ui->edtPassword->text();
+    if (username.isEmpty() || password.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "Please fill all required fields");
+        return;
     }
+
+    QString str = username + ";" + password;
+    connection->send(RequestSignUp, str.toUtf8());
 }
 
 void MainWindow::sendSignOut() {
-    if(socket) {
-        if(socket->isOpen()) {
-            QString str = currentUser;
-
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestSignOut;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QByteArray byteArray = str.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
-    }
+    transferManager->cancelAll();
+    connection->send(RequestSignOut, currentUser.toUtf8());
 }
 
 void MainWindow::sendGet() {
-    if(socket) {
-        if(socket->isOpen()) {
-            QString str = currentUser;
-
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestGet;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QByteArray byteArray = str.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
+    // A cluster is asked node by node, each with the tag of its own part of the tree.
+    if (!nodeTags.isEmpty()) {
+        for (QMap<QString, QByteArray>::const_iterator it = nodeTags.constBegin(); it != nodeTags.constEnd(); ++it) {
+            QByteArray byteArray = currentUser.toUtf8();
+            if (!it.value().isEmpty()) {
+                byteArray += ";" + it.value();
+            }
+            connection->sendTo(it.key(), RequestGet, byteArray);
         }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
+        return;
     }
+
+    QByteArray byteArray = currentUser.toUtf8();
+    if (!treeTag.isEmpty()) {
+        byteArray += ";" + treeTag;
+    }
+    connection->send(RequestGet, byteArray);
 }
 
 void MainWindow::sendCreateGroup() {
@@ -379,25 +320,7 @@ void MainWindow::sendCreateGroup() {
         }
     } while (ok && name.isEmpty());
 
-    if(socket) {
-        if(socket->isOpen()) {
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestCreateGroup;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QByteArray byteArray = name.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
-    }
+    connection->send(RequestCreateGroup, name.toUtf8());
 }
 
 void MainWindow::sendJoinGroup() {
@@ -410,25 +333,7 @@ void MainWindow::sendJoinGroup() {
         }
     } while (ok && name.isEmpty());
 
-    if(socket) {
-        if(socket->isOpen()) {
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestJoinGroup;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QByteArray byteArray = name.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
-    }
+    connection->send(RequestJoinGroup, name.toUtf8());
 }
 
 void MainWindow::sendCreateFolder() {
@@ -446,25 +351,7 @@ void MainWindow::sendCreateFolder() {
     } while (ok && name.isEmpty());
 
     QString folderPath = current.value("path").toString() + QDir::separator() + name;
-    if(socket) {
-        if(socket->isOpen()) {
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestCreateFolder;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QByteArray byteArray = folderPath.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
-    }
+    connection->send(RequestCreateFolder, folderPath.toUtf8());
 }
 
 void MainWindow::sendUpload() {
@@ -480,29 +367,12 @@ void MainWindow::sendUpload() {
         return;
     }
 
-    QFile file(info.filePath());
-    if(file.open(QIODevice::ReadOnly)){
-        QString fileName(info.fileName());
-
-        QDataStream socketStream(socket);
-        socketStream.setVersion(QDataStream::Qt_5_15);
-
-        Request type = Request::RequestUploadFile;
-        QByteArray typeArray = QByteArray::number(type);
-        typeArray.resize(8);
-
-        QByteArray header;
-        header.prepend(QString(current.value("path").toString() + QDir::separator() + fileName).toUtf8());
-        header.resize(256);
-
-        QByteArray byteArray = file.readAll();
-        byteArray.prepend(header);
-        byteArray.prepend(typeArray);
-
-        socketStream << byteArray;
-    } else {
+    if (!info.isReadable()) {
         QMessageBox::critical(this, "File Client", "File is not readable!");
+        return;
     }
+
+    transferManager->upload(info.filePath(), current.value("path").toString() + QDir::separator() + info.fileName());
 }
 
 void MainWindow::sendDownload(QJsonObject object) {
@@ -512,27 +382,13 @@ void MainWindow::sendDownload(QJsonObject object) {
         return;
     }
 
-    QString data = object.value("path").toString();
-
-    if(socket) {
-        if(socket->isOpen()) {
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestDownloadFile;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QByteArray byteArray = data.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
+    QString filename = object.value("name").toString();
+    QString filePath = QFileDialog::getSaveFileName(this, tr("Save File"), QDir::currentPath() + QDir::separator() + filename);
+    if (filePath.isEmpty()) {
+        return;
     }
+
+    transferManager->download(object.value("path").toString(), filePath, object.value("size").toVariant().toLongLong(), object.value("hash").toString());
 }
 
 void MainWindow::sendDelete(QJsonObject object) {
@@ -543,25 +399,29 @@ void MainWindow::sendDelete(QJsonObject object) {
     }
 
     QString data = object.value("path").toString();
-    if(socket) {
-        if(socket->isOpen()) {
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestDelete;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
+    connection->send(RequestDelete, data.toUtf8());
+}
 
-            QByteArray byteArray = data.toUtf8();
-            byteArray.prepend(typeArray);
+void MainWindow::sendSearch(const QString &query) {
+    if (query.trimmed().isEmpty() || currentUser.isEmpty()) {
+        return;
+    }
 
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
+    searching = true;
+    searchQuery = query.trimmed();
+    searchHits = QJsonArray();
+    searchPaths.clear();
+    showSearchResults();
+
+    // Each cluster node only searches the groups it holds.
+    QByteArray byteArray = QString("0,%1,%2").arg(SearchPageSize).arg(searchQuery).toUtf8();
+    if (!nodeTags.isEmpty()) {
+        foreach (const QString& node, nodeTags.keys()) {
+            connection->sendTo(node, RequestSearch, byteArray);
         }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
+        return;
     }
+    connection->send(RequestSearch, byteArray);
 }
 
 void MainWindow::handleMessage(QByteArray data) {
@@ -577,8 +437,10 @@ void MainWindow::handleMessage(QByteArray data) {
             qDebug() << (QString("ResponseSignInSuccess: ") + QString::fromStdString(data.toStdString()));
             currentUser = ui->edtUsername->text();
             current = QJsonObject();
+            searching = false;
             ui->edtPassword->setText("");
             ui->pages->setCurrentIndex(0);
+            showCachedTree();
             sendGet();
             break;
 
@@ -613,6 +475,10 @@ void MainWindow::handleMessage(QByteArray data) {
             processGet(data);
             break;
 
+        case ResponseGetNotModified:
+            qDebug() << (QString("ResponseGetNotModified: ") + QString::fromStdString(data.toStdString()));
+            break;
+
         case ResponseGetError:
             qDebug() << (QString("ResponseGetError: ") + QString::fromStdString(data.toStdString()));
             displayError(QString::fromStdString(data.toStdString()));
@@ -656,28 +522,6 @@ void MainWindow::handleMessage(QByteArray data) {
             displayError(QString::fromStdString(data.toStdString()));
             break;
 
-        case ResponseUploadFileSuccess:
-            processGet(data);
-
-            qDebug() << (QString("ResponseUploadFileSuccess: ") + QString::fromStdString(data.toStdString()));
-            QMessageBox::information(this, "Success", "Upload file successfully!");
-            break;
-
-        case ResponseUploadFileError:
-            qDebug() << (QString("ResponseUploadFileError: ") + QString::fromStdString(data.toStdString()));
-            displayError(QString::fromStdString(data.toStdString()));
-            break;
-
-        case ResponseDownloadFileSuccess:
-            qDebug() << (QString("ResponseDownloadFileSuccess: OK"));
-            processDownload(data);
-            break;
-
-        case ResponseDownloadFileError:
-            qDebug() << (QString("ResponseDownloadFileError: ") + QString::fromStdString(data.toStdString()));
-            displayError(QString::fromStdString(data.toStdString()));
-            break;
-
         case ResponseDeleteSuccess:
             processGet(data);
 
@@ -690,6 +534,15 @@ void MainWindow::handleMessage(QByteArray data) {
             displayError(QString::fromStdString(data.toStdString()));
             break;
 
+        case ResponseSearchSuccess:
+            processSearch(data);
+            break;
+
+        case ResponseSearchError:
+            qDebug() << (QString("ResponseSearchError: ") + QString::fromStdString(data.toStdString()));
+            displayError(QString::fromStdString(data.toStdString()));
+            break;
+
         default:
             break;
     }
@@ -697,40 +550,133 @@ void MainWindow::handleMessage(QByteArray data) {
 
 void MainWindow::processGet(QByteArray data) {
     QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
-    this->jsonData = jsonDoc.object();
+    QString node = jsonDoc.object().value("node").toString();
+    if (!node.isEmpty()) {
+        processNodeTree(node, jsonDoc.object());
+        return;
+    }
+
+    treeIndex.rebuild(jsonDoc.object());
     updateCurrent();
     updateListWidget();
-}
 
-void MainWindow::processDownload(QByteArray data) {
-    QString header = data.mid(0, 128);
-    data = data.mid(128);
+    // Servers that version groups send the tag in the tree; otherwise hash what was received.
+    QByteArray tag = jsonDoc.object().value("etag").toString().toLatin1();
+    if (tag.isEmpty()) {
+        tag = TreeCache::tag(data);
+    }
+
+    if (tag != treeTag) {
+        treeTag = tag;
+        if (treeCache && !currentUser.isEmpty()) {
+            treeCache->store(currentUser, jsonDoc.object(), treeTag);
+        }
+    }
+}
 
-    QStringList list = header.split(",");
-    if (list.size() < 2) {
-        qDebug() << ("processDownloadFile: Invalid data");
-        QMessageBox::warning(this, "Download", "Invalid data");
+void MainWindow::processSearch(QByteArray data) {
+    QJsonObject result = QJsonDocument::fromJson(data).object();
+    if (!searching || result.value("query").toString() != searchQuery) {
         return;
     }
 
-    QString filename = list[0];
-    QString size = list[1];
+    // Hits already in the tree are shown as its nodes, so they carry sizes, hashes and children.
+    foreach (const QJsonValue& value, result.value("hits").toArray()) {
+        QJsonObject hit = value.toObject();
+        QString path = hit.value("path").toString();
+        if (searchPaths.contains(path)) {
+            continue;
+        }
+        searchPaths.insert(path);
+        searchHits.append(treeIndex.contains(path) ? treeIndex.node(path) : hit);
+    }
 
-    qDebug() << ("Download file " + filename);
+    showSearchResults();
+}
 
-    QString filePath = QFileDialog::getSaveFileName(this, tr("Save File"), QDir::currentPath() + QDir::separator() + filename);
-    qDebug() << ("Download save on " + filePath);
-    if (filePath.isEmpty()) {
-        QMessageBox::information(this,"Download", QString("File %1 discarded.").arg(filename));
-        return;
+void MainWindow::processNodeTree(const QString &node, const QJsonObject &tree) {
+    nodeTrees.insert(node, tree);
+    nodeTags.insert(node, tree.value("etag").toString().toLatin1());
+    foreach (const QJsonValue& group, tree.value("children").toArray()) {
+        connection->setOwner(group.toObject().value("name").toString(), node);
     }
 
-    QFile file(filePath);
-    if (file.open(QIODevice::WriteOnly)) {
-        file.write(data);
-        QString message = QString("Download file successfully stored on disk under the path %2").arg(QString(filePath));
-        qDebug() << message;
-    } else {
-        QMessageBox::critical(this,"Download", "An error occurred while trying to write the file.");
+    // Nodes that joined since the last look are asked for their part too.
+    foreach (const QJsonValue& value, tree.value("nodes").toArray()) {
+        QString other = value.toString();
+        if (!other.isEmpty() && !nodeTags.contains(other)) {
+            nodeTags.insert(other, QByteArray());
+            connection->sendTo(other, RequestGet, currentUser.toUtf8());
+        }
     }
+
+    // A group being handed between nodes can briefly show up on both; the first one wins.
+    QJsonArray children;
+    QJsonObject tags;
+    QSet<QString> seen;
+    for (QMap<QString, QJsonObject>::const_iterator it = nodeTrees.constBegin(); it != nodeTrees.constEnd(); ++it) {
+        foreach (const QJsonValue& value, it.value().value("children").toArray()) {
+            QJsonObject group = value.toObject();
+            QString name = group.value("name").toString().toLower();
+            if (seen.contains(name)) {
+                continue;
+            }
+            seen.insert(name);
+            group.insert("node", it.key());
+            children.append(group);
+        }
+    }
+    for (QMap<QString, QByteArray>::const_iterator it = nodeTags.constBegin(); it != nodeTags.constEnd(); ++it) {
+        tags.insert(it.key(), QString::fromLatin1(it.value()));
+    }
+
+    QJsonObject merged;
+    merged.insert("name", "");
+    merged.insert("path", "");
+    merged.insert("type", "root");
+    merged.insert("children", children);
+    merged.insert("tags", tags);
+
+    treeIndex.rebuild(merged);
+    updateCurrent();
+    updateListWidget();
+
+    QByteArray tag = TreeCache::tag(QJsonDocument(tags).toJson(QJsonDocument::Compact));
+    if (tag != treeTag) {
+        treeTag = tag;
+        if (treeCache && !currentUser.isEmpty()) {
+            treeCache->store(currentUser, merged, treeTag);
+        }
+    }
+}
+
+void MainWindow::showCachedTree() {
+    QJsonObject tree;
+    QByteArray tag;
+    if (!treeCache || !treeCache->load(currentUser, tree, tag)) {
+        tree = QJsonObject();
+        tag.clear();
+    }
+
+    // A tree merged from cluster nodes is split back into their parts, each with its own tag.
+    nodeTrees.clear();
+    nodeTags.clear();
+    QJsonObject tags = tree.value("tags").toObject();
+    for (QJsonObject::const_iterator it = tags.constBegin(); it != tags.constEnd(); ++it) {
+        nodeTags.insert(it.key(), it.value().toString().toLatin1());
+
+        QJsonArray children;
+        foreach (const QJsonValue& value, tree.value("children").toArray()) {
+            if (value.toObject().value("node").toString() == it.key()) {
+                children.append(value);
+                connection->setOwner(value.toObject().value("name").toString(), it.key());
+            }
+        }
+        nodeTrees.insert(it.key(), QJsonObject({{"children", children}}));
+    }
+
+    // Shown until the revalidating Get answers; an empty tree for a first sign-in.
+    treeTag = tag;
+    treeIndex.rebuild(tree);
+    updateListWidget();
 }
@@ -2,16 +2,21 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTcpSocket>
-#include <QHostAddress>
 #include <QStringListModel>
 #include <QMap>
 #include <QPair>
+#include <QSet>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 
-#include "itemfile.h"
+#include "blobcache.h"
+#include "filelistmodel.h"
+#include "filetreeindex.h"
+#include "serverconnection.h"
+#include "transferdialog.h"
+#include "transfermanager.h"
+#include "treecache.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -31,10 +36,10 @@ private slots:
 
     void updateCurrent();
     void updateListWidget();
+    void showSearchResults();
 
-    void onReadyRead();
-    void onSocketDisconnected();
-    void onErrorOccurred(QAbstractSocket::SocketError error);
+    void onConnectionStateChanged(ServerConnection::State state);
+    void onReauthenticationFailed(QString message);
 
     void sendSignIn();
     void sendSignUp();
@@ -46,19 +51,37 @@ private slots:
     void sendUpload();
     void sendDownload(QJsonObject object);
     void sendDelete(QJsonObject object);
+    void sendSearch(const QString &query);
 
     void handleMessage(QByteArray data);
     void processGet(QByteArray data);
-    void processDownload(QByteArray data);
+    void processNodeTree(const QString &node, const QJsonObject &tree);
+    void processSearch(QByteArray data);
+    void showCachedTree();
 
 private:
+    static constexpr int SearchPageSize = 100;
+
     Ui::MainWindow *ui;
 
     QStringListModel *model;
-    QTcpSocket *socket;
-    QList<ItemFile*> items;
-    QJsonObject jsonData, current;
+    ServerConnection *connection;
+    TransferManager *transferManager;
+    TransferDialog *transferDialog;
+    FileListModel *fileModel;
+    FileTreeIndex treeIndex;
+    TreeCache *treeCache;
+    BlobCache *blobCache;
+    QByteArray treeTag;
+    QMap<QString, QJsonObject> nodeTrees;
+    QMap<QString, QByteArray> nodeTags;
+    QJsonObject current;
     QString currentUser;
+    QString baseTitle;
+    bool searching;
+    QString searchQuery;
+    QJsonArray searchHits;
+    QSet<QString> searchPaths;
 };
 
 #endif // MAINWINDOW_H
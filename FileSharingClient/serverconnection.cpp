@@ -0,0 +1,429 @@
+#include "serverconnection.h"
+
+#include <QDataStream>
+#include <QRandomGenerator>
+
+ServerConnection::ServerConnection(const QString& host, quint16 port, int initialDelay, int maxDelay, QObject* parent) : QObject(parent), m_host(host), m_port(port) {
+    this->initialDelay = qMax(10, initialDelay);
+    this->maxDelay = qMax(this->initialDelay, maxDelay);
+    delay = this->initialDelay;
+    m_state = Disconnected;
+    authenticating = false;
+    session = 0;
+    origin = nullptr;
+
+    socket = new QTcpSocket(this);
+    connect(socket, &QTcpSocket::connected, this, &ServerConnection::onConnected);
+    connect(socket, &QTcpSocket::disconnected, this, &ServerConnection::onDisconnected);
+    connect(socket, &QTcpSocket::readyRead, this, &ServerConnection::onReadyRead);
+    connect(socket, &QAbstractSocket::errorOccurred, this, &ServerConnection::onErrorOccurred);
+
+    reconnectTimer.setSingleShot(true);
+    connect(&reconnectTimer, &QTimer::timeout, this, &ServerConnection::connectToServer);
+
+    // A coarse timer may fire early, before the server is ready to take the request again.
+    retryTimer.setSingleShot(true);
+    retryTimer.setTimerType(Qt::PreciseTimer);
+    connect(&retryTimer, &QTimer::timeout, this, &ServerConnection::flush);
+
+    heartbeatTimeout = DefaultHeartbeatTimeout;
+    heartbeatTimer.setInterval(DefaultHeartbeatInterval);
+    connect(&heartbeatTimer, &QTimer::timeout, this, &ServerConnection::onHeartbeat);
+    connect(socket, &QTcpSocket::bytesWritten, this, [this]() {
+        lastActivity.start();
+    });
+}
+
+ServerConnection::State ServerConnection::state() const {
+    return m_state;
+}
+
+QString ServerConnection::host() const {
+    return m_host;
+}
+
+quint16 ServerConnection::port() const {
+    return m_port;
+}
+
+QString ServerConnection::errorString() const {
+    return socket->errorString();
+}
+
+void ServerConnection::start() {
+    connectToServer();
+}
+
+void ServerConnection::send(Request type, const QByteArray& payload, QObject* context, const std::function<void(QByteArray)>& done) {
+    // Requests for a group whose node is known go straight to that node.
+    sendTo(owners.value(groupOf(type, payload).toLower()), type, payload, context, done);
+}
+
+void ServerConnection::sendTo(const QString& node, Request type, const QByteArray& payload, QObject* context, const std::function<void(QByteArray)>& done) {
+    Outgoing request;
+    request.type = type;
+    request.payload = payload;
+    request.internal = false;
+    request.hops = 0;
+    request.context = context;
+    request.done = done;
+
+    ServerConnection* target = node.isEmpty() ? this : peer(node);
+    (target ? target : this)->enqueue(request);
+}
+
+void ServerConnection::setOwner(const QString& group, const QString& node) {
+    owners.insert(group.toLower(), node);
+}
+
+void ServerConnection::setHeartbeat(int interval, int timeout) {
+    heartbeatTimer.setInterval(qMax(0, interval));
+    heartbeatTimeout = qMax(0, timeout);
+    if (interval <= 0) {
+        heartbeatTimer.stop();
+    } else if (m_state == Connected) {
+        heartbeatTimer.start();
+    }
+
+    foreach (ServerConnection* peer, peers) {
+        peer->setHeartbeat(interval, timeout);
+    }
+}
+
+void ServerConnection::connectToServer() {
+    if (socket->state() != QAbstractSocket::UnconnectedState) {
+        return;
+    }
+
+    setState(Connecting);
+    socket->connectToHost(m_host, m_port);
+}
+
+void ServerConnection::onConnected() {
+    delay = initialDelay;
+    session++;
+    setState(Connected);
+    lastActivity.start();
+    if (heartbeatTimer.interval() > 0) {
+        heartbeatTimer.start();
+    }
+
+    // Anything sent before the drop was never answered; resend it in order.
+    while (!inflight.isEmpty()) {
+        Outgoing request = inflight.takeLast();
+        if (!request.internal) {
+            queue.prepend(request);
+        }
+    }
+
+    if (!credentials.isEmpty()) {
+        Outgoing signIn;
+        signIn.type = RequestSignIn;
+        signIn.payload = credentials;
+        signIn.internal = true;
+        signIn.hops = 0;
+
+        authenticating = true;
+        write(signIn);
+    }
+
+    flush();
+}
+
+void ServerConnection::onDisconnected() {
+    authenticating = false;
+    heartbeatTimer.stop();
+    scheduleReconnect();
+}
+
+void ServerConnection::onErrorOccurred(QAbstractSocket::SocketError error) {
+    Q_UNUSED(error);
+
+    // A failed connect attempt never reaches connected/disconnected.
+    if (socket->state() == QAbstractSocket::UnconnectedState) {
+        scheduleReconnect();
+    }
+}
+
+void ServerConnection::onReadyRead() {
+    // Part of a large response counts as a sign of life too.
+    lastActivity.start();
+
+    QDataStream socketStream(socket);
+    socketStream.setVersion(QDataStream::Qt_5_15);
+
+    forever {
+        socketStream.startTransaction();
+
+        QByteArray data;
+        socketStream >> data;
+
+        if (!socketStream.commitTransaction()) {
+            // The last answer to a request sent after a refused one may just have come in.
+            if (!refused.isEmpty()) {
+                flush();
+            }
+            return;
+        }
+
+        Outgoing request;
+        bool matched = !inflight.isEmpty();
+        if (matched) {
+            request = inflight.dequeue();
+        }
+
+        int responseCode = data.mid(0, 8).toInt();
+
+        if (matched && responseCode == ResponseSignInSuccess) {
+            m_node = QString::fromUtf8(data.mid(8)).section(';', 1);
+        }
+
+        if (matched && responseCode == ResponseRetryLater) {
+            retryLater(request, QString::fromUtf8(data.mid(8)).section(';', 0, 0).toInt());
+            continue;
+        }
+
+        if (matched && request.internal) {
+            if (request.type == RequestSignIn) {
+                authenticating = false;
+                if (responseCode != ResponseSignInSuccess) {
+                    setCredentials(QByteArray());
+                    emit reauthenticationFailed(QString::fromUtf8(data.mid(8)));
+                }
+                flush();
+            }
+            continue;
+        }
+
+        // Past MaxRedirects the redirect is delivered as is, so misconfigured servers
+        // cannot bounce a request between them forever.
+        if (matched && responseCode == ResponseRedirect && request.hops < MaxRedirects && redirect(request, QString::fromUtf8(data.mid(8)))) {
+            continue;
+        }
+
+        if (matched && request.type == RequestSignIn && responseCode == ResponseSignInSuccess) {
+            setCredentials(request.payload);
+        } else if (matched && request.type == RequestSignOut && responseCode == ResponseSignOutSuccess) {
+            setCredentials(QByteArray());
+        }
+
+        if (matched && request.done) {
+            if (request.context) {
+                request.done(data);
+            }
+            continue;
+        }
+
+        emit messageReceived(data);
+    }
+}
+
+void ServerConnection::onHeartbeat() {
+    if (m_state != Connected) {
+        return;
+    }
+
+    if (inflight.isEmpty()) {
+        if (lastActivity.elapsed() >= heartbeatTimer.interval()) {
+            Outgoing ping;
+            ping.type = RequestPing;
+            ping.internal = true;
+            ping.hops = 0;
+            write(ping);
+        }
+        return;
+    }
+
+    // The server answers every request, pings included, so silence this long means the link is gone.
+    if (lastActivity.elapsed() > heartbeatTimer.interval() + heartbeatTimeout) {
+        socket->abort();
+    }
+}
+
+void ServerConnection::setState(State state) {
+    if (m_state == state) {
+        return;
+    }
+
+    m_state = state;
+    emit stateChanged(state);
+}
+
+void ServerConnection::flush() {
+    // Nothing goes out until the replayed sign-in has been answered.
+    if (m_state != Connected || authenticating) {
+        return;
+    }
+
+    // Refused requests go out first, once their delay is over and everything sent after them has been answered.
+    if (!refused.isEmpty()) {
+        if (retryTimer.isActive() || !inflight.isEmpty()) {
+            return;
+        }
+        while (!refused.isEmpty()) {
+            queue.prepend(refused.takeLast());
+        }
+    }
+
+    while (!queue.isEmpty()) {
+        write(queue.dequeue());
+    }
+}
+
+void ServerConnection::write(const Outgoing& request) {
+    QByteArray typeArray = QByteArray::number(request.type);
+    typeArray.resize(8);
+
+    QDataStream socketStream(socket);
+    socketStream.setVersion(QDataStream::Qt_5_15);
+    socketStream << typeArray + request.payload;
+
+    inflight.enqueue(request);
+}
+
+void ServerConnection::scheduleReconnect() {
+    if (reconnectTimer.isActive()) {
+        return;
+    }
+
+    setState(Disconnected);
+
+    // Up to 20% jitter keeps clients from reconnecting in lockstep after a restart.
+    int jitter = QRandomGenerator::global()->bounded(delay / 5 + 1);
+    reconnectTimer.start(delay + jitter);
+    delay = qMin(delay * 2, maxDelay);
+}
+
+void ServerConnection::setCredentials(const QByteArray& credentials) {
+    if (this->credentials == credentials) {
+        return;
+    }
+    this->credentials = credentials;
+
+    // Peers sign in again as the new user, or stay signed out, on their next connect.
+    foreach (ServerConnection* peer, peers) {
+        peer->credentials = credentials;
+        peer->socket->abort();
+        peer->scheduleReconnect();
+    }
+}
+
+bool ServerConnection::redirect(Outgoing request, const QString& target) {
+    // Peers share the map of peers and group owners kept by the connection that made them.
+    if (origin) {
+        return origin->redirect(request, target);
+    }
+
+    // "host:port" names the primary of a replica; "host:port;group" the node owning a group.
+    QString node = target.section(';', 0, 0);
+    QString group = target.section(';', 1);
+    ServerConnection* connection = peer(node);
+    if (!connection) {
+        return false;
+    }
+
+    if (!group.isEmpty()) {
+        owners.insert(group.toLower(), node);
+    }
+
+    request.hops++;
+    connection->enqueue(request);
+    return true;
+}
+
+ServerConnection* ServerConnection::peer(const QString& node) {
+    if (origin) {
+        return origin->peer(node);
+    }
+
+    if (node == QString("%1:%2").arg(m_host).arg(m_port) || node == m_node) {
+        return this;
+    }
+
+    ServerConnection* connection = peers.value(node);
+    if (connection) {
+        return connection;
+    }
+
+    QString host = node.section(':', 0, -2);
+    quint16 port = node.section(':', -1).toUShort();
+    if (host.isEmpty() || port == 0) {
+        return nullptr;
+    }
+
+    connection = new ServerConnection(host, port, initialDelay, maxDelay, this);
+    connection->origin = this;
+    connection->credentials = credentials;
+    connection->setHeartbeat(heartbeatTimer.interval(), heartbeatTimeout);
+    connect(connection, &ServerConnection::messageReceived, this, &ServerConnection::messageReceived);
+    connect(connection, &ServerConnection::reauthenticationFailed, this, &ServerConnection::reauthenticationFailed);
+    peers.insert(node, connection);
+    connection->start();
+    return connection;
+}
+
+void ServerConnection::enqueue(const Outgoing& request) {
+    queue.enqueue(request);
+    flush();
+}
+
+void ServerConnection::retryLater(const Outgoing& request, int delay) {
+    // Whatever the server says, a refused client backs off at least a little and never forever.
+    delay = qBound(initialDelay, delay, maxDelay);
+    this->delay = qMax(this->delay, delay);
+
+    if (request.internal) {
+        if (request.type != RequestSignIn) {
+            return;
+        }
+
+        // Everything else keeps waiting behind the sign-in; a reconnect replays its own.
+        int current = session;
+        QTimer::singleShot(delay, this, [this, request, current]() {
+            if (current == session && m_state == Connected && authenticating) {
+                write(request);
+            }
+        });
+        return;
+    }
+
+    // Answers come in the order the requests were sent, so appending keeps that order.
+    refused.append(request);
+    if (!retryTimer.isActive() || retryTimer.remainingTime() < delay) {
+        retryTimer.start(delay);
+    }
+}
+
+QString ServerConnection::groupOf(Request type, const QByteArray& payload) {
+    QString path;
+    switch (type) {
+        case RequestCreateGroup:
+        case RequestJoinGroup:
+            return QString::fromUtf8(payload);
+
+        case RequestCreateFolder:
+        case RequestDownloadFile:
+        case RequestDelete:
+        case RequestUploadCancel:
+            path = QString::fromUtf8(payload);
+            break;
+
+        case RequestDownloadRange:
+        case RequestUploadHash:
+            path = QString::fromUtf8(payload).section(',', 2);
+            break;
+
+        case RequestUploadFile:
+            path = QString::fromUtf8(payload.left(256).constData());
+            break;
+
+        case RequestUploadRange:
+            path = QString::fromUtf8(payload.left(256).constData()).section(',', 2);
+            break;
+
+        default:
+            return QString();
+    }
+
+    return path.replace('\\', '/').section('/', 0, 0);
+}
@@ -0,0 +1,122 @@
+#ifndef SERVERCONNECTION_H
+#define SERVERCONNECTION_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <functional>
+
+#include "structs.h"
+
+// Owns the client's link to the server. Connecting never blocks; a lost
+// connection is retried with exponential backoff, the last successful sign-in
+// is replayed after every reconnect, and requests issued while offline wait in
+// an outbound queue. Requests that were sent but not yet answered when the link
+// dropped are sent again, since the server answers strictly in order. A request
+// sent with a callback has its response delivered there instead of through
+// messageReceived(). A request answered with a redirect, by a read-only replica
+// or by a cluster node that does not own the group, is sent again over another
+// connection to the server named, which signs in with the same credentials.
+// The owner of each group is remembered, so later requests for the group go
+// straight to its node. An idle link sends a ping every heartbeat interval so
+// the server does not close it, and a link that has requests outstanding but
+// has heard nothing for the interval plus the timeout is treated as dropped.
+// A request the server answers with ResponseRetryLater is sent again once the
+// delay it names has passed, without its sender ever seeing the refusal. It is
+// held back together with every request sent after it, which the server
+// refuses as well, and they all go out again in their original order.
+class ServerConnection : public QObject {
+    Q_OBJECT
+
+public:
+    enum State {
+        Disconnected,
+        Connecting,
+        Connected,
+    };
+
+    static constexpr int DefaultPort = 1234;
+    static constexpr int DefaultInitialDelay = 500;
+    static constexpr int DefaultMaxDelay = 30000;
+    static constexpr int MaxRedirects = 2;
+    static constexpr int DefaultHeartbeatInterval = 30000;
+    static constexpr int DefaultHeartbeatTimeout = 10000;
+
+    ServerConnection(const QString& host, quint16 port, int initialDelay, int maxDelay, QObject* parent = nullptr);
+
+    State state() const;
+    QString host() const;
+    quint16 port() const;
+    QString errorString() const;
+
+    void start();
+    void send(Request type, const QByteArray& payload, QObject* context = nullptr, const std::function<void(QByteArray)>& done = nullptr);
+    void sendTo(const QString& node, Request type, const QByteArray& payload, QObject* context = nullptr, const std::function<void(QByteArray)>& done = nullptr);
+    void setOwner(const QString& group, const QString& node);
+    void setHeartbeat(int interval, int timeout);
+
+signals:
+    void stateChanged(ServerConnection::State state);
+    void messageReceived(QByteArray data);
+    void reauthenticationFailed(QString message);
+
+private slots:
+    void connectToServer();
+    void onConnected();
+    void onDisconnected();
+    void onErrorOccurred(QAbstractSocket::SocketError error);
+    void onReadyRead();
+    void onHeartbeat();
+
+private:
+    struct Outgoing {
+        Request type;
+        QByteArray payload;
+        bool internal;
+        int hops;
+        QPointer<QObject> context;
+        std::function<void(QByteArray)> done;
+    };
+
+    void setState(State state);
+    void flush();
+    void write(const Outgoing& request);
+    void scheduleReconnect();
+    void setCredentials(const QByteArray& credentials);
+    bool redirect(Outgoing request, const QString& target);
+    ServerConnection* peer(const QString& node);
+    void enqueue(const Outgoing& request);
+    void retryLater(const Outgoing& request, int delay);
+    static QString groupOf(Request type, const QByteArray& payload);
+
+    QTcpSocket* socket;
+    QTimer reconnectTimer;
+    QTimer heartbeatTimer;
+    QTimer retryTimer;
+    QElapsedTimer lastActivity;
+    int heartbeatTimeout;
+    QString m_host;
+    quint16 m_port;
+    int initialDelay;
+    int maxDelay;
+    int delay;
+    State m_state;
+    bool authenticating;
+    int session;
+
+    QQueue<Outgoing> queue;
+    QQueue<Outgoing> inflight;
+    QList<Outgoing> refused;
+    QByteArray credentials;
+    QString m_node;
+    ServerConnection* origin;
+    QHash<QString, ServerConnection*> peers;
+    QHash<QString, QString> owners;
+};
+
+#endif // SERVERCONNECTION_H
@@ -0,0 +1,76 @@
+#include "transferdialog.h"
+
+#include <QApplication>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QStyledItemDelegate>
+#include <QVBoxLayout>
+
+namespace {
+
+class ProgressDelegate : public QStyledItemDelegate {
+public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override {
+        if (index.column() != TransferManager::ProgressColumn) {
+            QStyledItemDelegate::paint(painter, option, index);
+            return;
+        }
+
+        QStyleOptionProgressBar bar;
+        bar.rect = option.rect.adjusted(2, 2, -2, -2);
+        bar.minimum = 0;
+        bar.maximum = 100;
+        bar.progress = index.data(TransferManager::ProgressRole).toInt();
+        bar.text = index.data().toString();
+        bar.textVisible = true;
+        bar.state = option.state | QStyle::State_Horizontal;
+
+        QApplication::style()->drawControl(QStyle::CE_ProgressBar, &bar, painter);
+    }
+};
+
+}
+
+TransferDialog::TransferDialog(TransferManager* manager, QWidget* parent) : QDialog(parent), manager(manager) {
+    setWindowTitle("Transfers");
+    resize(640, 300);
+
+    view = new QTableView(this);
+    view->setModel(manager);
+    view->setItemDelegate(new ProgressDelegate(view));
+    view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    view->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    view->verticalHeader()->hide();
+    view->horizontalHeader()->setSectionResizeMode(TransferManager::NameColumn, QHeaderView::Stretch);
+    view->setColumnWidth(TransferManager::ProgressColumn, 180);
+
+    QPushButton* btnCancel = new QPushButton("Cancel", this);
+    QPushButton* btnClear = new QPushButton("Clear Finished", this);
+    QPushButton* btnClose = new QPushButton("Close", this);
+
+    connect(btnCancel, &QPushButton::clicked, this, [this]() {
+        QModelIndexList rows = view->selectionModel()->selectedRows();
+        for (const QModelIndex& index : rows) {
+            this->manager->cancel(index.row());
+        }
+    });
+
+    connect(btnClear, &QPushButton::clicked, this, [this]() {
+        this->manager->clearFinished();
+    });
+
+    connect(btnClose, &QPushButton::clicked, this, &QDialog::hide);
+
+    QHBoxLayout* buttons = new QHBoxLayout();
+    buttons->addWidget(btnCancel);
+    buttons->addWidget(btnClear);
+    buttons->addStretch();
+    buttons->addWidget(btnClose);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(view);
+    layout->addLayout(buttons);
+}
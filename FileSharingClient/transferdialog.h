@@ -0,0 +1,22 @@
+#ifndef TRANSFERDIALOG_H
+#define TRANSFERDIALOG_H
+
+#include <QDialog>
+#include <QTableView>
+
+#include "transfermanager.h"
+
+// Non-modal window listing the transfers of a TransferManager with their
+// progress, speed and remaining time, and buttons to cancel or clear them.
+class TransferDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit TransferDialog(TransferManager* manager, QWidget* parent = nullptr);
+
+private:
+    TransferManager* manager;
+    QTableView* view;
+};
+
+#endif // TRANSFERDIALOG_H
@@ -0,0 +1,537 @@
+#include "transfermanager.h"
+
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QTime>
+#include <QtConcurrent>
+
+TransferManager::TransferManager(ServerConnection* connection, int concurrent, qint64 chunkSize, int window, bool offerHashes, QObject* parent) : QAbstractTableModel(parent), connection(connection), offerHashes(offerHashes) {
+    cache = nullptr;
+    this->concurrent = qMax(1, concurrent);
+    // The server answers at most one mebibyte per range.
+    this->chunkSize = qBound<qint64>(4096, chunkSize, 1024 * 1024);
+    this->window = qMax(1, window);
+    nextId = 0;
+}
+
+void TransferManager::upload(const QString& localPath, const QString& remotePath) {
+    Transfer transfer;
+    transfer.direction = Upload;
+    transfer.localPath = localPath;
+    transfer.remotePath = remotePath;
+    transfer.size = QFileInfo(localPath).size();
+    add(transfer);
+}
+
+void TransferManager::download(const QString& remotePath, const QString& localPath, qint64 size, const QString& hash) {
+    Transfer transfer;
+    transfer.direction = Download;
+    transfer.localPath = localPath;
+    transfer.remotePath = remotePath;
+    transfer.size = size;
+    transfer.hash = hash;
+    add(transfer);
+}
+
+void TransferManager::setBlobCache(BlobCache* cache) {
+    this->cache = cache;
+}
+
+void TransferManager::cancel(int row) {
+    if (row < 0 || row >= transfers.size()) {
+        return;
+    }
+
+    Transfer& transfer = transfers[row];
+    if (isActive(transfer.state)) {
+        finish(transfer, Cancelled);
+        schedule();
+    }
+}
+
+void TransferManager::cancelAll() {
+    for (int i = 0; i < transfers.size(); i++) {
+        Transfer& transfer = transfers[i];
+        if (isActive(transfer.state)) {
+            finish(transfer, Cancelled);
+        }
+    }
+}
+
+void TransferManager::clearFinished() {
+    for (int i = transfers.size() - 1; i >= 0; i--) {
+        if (isActive(transfers[i].state)) {
+            continue;
+        }
+
+        beginRemoveRows(QModelIndex(), i, i);
+        transfers.remove(i);
+        endRemoveRows();
+    }
+}
+
+int TransferManager::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : transfers.size();
+}
+
+int TransferManager::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant TransferManager::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= transfers.size()) {
+        return QVariant();
+    }
+
+    const Transfer& transfer = transfers[index.row()];
+    bool running = transfer.state == Running;
+
+    switch (role) {
+        case Qt::DisplayRole:
+            switch (index.column()) {
+                case NameColumn:
+                    return QString(transfer.direction == Upload ? "↑ " : "↓ ") + QFileInfo(transfer.remotePath).fileName();
+
+                case ProgressColumn:
+                    return QString("%1 / %2").arg(formatSize(transfer.done), formatSize(transfer.size));
+
+                case RateColumn:
+                    return running && transfer.rate > 0 ? formatSize(transfer.rate) + "/s" : QString();
+
+                case EtaColumn:
+                    if (running && transfer.rate > 0) {
+                        int seconds = int((transfer.size - transfer.done) / transfer.rate);
+                        return QTime(0, 0).addSecs(seconds).toString("h:mm:ss");
+                    }
+                    return QString();
+
+                case StateColumn:
+                    switch (transfer.state) {
+                        case Queued: return QString("Queued");
+                        case Checking: return QString(transfer.direction == Upload ? "Checking" : "Copying from cache");
+                        case Running: return QString(transfer.direction == Upload ? "Uploading" : "Downloading");
+                        case Finished: return QString("Done");
+                        case Failed: return QString("Failed: ") + transfer.error;
+                        case Cancelled: return QString("Cancelled");
+                    }
+                    break;
+            }
+            break;
+
+        case Qt::ToolTipRole:
+            return transfer.direction == Upload ? QString("%1 → %2").arg(transfer.localPath, transfer.remotePath)
+                                                : QString("%1 → %2").arg(transfer.remotePath, transfer.localPath);
+
+        case ProgressRole:
+            return transfer.size > 0 ? int(transfer.done * 100 / transfer.size) : (transfer.state == Finished ? 100 : 0);
+
+        case ActiveRole:
+            return isActive(transfer.state);
+    }
+
+    return QVariant();
+}
+
+QVariant TransferManager::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (section) {
+        case NameColumn: return QString("Name");
+        case ProgressColumn: return QString("Progress");
+        case RateColumn: return QString("Speed");
+        case EtaColumn: return QString("Remaining");
+        case StateColumn: return QString("Status");
+    }
+    return QVariant();
+}
+
+void TransferManager::add(const Transfer& transfer) {
+    Transfer entry = transfer;
+    entry.id = nextId++;
+    entry.state = Queued;
+    entry.requested = 0;
+    entry.done = 0;
+    entry.inflight = 0;
+    entry.finalSent = false;
+    entry.sampleTime = 0;
+    entry.sampleDone = 0;
+    entry.rate = 0;
+
+    beginInsertRows(QModelIndex(), transfers.size(), transfers.size());
+    transfers.append(entry);
+    endInsertRows();
+
+    emit transferAdded();
+    schedule();
+}
+
+int TransferManager::rowOf(int id) const {
+    for (int i = 0; i < transfers.size(); i++) {
+        if (transfers[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TransferManager::schedule() {
+    int running = 0;
+    for (const Transfer& transfer : qAsConst(transfers)) {
+        running += isActive(transfer.state) && transfer.state != Queued ? 1 : 0;
+    }
+
+    for (int i = 0; i < transfers.size() && running < concurrent; i++) {
+        Transfer& transfer = transfers[i];
+        if (transfer.state != Queued) {
+            continue;
+        }
+
+        if (transfer.direction == Download && cache && cache->contains(transfer.hash)) {
+            transfer.clock.start();
+            running++;
+            copyFromCache(transfer);
+            continue;
+        }
+
+        transfer.file.reset(new QFile(transfer.localPath));
+        if (!transfer.file->open(transfer.direction == Upload ? QIODevice::ReadOnly : QIODevice::WriteOnly)) {
+            finish(transfer, Failed, transfer.file->errorString());
+            continue;
+        }
+
+        if (transfer.direction == Upload) {
+            transfer.size = transfer.file->size();
+        }
+
+        transfer.clock.start();
+        running++;
+
+        if (transfer.direction == Upload && offerHashes) {
+            transfer.state = Checking;
+            changed(transfer);
+
+            int id = transfer.id;
+            QFutureWatcher<QString>* watcher = new QFutureWatcher<QString>(this);
+            connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, id]() {
+                watcher->deleteLater();
+                offer(id, watcher->result());
+            });
+            watcher->setFuture(QtConcurrent::run(&TransferManager::hashFile, transfer.localPath));
+            continue;
+        }
+
+        transfer.state = Running;
+        changed(transfer);
+        fill(transfer);
+    }
+}
+
+void TransferManager::offer(int id, const QString& hash) {
+    int row = rowOf(id);
+    if (row < 0 || transfers[row].state != Checking) {
+        return;
+    }
+
+    Transfer& transfer = transfers[row];
+    if (hash.isEmpty()) {
+        transfer.state = Running;
+        changed(transfer);
+        fill(transfer);
+        return;
+    }
+
+    // Any answer but success, a miss included, falls back to sending the bytes.
+    QString payload = QString("%1,%2,%3").arg(transfer.size).arg(hash, transfer.remotePath);
+    connection->send(RequestUploadHash, payload.toUtf8(), this, [this, id](QByteArray data) {
+        int row = rowOf(id);
+        if (row < 0 || transfers[row].state != Checking) {
+            return;
+        }
+
+        Transfer& transfer = transfers[row];
+        if (data.mid(0, 8).toInt() == ResponseUploadHashSuccess) {
+            transfer.done = transfer.size;
+            finish(transfer, Finished);
+            emit treeReceived(data.mid(8));
+            schedule();
+            return;
+        }
+
+        transfer.state = Running;
+        changed(transfer);
+        fill(transfer);
+    });
+}
+
+void TransferManager::copyFromCache(Transfer& transfer) {
+    transfer.state = Checking;
+    changed(transfer);
+
+    int id = transfer.id;
+    BlobCache* cache = this->cache;
+    QString hash = transfer.hash;
+    QString localPath = transfer.localPath;
+
+    QFutureWatcher<bool>* watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, id]() {
+        watcher->deleteLater();
+        onCopied(id, watcher->result());
+    });
+    watcher->setFuture(QtConcurrent::run([cache, hash, localPath]() {
+        return cache->copyTo(hash, localPath);
+    }));
+}
+
+void TransferManager::onCopied(int id, bool copied) {
+    int row = rowOf(id);
+    if (row < 0 || transfers[row].state != Checking) {
+        // Cancelled while copying; the copy finished after the cleanup.
+        if (copied && row >= 0) {
+            QFile::remove(transfers[row].localPath);
+        }
+        return;
+    }
+
+    Transfer& transfer = transfers[row];
+    if (copied) {
+        transfer.done = transfer.size;
+        finish(transfer, Finished);
+        schedule();
+        return;
+    }
+
+    // The blob may have been evicted in the meantime; fetch it from the server.
+    transfer.file.reset(new QFile(transfer.localPath));
+    if (!transfer.file->open(QIODevice::WriteOnly)) {
+        finish(transfer, Failed, transfer.file->errorString());
+        schedule();
+        return;
+    }
+
+    transfer.state = Running;
+    changed(transfer);
+    fill(transfer);
+}
+
+void TransferManager::fill(Transfer& transfer) {
+    while (transfer.state == Running && transfer.inflight < window && !transfer.finalSent) {
+        requestRange(transfer);
+    }
+}
+
+void TransferManager::requestRange(Transfer& transfer) {
+    int id = transfer.id;
+    qint64 offset = transfer.requested;
+    qint64 length = qMax<qint64>(0, qMin(chunkSize, transfer.size - offset));
+
+    if (transfer.direction == Download) {
+        QString payload = QString("%1,%2,%3").arg(offset).arg(length).arg(transfer.remotePath);
+        connection->send(RequestDownloadRange, payload.toUtf8(), this, [this, id, offset, length](QByteArray data) {
+            onDownloadRange(id, offset, length, data);
+        });
+    } else {
+        QByteArray bytes;
+        if (!transfer.file->seek(offset) || (bytes = transfer.file->read(length)).size() != length) {
+            finish(transfer, Failed, "The file could not be read");
+            schedule();
+            return;
+        }
+
+        QByteArray header = QString("%1,%2,%3").arg(offset).arg(transfer.size).arg(transfer.remotePath).toUtf8();
+        header.resize(256);
+
+        connection->send(RequestUploadRange, header + bytes, this, [this, id, length](QByteArray data) {
+            onUploadRange(id, length, data);
+        });
+    }
+
+    transfer.requested += length;
+    transfer.inflight++;
+    transfer.finalSent = transfer.requested >= transfer.size;
+}
+
+void TransferManager::onDownloadRange(int id, qint64 offset, qint64 length, QByteArray data) {
+    int row = rowOf(id);
+    if (row < 0) {
+        return;
+    }
+
+    Transfer& transfer = transfers[row];
+    transfer.inflight--;
+    if (transfer.state != Running) {
+        return;
+    }
+
+    int responseCode = data.mid(0, 8).toInt();
+    if (responseCode != ResponseDownloadRangeSuccess) {
+        finish(transfer, Failed, QString::fromUtf8(data.mid(8)));
+        schedule();
+        return;
+    }
+
+    QString header = QString::fromUtf8(data.mid(8, 128));
+    QByteArray bytes = data.mid(8 + 128);
+
+    // A different hash means the file was replaced between two ranges.
+    QString hash = header.section(',', 1, 1);
+    if (!hash.isEmpty() && !transfer.hash.isEmpty() && hash != transfer.hash) {
+        finish(transfer, Failed, "The file changed during the download");
+        schedule();
+        return;
+    }
+    if (!hash.isEmpty()) {
+        transfer.hash = hash;
+    }
+
+    // The listing the download started from may be stale; the server's size wins.
+    qint64 size = header.section(',', 0, 0).toLongLong();
+    if (size != transfer.size) {
+        transfer.size = size;
+        transfer.finalSent = transfer.requested >= transfer.size;
+    }
+
+    if (bytes.size() < qMin(length, transfer.size - offset)) {
+        finish(transfer, Failed, "The file changed during the download");
+        schedule();
+        return;
+    }
+
+    if (!transfer.file->seek(offset) || transfer.file->write(bytes) != bytes.size()) {
+        finish(transfer, Failed, transfer.file->errorString());
+        schedule();
+        return;
+    }
+
+    advance(transfer, bytes.size());
+
+    if (transfer.finalSent && transfer.inflight == 0) {
+        finish(transfer, Finished);
+        storeInCache(transfer);
+        schedule();
+        return;
+    }
+
+    fill(transfer);
+}
+
+void TransferManager::onUploadRange(int id, qint64 length, QByteArray data) {
+    int row = rowOf(id);
+    if (row < 0) {
+        return;
+    }
+
+    Transfer& transfer = transfers[row];
+    transfer.inflight--;
+    if (transfer.state != Running) {
+        return;
+    }
+
+    int responseCode = data.mid(0, 8).toInt();
+    if (responseCode != ResponseUploadRangeSuccess) {
+        finish(transfer, Failed, QString::fromUtf8(data.mid(8)));
+        schedule();
+        return;
+    }
+
+    advance(transfer, length);
+
+    if (transfer.finalSent && transfer.inflight == 0) {
+        // The range that completes the file is answered with the updated tree.
+        finish(transfer, Finished);
+        emit treeReceived(data.mid(8));
+        schedule();
+        return;
+    }
+
+    fill(transfer);
+}
+
+void TransferManager::advance(Transfer& transfer, qint64 bytes) {
+    transfer.done += bytes;
+
+    qint64 now = transfer.clock.elapsed();
+    qint64 elapsed = now - transfer.sampleTime;
+    if (elapsed >= 250) {
+        double rate = (transfer.done - transfer.sampleDone) * 1000.0 / elapsed;
+        transfer.rate = transfer.rate > 0 ? 0.7 * transfer.rate + 0.3 * rate : rate;
+        transfer.sampleTime = now;
+        transfer.sampleDone = transfer.done;
+    }
+
+    changed(transfer);
+}
+
+void TransferManager::finish(Transfer& transfer, State state, const QString& error) {
+    transfer.state = state;
+    transfer.error = error;
+
+    if (transfer.file) {
+        transfer.file->close();
+        transfer.file.reset();
+    }
+
+    if (state != Finished) {
+        if (transfer.direction == Download) {
+            QFile::remove(transfer.localPath);
+        } else if (transfer.requested > 0) {
+            // Sent after the outstanding ranges, so the server drops the partial file last.
+            connection->send(RequestUploadCancel, transfer.remotePath.toUtf8(), this, [this](QByteArray data) {
+                if (data.mid(0, 8).toInt() == ResponseUploadCancelSuccess) {
+                    emit treeReceived(data.mid(8));
+                }
+            });
+        }
+    }
+
+    changed(transfer);
+}
+
+void TransferManager::storeInCache(const Transfer& transfer) {
+    if (!cache || !BlobCache::isValidHash(transfer.hash)) {
+        return;
+    }
+
+    // Only bytes that hash to what the server announced are worth keeping.
+    BlobCache* cache = this->cache;
+    QString hash = transfer.hash;
+    QString localPath = transfer.localPath;
+    QtConcurrent::run([cache, hash, localPath]() {
+        if (hashFile(localPath) == hash) {
+            cache->store(hash, localPath);
+        }
+    });
+}
+
+void TransferManager::changed(const Transfer& transfer) {
+    int row = rowOf(transfer.id);
+    if (row >= 0) {
+        emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+    }
+}
+
+bool TransferManager::isActive(State state) {
+    return state == Queued || state == Checking || state == Running;
+}
+
+QString TransferManager::hashFile(const QString& fileName) {
+    QFile file(fileName);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!file.open(QIODevice::ReadOnly) || !hash.addData(&file)) {
+        return QString();
+    }
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString TransferManager::formatSize(double bytes) {
+    static const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+
+    int unit = 0;
+    while (bytes >= 1024 && unit < 4) {
+        bytes /= 1024;
+        unit++;
+    }
+    return QString("%1 %2").arg(bytes, 0, 'f', unit == 0 ? 0 : 1).arg(units[unit]);
+}
@@ -0,0 +1,126 @@
+#ifndef TRANSFERMANAGER_H
+#define TRANSFERMANAGER_H
+
+#include <QAbstractTableModel>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "blobcache.h"
+#include "serverconnection.h"
+
+// Uploads and downloads running in the background as a series of ranged
+// requests. At most `concurrent` transfers are active at a time, each with a
+// small window of ranges in flight, so memory is bounded by the chunk size
+// rather than the file size and other requests keep flowing in between.
+// Downloads are written to disk as each range arrives and uploads are read
+// from disk one range at a time. An upload is first offered by its SHA-256,
+// and its bytes are only sent if the server does not already hold them. A
+// download whose SHA-256 is already in the blob cache is copied locally.
+class TransferManager : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    enum Column {
+        NameColumn,
+        ProgressColumn,
+        RateColumn,
+        EtaColumn,
+        StateColumn,
+        ColumnCount,
+    };
+
+    enum Roles {
+        ProgressRole = Qt::UserRole + 1,
+        ActiveRole,
+    };
+
+    enum Direction {
+        Upload,
+        Download,
+    };
+
+    enum State {
+        Queued,
+        Checking,
+        Running,
+        Finished,
+        Failed,
+        Cancelled,
+    };
+
+    static constexpr int DefaultConcurrent = 3;
+    static constexpr qint64 DefaultChunkSize = 256 * 1024;
+    static constexpr int DefaultWindow = 4;
+
+    TransferManager(ServerConnection* connection, int concurrent, qint64 chunkSize, int window, bool offerHashes, QObject* parent = nullptr);
+
+    void upload(const QString& localPath, const QString& remotePath);
+    void download(const QString& remotePath, const QString& localPath, qint64 size, const QString& hash = QString());
+    void setBlobCache(BlobCache* cache);
+    void cancel(int row);
+    void cancelAll();
+    void clearFinished();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+signals:
+    void transferAdded();
+    void treeReceived(QByteArray data);
+
+private:
+    struct Transfer {
+        int id;
+        Direction direction;
+        State state;
+        QString remotePath;
+        QString localPath;
+        QString hash;
+        QSharedPointer<QFile> file;
+        qint64 size;
+        qint64 requested;
+        qint64 done;
+        int inflight;
+        bool finalSent;
+        QElapsedTimer clock;
+        qint64 sampleTime;
+        qint64 sampleDone;
+        double rate;
+        QString error;
+    };
+
+    void add(const Transfer& transfer);
+    int rowOf(int id) const;
+    void schedule();
+    void offer(int id, const QString& hash);
+    void copyFromCache(Transfer& transfer);
+    void onCopied(int id, bool copied);
+    void storeInCache(const Transfer& transfer);
+    void fill(Transfer& transfer);
+    void requestRange(Transfer& transfer);
+    void onDownloadRange(int id, qint64 offset, qint64 length, QByteArray data);
+    void onUploadRange(int id, qint64 length, QByteArray data);
+    void advance(Transfer& transfer, qint64 bytes);
+    void finish(Transfer& transfer, State state, const QString& error = QString());
+    void changed(const Transfer& transfer);
+
+    static bool isActive(State state);
+    static QString hashFile(const QString& fileName);
+    static QString formatSize(double bytes);
+
+    ServerConnection* connection;
+    int concurrent;
+    qint64 chunkSize;
+    int window;
+    bool offerHashes;
+    BlobCache* cache;
+    int nextId;
+    QVector<Transfer> transfers;
+};
+
+#endif // TRANSFERMANAGER_H
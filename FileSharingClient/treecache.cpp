@@ -0,0 +1,64 @@
+#include "treecache.h"
+
+#include <QCborMap>
+#include <QCborValue>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+TreeCache::TreeCache(const QString& directory, const QString& host, quint16 port) : directory(directory) {
+    server = QString("%1:%2").arg(host).arg(port);
+}
+
+bool TreeCache::load(const QString& user, QJsonObject& tree, QByteArray& tag) const {
+    QFile file(fileName(user));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QCborValue value = QCborValue::fromCbor(qUncompress(file.readAll()));
+    QCborMap entry = value.toMap();
+    if (entry.value("version").toInteger() != FormatVersion
+        || entry.value("server").toString() != server
+        || entry.value("user").toString().compare(user, Qt::CaseInsensitive) != 0) {
+        return false;
+    }
+
+    tree = entry.value("tree").toJsonValue().toObject();
+    tag = entry.value("tag").toByteArray();
+    return !tree.isEmpty() && !tag.isEmpty();
+}
+
+void TreeCache::store(const QString& user, const QJsonObject& tree, const QByteArray& tag) const {
+    if (!QDir().mkpath(directory)) {
+        return;
+    }
+
+    QCborMap entry;
+    entry.insert(QString("version"), FormatVersion);
+    entry.insert(QString("server"), server);
+    entry.insert(QString("user"), user);
+    entry.insert(QString("tag"), tag);
+    entry.insert(QString("tree"), QCborValue::fromJsonValue(tree));
+
+    QSaveFile file(fileName(user));
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(qCompress(entry.toCborValue().toCbor()));
+        file.commit();
+    }
+}
+
+QString TreeCache::defaultDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QDir::separator() + "trees";
+}
+
+QByteArray TreeCache::tag(const QByteArray& data) {
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+}
+
+QString TreeCache::fileName(const QString& user) const {
+    QByteArray key = QCryptographicHash::hash((server + "\n" + user.toLower()).toUtf8(), QCryptographicHash::Sha1).toHex();
+    return directory + QDir::separator() + QString::fromLatin1(key) + ".tree";
+}
@@ -0,0 +1,31 @@
+#ifndef TREECACHE_H
+#define TREECACHE_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+
+// The last tree received for each user of a server, kept on disk so that a
+// sign-in can show the folders straight away and revalidate in the background.
+// An entry is the tree and its tag encoded as CBOR and compressed with
+// qCompress, and is replaced atomically so a crash never leaves half of one.
+class TreeCache {
+public:
+    static constexpr int FormatVersion = 1;
+
+    TreeCache(const QString& directory, const QString& host, quint16 port);
+
+    bool load(const QString& user, QJsonObject& tree, QByteArray& tag) const;
+    void store(const QString& user, const QJsonObject& tree, const QByteArray& tag) const;
+
+    static QString defaultDirectory();
+    static QByteArray tag(const QByteArray& data);
+
+private:
+    QString fileName(const QString& user) const;
+
+    QString directory;
+    QString server;
+};
+
+#endif // TREECACHE_H
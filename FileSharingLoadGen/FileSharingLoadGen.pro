@@ -0,0 +1,15 @@
+QT       += core network
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+SOURCES += \
+    loadclient.cpp \
+    loadgenerator.cpp \
+    main.cpp
+
+HEADERS += \
+    loadclient.h \
+    loadgenerator.h \
+    structs.h
@@ -0,0 +1,239 @@
+#include "loadclient.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTimer>
+
+LoadClient::LoadClient(int index, const LoadOptions* options, QObject* parent) : QObject(parent), options(options) {
+    user = QString("loaduser%1").arg(index);
+    group = QString("load%1").arg(index % qMax(1, options->groups));
+    leader = false;
+    established = false;
+    stopped = false;
+    sequence = 0;
+    operation = OperationCount;
+
+    socket = new QTcpSocket(this);
+    connect(socket, &QTcpSocket::connected, this, &LoadClient::onConnected);
+    connect(socket, &QTcpSocket::disconnected, this, &LoadClient::onDisconnected);
+    connect(socket, &QTcpSocket::readyRead, this, &LoadClient::onReadyRead);
+    connect(socket, &QAbstractSocket::errorOccurred, this, &LoadClient::onErrorOccurred);
+}
+
+QString LoadClient::operationName(int operation) {
+    switch (operation) {
+        case OperationSignUp: return "SignUp";
+        case OperationSignIn: return "SignIn";
+        case OperationCreateGroup: return "CreateGroup";
+        case OperationJoinGroup: return "JoinGroup";
+        case OperationGet: return "Get";
+        case OperationCreateFolder: return "CreateFolder";
+        case OperationUpload: return "Upload";
+        case OperationDownload: return "Download";
+        case OperationDelete: return "Delete";
+    }
+    return "Unknown";
+}
+
+void LoadClient::start() {
+    socket->connectToHost(options->host, options->port);
+}
+
+void LoadClient::stop() {
+    stopped = true;
+    if (socket->state() != QAbstractSocket::UnconnectedState) {
+        socket->abort();
+    }
+}
+
+void LoadClient::onConnected() {
+    established = true;
+    emit connected(this);
+
+    send(OperationSignUp, RequestSignUp, QString("%1;%2").arg(user, "load").toUtf8());
+}
+
+void LoadClient::onDisconnected() {
+    if (established) {
+        established = false;
+        emit disconnected(this);
+    }
+}
+
+void LoadClient::onErrorOccurred(QAbstractSocket::SocketError error) {
+    Q_UNUSED(error);
+
+    if (!established && !stopped) {
+        emit connectFailed(this, socket->errorString());
+    }
+}
+
+void LoadClient::onReadyRead() {
+    QDataStream socketStream(socket);
+    socketStream.setVersion(QDataStream::Qt_5_15);
+
+    forever {
+        socketStream.startTransaction();
+
+        QByteArray data;
+        socketStream >> data;
+
+        if (!socketStream.commitTransaction()) {
+            return;
+        }
+
+        handleResponse(data.mid(0, 8).toInt(), data.mid(8));
+    }
+}
+
+void LoadClient::send(int operation, Request request, const QByteArray& payload) {
+    this->operation = operation;
+
+    QByteArray typeArray = QByteArray::number(request).leftJustified(8, '\0', true);
+
+    QDataStream socketStream(socket);
+    socketStream.setVersion(QDataStream::Qt_5_15);
+    socketStream << typeArray + payload;
+
+    timer.start();
+}
+
+void LoadClient::handleResponse(int code, const QByteArray& data) {
+    qint64 latency = timer.nsecsElapsed() / 1000;
+
+    switch (operation) {
+        case OperationSignUp:
+            // An existing account from an earlier run is fine, the password is fixed.
+            emit requestFinished(operation, latency, code == ResponseSignUpSuccess || data.contains("exist"));
+            send(OperationSignIn, RequestSignIn, QString("%1;%2").arg(user, "load").toUtf8());
+            return;
+
+        case OperationSignIn:
+            emit requestFinished(operation, latency, code == ResponseSignInSuccess);
+            if (code != ResponseSignInSuccess) {
+                stop();
+                return;
+            }
+            send(OperationCreateGroup, RequestCreateGroup, group.toUtf8());
+            return;
+
+        case OperationCreateGroup:
+            // Losing the race for a group name is expected; the loser joins instead.
+            emit requestFinished(operation, latency, code == ResponseCreateGroupSuccess || data.contains("exist"));
+            if (code != ResponseCreateGroupSuccess) {
+                send(OperationJoinGroup, RequestJoinGroup, group.toUtf8());
+                return;
+            }
+            leader = true;
+            break;
+
+        case OperationJoinGroup:
+            emit requestFinished(operation, latency, code == ResponseJoinGroupSuccess || data.contains("already"));
+            // Group leadership survives between runs, so ask the tree who leads.
+            send(OperationGet, RequestGet, QByteArray());
+            return;
+
+        case OperationGet:
+            emit requestFinished(operation, latency, code == ResponseGetSuccess);
+            if (code == ResponseGetSuccess && !leader) {
+                QJsonArray groups = QJsonDocument::fromJson(data).object().value("children").toArray();
+                foreach (const QJsonValue& value, groups) {
+                    QJsonObject object = value.toObject();
+                    if (object.value("name").toString() == group && object.value("leader").toString() == user) {
+                        leader = true;
+                    }
+                }
+            }
+            break;
+
+        case OperationCreateFolder:
+            emit requestFinished(operation, latency, code == ResponseCreateFolderSuccess);
+            break;
+
+        case OperationUpload:
+            emit requestFinished(operation, latency, code == ResponseUploadFileSuccess);
+            if (code == ResponseUploadFileSuccess) {
+                files.append(target);
+            }
+            break;
+
+        case OperationDownload:
+            emit requestFinished(operation, latency, code == ResponseDownloadFileSuccess && data.size() == 128 + options->payload.size());
+            break;
+
+        case OperationDelete:
+            emit requestFinished(operation, latency, code == ResponseDeleteSuccess);
+            break;
+
+        default:
+            return;
+    }
+
+    if (options->thinkTime > 0) {
+        QTimer::singleShot(options->thinkTime, this, &LoadClient::next);
+    } else {
+        next();
+    }
+}
+
+void LoadClient::next() {
+    if (stopped || socket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    int total = 0;
+    for (int i = OperationGet; i < OperationCount; i++) {
+        total += options->weights[i];
+    }
+
+    int operation = OperationGet;
+    int pick = total > 0 ? QRandomGenerator::global()->bounded(total) : 0;
+    for (int i = OperationGet; i < OperationCount; i++) {
+        if (pick < options->weights[i]) {
+            operation = i;
+            break;
+        }
+        pick -= options->weights[i];
+    }
+
+    if (operation == OperationDownload && files.isEmpty()) {
+        operation = OperationUpload;
+    }
+    if (operation == OperationDelete && (!leader || files.isEmpty())) {
+        operation = OperationGet;
+    }
+
+    sequence++;
+    QString prefix = group + QDir::separator() + QString("%1-%2-%3").arg(user, options->runId).arg(sequence);
+
+    switch (operation) {
+        case OperationGet:
+            send(operation, RequestGet, QByteArray());
+            break;
+
+        case OperationCreateFolder:
+            send(operation, RequestCreateFolder, prefix.toUtf8());
+            break;
+
+        case OperationUpload: {
+            target = prefix + ".bin";
+            QByteArray header = target.toUtf8().leftJustified(256, '\0', true);
+            send(operation, RequestUploadFile, header + options->payload);
+            break;
+        }
+
+        case OperationDownload:
+            target = files.at(QRandomGenerator::global()->bounded(files.size()));
+            send(operation, RequestDownloadFile, target.toUtf8());
+            break;
+
+        case OperationDelete:
+            target = files.takeLast();
+            send(operation, RequestDelete, target.toUtf8());
+            break;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVector>
+
+#include "structs.h"
+
+enum Operation {
+    OperationSignUp,
+    OperationSignIn,
+    OperationCreateGroup,
+    OperationJoinGroup,
+    OperationGet,
+    OperationCreateFolder,
+    OperationUpload,
+    OperationDownload,
+    OperationDelete,
+    OperationCount,
+};
+
+struct LoadOptions {
+    QString host;
+    quint16 port;
+    int connections;
+    int rate;
+    int duration;
+    int groups;
+    int thinkTime;
+    QString runId;
+    QByteArray payload;
+    QVector<int> weights;
+};
+
+// One synthetic user: signs up, signs in, creates or joins its group and then
+// keeps exactly one request in flight, picked from the configured mix.
+class LoadClient : public QObject {
+    Q_OBJECT
+
+public:
+    LoadClient(int index, const LoadOptions* options, QObject* parent = nullptr);
+
+    static QString operationName(int operation);
+
+    void start();
+    void stop();
+
+signals:
+    void connected(LoadClient* client);
+    void connectFailed(LoadClient* client, const QString& error);
+    void disconnected(LoadClient* client);
+    void requestFinished(int operation, qint64 latency, bool success);
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onErrorOccurred(QAbstractSocket::SocketError error);
+    void onReadyRead();
+
+private:
+    void send(int operation, Request request, const QByteArray& payload);
+    void handleResponse(int code, const QByteArray& data);
+    void next();
+
+    const LoadOptions* options;
+    QTcpSocket* socket;
+    QString user;
+    QString group;
+    bool leader;
+    bool established;
+    bool stopped;
+    int sequence;
+    QStringList files;
+
+    int operation;
+    QString target;
+    QElapsedTimer timer;
+};
+
+#endif // LOADCLIENT_H
@@ -0,0 +1,171 @@
+#include "loadgenerator.h"
+
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+
+LoadGenerator::LoadGenerator(const LoadOptions& options, QObject* parent) : QObject(parent), options(options) {
+    active = 0;
+    peakActive = 0;
+    connectFailures = 0;
+    drops = 0;
+    stopping = false;
+    lastTotal = 0;
+    latencies.resize(OperationCount);
+    errors.fill(0, OperationCount);
+
+    connect(&rampTimer, &QTimer::timeout, this, &LoadGenerator::rampUp);
+    connect(&progressTimer, &QTimer::timeout, this, &LoadGenerator::printProgress);
+}
+
+void LoadGenerator::start() {
+    elapsed.start();
+
+    // The ramp runs in 10 ms steps so the connect rate is smooth at any size.
+    rampTimer.start(10);
+    progressTimer.start(1000);
+    QTimer::singleShot(options.duration * 1000, this, &LoadGenerator::stop);
+
+    rampUp();
+}
+
+void LoadGenerator::rampUp() {
+    int target = options.connections;
+    if (options.rate > 0) {
+        target = qMin(target, int(elapsed.elapsed() * options.rate / 1000) + 1);
+    }
+
+    while (loadClients.size() < target) {
+        LoadClient* client = new LoadClient(loadClients.size(), &options, this);
+        connect(client, &LoadClient::connected, this, &LoadGenerator::onConnected);
+        connect(client, &LoadClient::connectFailed, this, &LoadGenerator::onConnectFailed);
+        connect(client, &LoadClient::disconnected, this, &LoadGenerator::onDisconnected);
+        connect(client, &LoadClient::requestFinished, this, &LoadGenerator::onRequestFinished);
+        loadClients.append(client);
+        client->start();
+    }
+
+    if (loadClients.size() >= options.connections) {
+        rampTimer.stop();
+    }
+}
+
+void LoadGenerator::printProgress() {
+    qint64 total = 0;
+    qint64 failed = 0;
+    for (int i = 0; i < OperationCount; i++) {
+        total += latencies[i].size();
+        failed += errors[i];
+    }
+
+    QTextStream out(stdout);
+    out << QString("%1s connections=%2/%3 requests=%4 (%5/s) errors=%6")
+           .arg(elapsed.elapsed() / 1000, 4)
+           .arg(active)
+           .arg(loadClients.size())
+           .arg(total)
+           .arg(total - lastTotal)
+           .arg(failed) << Qt::endl;
+
+    lastTotal = total;
+}
+
+void LoadGenerator::stop() {
+    stopping = true;
+    rampTimer.stop();
+    progressTimer.stop();
+
+    foreach (LoadClient* client, loadClients) {
+        client->stop();
+    }
+
+    printReport();
+    emit finished();
+}
+
+void LoadGenerator::onConnected(LoadClient* client) {
+    Q_UNUSED(client);
+
+    active++;
+    peakActive = qMax(peakActive, active);
+}
+
+void LoadGenerator::onConnectFailed(LoadClient* client, const QString& error) {
+    Q_UNUSED(client);
+
+    connectFailures++;
+    lastError = error;
+}
+
+void LoadGenerator::onDisconnected(LoadClient* client) {
+    Q_UNUSED(client);
+
+    active--;
+    if (!stopping) {
+        drops++;
+    }
+}
+
+void LoadGenerator::onRequestFinished(int operation, qint64 latency, bool success) {
+    if (stopping) {
+        return;
+    }
+
+    latencies[operation].append(latency);
+    if (!success) {
+        errors[operation]++;
+    }
+}
+
+qint64 LoadGenerator::percentile(const QVector<qint64>& sorted, double fraction) {
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+
+    int index = int(std::ceil(fraction * sorted.size())) - 1;
+    return sorted.at(qBound(0, index, sorted.size() - 1));
+}
+
+void LoadGenerator::printReport() {
+    double seconds = qMax<qint64>(1, elapsed.elapsed()) / 1000.0;
+
+    QTextStream out(stdout);
+    out << Qt::endl;
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8")
+           .arg("request", -13)
+           .arg("count", 9)
+           .arg("errors", 8)
+           .arg("req/s", 9)
+           .arg("p50 ms", 9)
+           .arg("p99 ms", 9)
+           .arg("p999 ms", 9)
+           .arg("max ms", 9) << Qt::endl;
+
+    qint64 total = 0;
+    for (int i = 0; i < OperationCount; i++) {
+        QVector<qint64> sorted = latencies[i];
+        if (sorted.isEmpty()) {
+            continue;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        total += sorted.size();
+
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8")
+               .arg(LoadClient::operationName(i), -13)
+               .arg(sorted.size(), 9)
+               .arg(errors[i], 8)
+               .arg(sorted.size() / seconds, 9, 'f', 1)
+               .arg(percentile(sorted, 0.50) / 1000.0, 9, 'f', 2)
+               .arg(percentile(sorted, 0.99) / 1000.0, 9, 'f', 2)
+               .arg(percentile(sorted, 0.999) / 1000.0, 9, 'f', 2)
+               .arg(sorted.last() / 1000.0, 9, 'f', 2) << Qt::endl;
+    }
+
+    out << Qt::endl;
+    out << QString("Total: %1 requests in %2 s (%3 req/s)").arg(total).arg(seconds, 0, 'f', 1).arg(total / seconds, 0, 'f', 1) << Qt::endl;
+    out << QString("Connections: target %1, peak established %2, connect failures %3, dropped %4")
+           .arg(options.connections).arg(peakActive).arg(connectFailures).arg(drops) << Qt::endl;
+    if (!lastError.isEmpty()) {
+        out << QString("Last connect error: %1").arg(lastError) << Qt::endl;
+    }
+}
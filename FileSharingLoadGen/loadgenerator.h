@@ -0,0 +1,57 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "loadclient.h"
+
+// Ramps up the configured number of LoadClients, aggregates their latencies
+// per request type and prints a throughput / percentile report when the run
+// is over.
+class LoadGenerator : public QObject {
+    Q_OBJECT
+
+public:
+    LoadGenerator(const LoadOptions& options, QObject* parent = nullptr);
+
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void rampUp();
+    void printProgress();
+    void stop();
+
+    void onConnected(LoadClient* client);
+    void onConnectFailed(LoadClient* client, const QString& error);
+    void onDisconnected(LoadClient* client);
+    void onRequestFinished(int operation, qint64 latency, bool success);
+
+private:
+    static qint64 percentile(const QVector<qint64>& sorted, double fraction);
+    void printReport();
+
+    LoadOptions options;
+    QVector<LoadClient*> loadClients;
+    QTimer rampTimer;
+    QTimer progressTimer;
+    QElapsedTimer elapsed;
+
+    int active;
+    int peakActive;
+    int connectFailures;
+    int drops;
+    bool stopping;
+    QString lastError;
+
+    QVector<QVector<qint64>> latencies;
+    QVector<qint64> errors;
+    qint64 lastTotal;
+};
+
+#endif // LOADGENERATOR_H
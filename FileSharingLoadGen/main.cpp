@@ -0,0 +1,75 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QHostAddress>
+#include <QTextStream>
+
+#include "loadgenerator.h"
+
+static bool parseMix(const QString& mix, QVector<int>& weights) {
+    const QStringList names = {"get", "folder", "upload", "download", "delete"};
+
+    weights.fill(0, OperationCount);
+    foreach (const QString& entry, mix.split(",", Qt::SkipEmptyParts)) {
+        QStringList pair = entry.split("=");
+        int index = names.indexOf(pair.first().trimmed().toLower());
+        bool ok = false;
+        int weight = pair.size() == 2 ? pair.last().toInt(&ok) : 0;
+        if (index < 0 || !ok || weight < 0) {
+            return false;
+        }
+        weights[OperationGet + index] = weight;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("FileSharingLoadGen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Drives a local FileSharingServer with synthetic clients.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"host", "Server address, must be a loopback address.", "host", "127.0.0.1"},
+        {"port", "Server port.", "port", "1234"},
+        {"connections", "Number of concurrent clients.", "count", "100"},
+        {"rate", "New connections per second, 0 opens them all at once.", "count", "200"},
+        {"duration", "Length of the run in seconds.", "seconds", "30"},
+        {"groups", "Number of groups the clients are spread over.", "count", "10"},
+        {"mix", "Request weights.", "get=N,folder=N,upload=N,download=N,delete=N", "get=50,folder=10,upload=20,download=15,delete=5"},
+        {"file-size", "Size of each uploaded file in bytes.", "bytes", "65536"},
+        {"think-time", "Pause between a response and the next request in ms.", "ms", "0"},
+    });
+    parser.process(a);
+
+    QTextStream err(stderr);
+
+    LoadOptions options;
+    options.host = parser.value("host");
+    options.port = parser.value("port").toUShort();
+    options.connections = qMax(1, parser.value("connections").toInt());
+    options.rate = qMax(0, parser.value("rate").toInt());
+    options.duration = qMax(1, parser.value("duration").toInt());
+    options.groups = qMax(1, parser.value("groups").toInt());
+    options.thinkTime = qMax(0, parser.value("think-time").toInt());
+    options.runId = QString::number(QDateTime::currentSecsSinceEpoch(), 36);
+    options.payload = QByteArray(qMax(0, parser.value("file-size").toInt()), 'x');
+
+    if (options.host.compare("localhost", Qt::CaseInsensitive) != 0 && !QHostAddress(options.host).isLoopback()) {
+        err << "Refusing to generate load against a non-local host: " << options.host << Qt::endl;
+        return 1;
+    }
+
+    if (!parseMix(parser.value("mix"), options.weights)) {
+        err << "Invalid request mix: " << parser.value("mix") << Qt::endl;
+        return 1;
+    }
+
+    LoadGenerator generator(options);
+    QObject::connect(&generator, &LoadGenerator::finished, &a, &QCoreApplication::quit, Qt::QueuedConnection);
+    generator.start();
+
+    return a.exec();
+}
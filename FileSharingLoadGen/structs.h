@@ -0,0 +1,87 @@
+#ifndef STRUCTS_H
+#define STRUCTS_H
+
+enum Request {
+    RequestNone,
+    RequestSignIn,
+    RequestSignUp,
+    RequestSignOut,
+    RequestGet,
+    RequestCreateGroup,
+    RequestJoinGroup,
+    RequestCreateFolder,
+    RequestUploadFile,
+    RequestDownloadFile,
+    RequestDelete,
+    RequestStats,
+    RequestDownloadRange,
+    RequestUploadRange,
+    RequestUploadCancel,
+    RequestUploadHash,
+    RequestReplicate,
+    RequestClusterUsers,
+    RequestClusterGroup,
+    RequestClusterTransfer,
+    RequestPing,
+    RequestSearch,
+};
+
+enum Response {
+    ResponseNone,
+    ResponseSignInSuccess,
+    ResponseSignInError,
+    ResponseSignUpSuccess,
+    ResponseSignUpError,
+    ResponseSignOutSuccess,
+    ResponseSignOutError,
+    ResponseGetSuccess,
+    ResponseGetError,
+    ResponseCreateGroupSuccess,
+    ResponseCreateGroupError,
+    ResponseJoinGroupSuccess,
+    ResponseJoinGroupError,
+    ResponseCreateFolderSuccess,
+    ResponseCreateFolderError,
+    ResponseUploadFileSuccess,
+    ResponseUploadFileError,
+    ResponseDownloadFileSuccess,
+    ResponseDownloadFileError,
+    ResponseDeleteSuccess,
+    ResponseDeleteError,
+    ResponseSuccess,
+    ResponseError,
+    ResponseStatsSuccess,
+    ResponseStatsError,
+    ResponseDownloadRangeSuccess,
+    ResponseDownloadRangeError,
+    ResponseUploadRangeSuccess,
+    ResponseUploadRangeError,
+    ResponseUploadCancelSuccess,
+    ResponseUploadCancelError,
+    ResponseGetNotModified,
+    ResponseReserved, // Keeps every success code odd and every error code even.
+    ResponseUploadHashSuccess,
+    ResponseUploadHashError,
+    ResponseReplicateSuccess,
+    ResponseReplicateError,
+    ResponseRedirect,
+    ResponseRedirectReserved, // Keeps the codes after ResponseRedirect odd for success and even for errors.
+    ResponseClusterSuccess,
+    ResponseClusterError,
+    ResponsePingSuccess,
+    ResponsePingError,
+    ResponseRetryReserved, // Keeps ResponseRetryLater even: clients treat it as a failed attempt.
+    ResponseRetryLater,
+    ResponseSearchSuccess,
+    ResponseSearchError,
+};
+
+// Metrics counts every even response code as an error.
+static_assert(ResponseUploadHashSuccess % 2 == 1 && ResponseUploadHashError % 2 == 0, "response code parity");
+static_assert(ResponseReplicateSuccess % 2 == 1 && ResponseReplicateError % 2 == 0, "response code parity");
+static_assert(ResponseClusterSuccess % 2 == 1 && ResponseClusterError % 2 == 0, "response code parity");
+static_assert(ResponsePingSuccess % 2 == 1 && ResponsePingError % 2 == 0, "response code parity");
+static_assert(ResponseRetryLater % 2 == 0, "response code parity");
+static_assert(ResponseSearchSuccess % 2 == 1 && ResponseSearchError % 2 == 0, "response code parity");
+
+#endif // STRUCTS_H
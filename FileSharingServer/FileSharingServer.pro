@@ -9,16 +9,66 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    connection.cpp \
+    contentindex.cpp \
+    dataroots.cpp \
+    filetree.cpp \
+    hashring.cpp \
+    iopool.cpp \
+    logger.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    metadatastore.cpp \
+    metrics.cpp \
+    nameindex.cpp \
+    peerlink.cpp \
+    ratelimiter.cpp \
+    replicaclient.cpp \
+    replicationlog.cpp \
+    storage.cpp \
+    tcpconnection.cpp \
+    timerwheel.cpp \
+    tracer.cpp
 
 HEADERS += \
+    connection.h \
+    contentindex.h \
+    dataroots.h \
+    filetree.h \
+    hashring.h \
+    iopool.h \
+    logger.h \
     mainwindow.h \
-    structs.h
+    metadatastore.h \
+    metrics.h \
+    nameindex.h \
+    peerlink.h \
+    ratelimiter.h \
+    replicaclient.h \
+    replicationlog.h \
+    storage.h \
+    structs.h \
+    tcpconnection.h \
+    timerwheel.h \
+    tracer.h
 
 FORMS += \
     mainwindow.ui
 
+# Edge-triggered epoll network engine, selected at runtime with server/engine=epoll.
+linux {
+    SOURCES += epollconnection.cpp epollserver.cpp
+    HEADERS += epollconnection.h epollserver.h
+}
+
+# Optional io_uring storage backend, enabled with `qmake CONFIG+=iouring` (requires liburing).
+linux:iouring {
+    DEFINES += USE_IO_URING
+    SOURCES += uringstorage.cpp
+    HEADERS += uringstorage.h
+    LIBS += -luring
+}
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
@@ -0,0 +1,348 @@
+#include "connection.h"
+
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <QTimer>
+
+#include "structs.h"
+
+Connection::Connection(qint64 descriptor, Storage* storage, QObject* parent) : QObject(parent), m_descriptor(descriptor), storage(storage) {
+    m_bytesReceived = 0;
+    m_bytesSent = 0;
+    m_connectedAt = now();
+    m_lastActivity = m_connectedAt;
+    m_requested = false;
+    lowWatermark = DefaultLowWatermark;
+    highWatermark = DefaultHighWatermark;
+    readPauses = 0;
+
+    frameSize = -1;
+    frameRead = 0;
+    uploading = false;
+    uploadOffset = 0;
+    uploadPending = 0;
+    uploadThrottled = false;
+    closePending = false;
+}
+
+Connection::~Connection() {
+}
+
+qint64 Connection::descriptor() const {
+    return m_descriptor;
+}
+
+qint64 Connection::bytesReceived() const {
+    return m_bytesReceived;
+}
+
+qint64 Connection::bytesSent() const {
+    return m_bytesSent;
+}
+
+int Connection::queuedResponses() const {
+    return outbox.size();
+}
+
+bool Connection::isSendingFile() const {
+    return !outbox.isEmpty() && outbox.head().file;
+}
+
+qint64 Connection::now() {
+    static const QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.elapsed();
+}
+
+qint64 Connection::connectedAt() const {
+    return m_connectedAt;
+}
+
+qint64 Connection::lastActivity() const {
+    return m_lastActivity;
+}
+
+bool Connection::hasRequested() const {
+    return m_requested;
+}
+
+bool Connection::isBusy() const {
+    // The server is still working on a request, so silence is not the client's doing.
+    return readPauses > 0;
+}
+
+QString Connection::peerAddress() const {
+    return QString();
+}
+
+QSharedPointer<QFile> Connection::uploadFile() const {
+    return upload;
+}
+
+QString Connection::uploadTarget() const {
+    return uploadPath;
+}
+
+void Connection::setUploadFile(const QSharedPointer<QFile>& file, const QString& target) {
+    upload = file;
+    uploadPath = target;
+    uploadOffset = 0;
+}
+
+qint64 Connection::reserveUpload(qint64 bytes) {
+    qint64 offset = uploadOffset;
+    uploadOffset += bytes;
+
+    uploadPending += bytes;
+    if (!uploadThrottled && uploadPending >= highWatermark) {
+        uploadThrottled = true;
+        pauseReading();
+    }
+
+    return offset;
+}
+
+void Connection::removeUploadPending(qint64 bytes) {
+    uploadPending -= bytes;
+    if (uploadThrottled && uploadPending <= lowWatermark) {
+        uploadThrottled = false;
+        resumeReading();
+    }
+}
+
+void Connection::setWatermarks(qint64 low, qint64 high) {
+    if (low < 0 || high <= low) {
+        return;
+    }
+
+    lowWatermark = low;
+    highWatermark = high;
+}
+
+void Connection::pauseReading() {
+    readPauses++;
+}
+
+void Connection::resumeReading() {
+    if (readPauses == 0) {
+        return;
+    }
+
+    readPauses--;
+    if (readPauses == 0) {
+        QTimer::singleShot(0, this, &Connection::onReadyRead);
+    }
+}
+
+void Connection::close() {
+    // Responses still queued behind a download would otherwise be lost with the socket.
+    if (!outbox.isEmpty() && isOpen()) {
+        closePending = true;
+        return;
+    }
+
+    closeSocket();
+}
+
+void Connection::send(const QByteArray& bytes) {
+    Outgoing item;
+    item.bytes = framePrefix(bytes.size()) + bytes;
+    item.offset = 0;
+    item.remaining = 0;
+    item.reading = false;
+
+    outbox.enqueue(item);
+    pump();
+}
+
+void Connection::sendFile(const QByteArray& header, const QSharedPointer<QFile>& file, qint64 offset, qint64 length) {
+    offset = qBound<qint64>(0, offset, file->size());
+    if (length < 0 || length > file->size() - offset) {
+        length = file->size() - offset;
+    }
+
+    Outgoing item;
+    item.bytes = framePrefix(header.size() + length) + header;
+    item.file = file;
+    item.offset = offset;
+    item.remaining = length;
+    item.reading = false;
+
+    outbox.enqueue(item);
+    pump();
+}
+
+QByteArray Connection::framePrefix(qint64 size) {
+    QByteArray prefix(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(size), prefix.data());
+    return prefix;
+}
+
+QByteArray Connection::read(qint64 maxSize) {
+    QByteArray bytes(maxSize, Qt::Uninitialized);
+    qint64 length = readData(bytes.data(), maxSize);
+    bytes.resize(length > 0 ? length : 0);
+    m_bytesReceived += bytes.size();
+    if (length > 0) {
+        m_lastActivity = now();
+    }
+    return bytes;
+}
+
+bool Connection::canProcessMessage() const {
+    return !closePending && outbox.isEmpty() && bytesToWrite() < highWatermark;
+}
+
+void Connection::pump() {
+    while (!outbox.isEmpty() && bytesToWrite() < highWatermark) {
+        Outgoing& item = outbox.head();
+
+        if (!item.bytes.isEmpty()) {
+            writeData(item.bytes);
+            m_bytesSent += item.bytes.size();
+            item.bytes.clear();
+            continue;
+        }
+
+        if (item.reading) {
+            return;
+        }
+
+        if (item.file && item.remaining > 0) {
+            qint64 length = qMin(ChunkSize, item.remaining);
+            item.reading = true;
+            storage->read(item.file, item.offset, length, this, [this, length](QByteArray chunk) {
+                onFileRead(chunk, length);
+            });
+            return;
+        }
+
+        outbox.dequeue();
+    }
+
+    if (closePending && outbox.isEmpty()) {
+        closePending = false;
+        closeSocket();
+    }
+}
+
+void Connection::onFileRead(const QByteArray& chunk, qint64 length) {
+    if (outbox.isEmpty() || !isOpen()) {
+        return;
+    }
+
+    Outgoing& item = outbox.head();
+    item.reading = false;
+
+    if (chunk.size() != length) {
+        // The frame length has already been announced, so a short read cannot be recovered.
+        abort();
+        return;
+    }
+
+    writeData(chunk);
+    m_bytesSent += chunk.size();
+    item.offset += length;
+    item.remaining -= length;
+    pump();
+}
+
+void Connection::onReadyRead() {
+    while (readPauses == 0 && isOpen()) {
+        if (frameSize < 0) {
+            if (!canProcessMessage() || bytesAvailable() < 4) {
+                return;
+            }
+
+            char prefix[4];
+            readData(prefix, 4);
+            m_bytesReceived += 4;
+            m_lastActivity = now();
+            quint32 size = qFromBigEndian<quint32>(prefix);
+
+            frameSize = (size == 0xFFFFFFFF) ? 0 : size;
+            frameRead = 0;
+            uploading = false;
+            frame.clear();
+        }
+
+        if (uploading) {
+            if (frameRead < frameSize) {
+                qint64 length = qMin(bytesAvailable(), frameSize - frameRead);
+                if (length <= 0) {
+                    return;
+                }
+
+                QByteArray chunk = read(qMin(length, ChunkSize));
+                frameRead += chunk.size();
+                emit uploadReceived(this, chunk);
+            }
+
+            if (frameRead == frameSize) {
+                frameSize = -1;
+                uploading = false;
+                emit uploadFinished(this);
+            }
+            continue;
+        }
+
+        if (frame.size() < frameSize) {
+            qint64 length = frameSize - frame.size();
+            if (frame.size() < RequestHeaderSize) {
+                length = qMin(length, RequestHeaderSize - frame.size());
+            }
+
+            length = qMin(length, bytesAvailable());
+            if (length <= 0) {
+                return;
+            }
+            frame.append(read(length));
+        }
+
+        if (frame.size() == RequestHeaderSize && frame.mid(0, 8).toInt() == RequestUploadFile) {
+            uploading = true;
+            frameRead = frame.size();
+            QByteArray header = frame.mid(8);
+            frame.clear();
+            m_requested = true;
+            emit uploadStarted(this, header, frameSize - frameRead);
+            continue;
+        }
+
+        if (frame.size() == frameSize) {
+            QByteArray bytes = frame;
+            frame.clear();
+            frameSize = -1;
+            m_requested = true;
+            emit messageReceived(this, bytes);
+            continue;
+        }
+
+        if (frame.size() >= RequestHeaderSize && frameSize > MaxMessageSize) {
+            abort();
+            return;
+        }
+    }
+}
+
+void Connection::onBytesWritten(qint64 bytes) {
+    if (bytes > 0) {
+        m_lastActivity = now();
+    }
+
+    if (bytesToWrite() > lowWatermark) {
+        return;
+    }
+
+    pump();
+    if (outbox.isEmpty()) {
+        onReadyRead();
+    }
+}
+
+void Connection::onDisconnected() {
+    emit disconnected(this);
+}
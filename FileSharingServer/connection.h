@@ -0,0 +1,126 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <QObject>
+#include <QQueue>
+#include <QFile>
+#include <QSharedPointer>
+
+#include "storage.h"
+
+// A client connection, independent of the network engine behind it. It frames
+// the QDataStream protocol by hand so that neither direction has to hold a
+// whole message in memory; subclasses only move bytes. Outgoing data is
+// produced only while the socket buffer is below the high watermark and
+// resumes once it drains below the low one. Uploads are handed out in chunks
+// as they arrive instead of being buffered into a single QByteArray, and
+// reading stops while more than the high watermark of them is still waiting
+// to reach the disk. Every read and write stamps the connection with the time
+// of its last activity, on a monotonic clock, so idle ones can be found.
+class Connection : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr qint64 DefaultLowWatermark = 256 * 1024;
+    static constexpr qint64 DefaultHighWatermark = 1024 * 1024;
+    static constexpr qint64 ReadBufferSize = 1024 * 1024;
+    static constexpr qint64 ChunkSize = 64 * 1024;
+    static constexpr qint64 MaxMessageSize = 4 * 1024 * 1024;
+    static constexpr qint64 RequestHeaderSize = 8 + 256;
+    static constexpr qint64 MaxRangeSize = 1024 * 1024;
+
+    Connection(qint64 descriptor, Storage* storage, QObject* parent = nullptr);
+    virtual ~Connection();
+
+    qint64 descriptor() const;
+    qint64 bytesReceived() const;
+    qint64 bytesSent() const;
+    int queuedResponses() const;
+    bool isSendingFile() const;
+
+    static qint64 now();
+    qint64 connectedAt() const;
+    qint64 lastActivity() const;
+    bool hasRequested() const;
+    bool isBusy() const;
+
+    virtual QString peerAddress() const;
+    virtual bool isOpen() const = 0;
+    void close();
+    virtual void abort() = 0;
+
+    QSharedPointer<QFile> uploadFile() const;
+    QString uploadTarget() const;
+    void setUploadFile(const QSharedPointer<QFile>& file, const QString& target = QString());
+    qint64 reserveUpload(qint64 bytes);
+    void removeUploadPending(qint64 bytes);
+
+    void setWatermarks(qint64 low, qint64 high);
+    void pauseReading();
+    void resumeReading();
+
+    void send(const QByteArray& bytes);
+    void sendFile(const QByteArray& header, const QSharedPointer<QFile>& file, qint64 offset = 0, qint64 length = -1);
+
+signals:
+    void messageReceived(Connection* connection, QByteArray bytes);
+    void uploadStarted(Connection* connection, QByteArray header, qint64 size);
+    void uploadReceived(Connection* connection, QByteArray bytes);
+    void uploadFinished(Connection* connection);
+    void disconnected(Connection* connection);
+
+protected slots:
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onDisconnected();
+
+protected:
+    virtual qint64 bytesAvailable() = 0;
+    virtual qint64 readData(char* data, qint64 maxSize) = 0;
+    virtual void writeData(const QByteArray& bytes) = 0;
+    virtual qint64 bytesToWrite() const = 0;
+    virtual void closeSocket() = 0;
+
+private:
+    struct Outgoing {
+        QByteArray bytes;
+        QSharedPointer<QFile> file;
+        qint64 offset;
+        qint64 remaining;
+        bool reading;
+    };
+
+    static QByteArray framePrefix(qint64 size);
+
+    bool canProcessMessage() const;
+    QByteArray read(qint64 maxSize);
+    void pump();
+    void onFileRead(const QByteArray& chunk, qint64 length);
+
+    qint64 m_descriptor;
+    Storage* storage;
+    qint64 m_bytesReceived;
+    qint64 m_bytesSent;
+    qint64 m_connectedAt;
+    qint64 m_lastActivity;
+    bool m_requested;
+
+    qint64 lowWatermark;
+    qint64 highWatermark;
+    int readPauses;
+
+    qint64 frameSize;
+    qint64 frameRead;
+    bool uploading;
+    QByteArray frame;
+    QSharedPointer<QFile> upload;
+    QString uploadPath;
+    qint64 uploadOffset;
+    qint64 uploadPending;
+    bool uploadThrottled;
+
+    QQueue<Outgoing> outbox;
+    bool closePending;
+};
+
+#endif // CONNECTION_H
@@ -0,0 +1,167 @@
+#include "contentindex.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QSharedPointer>
+
+bool ContentIndex::Entry::matches(const QString& fileName) const {
+    QFileInfo info(fileName);
+    return !hash.isEmpty() && info.isFile() && info.size() == size && info.lastModified().toMSecsSinceEpoch() == modified;
+}
+
+ContentIndex::ContentIndex(MetadataStore* store, DataRoots* roots, IoPool* pool, QObject* parent) : QObject(parent), store(store), roots(roots), pool(pool) {
+    table = store->table("content");
+
+    // Servers from before the journal kept the index in an INI file of its own.
+    QStringList keys = table->allKeys();
+    if (keys.isEmpty() && QFile::exists(LegacyFileName)) {
+        store->startTransaction();
+        store->import("content", LegacyFileName);
+        store->commitTransaction();
+        keys = table->allKeys();
+    }
+
+    foreach (const QString& path, keys) {
+        QStringList fields = table->value(path).toString().split(",");
+        if (fields.size() != 3) {
+            continue;
+        }
+
+        Entry entry;
+        entry.hash = fields[0];
+        entry.size = fields[1].toLongLong();
+        entry.modified = fields[2].toLongLong();
+        entries.insert(path, entry);
+        files.insert(entry.hash, path);
+    }
+}
+
+ContentIndex::Entry ContentIndex::entry(const QString& path) const {
+    return entries.value(normalize(path), Entry{QString(), -1, -1});
+}
+
+QStringList ContentIndex::paths(const QString& hash) const {
+    return files.values(hash);
+}
+
+ContentIndex::Snapshot ContentIndex::snapshot() const {
+    return entries;
+}
+
+void ContentIndex::add(const QString& path, const Entry& entry) {
+    QString key = normalize(path);
+    Snapshot::iterator it = entries.find(key);
+    if (it != entries.end()) {
+        files.remove(it.value().hash, key);
+        entries.erase(it);
+    }
+
+    entries.insert(key, entry);
+    files.insert(entry.hash, key);
+    table->setValue(key, QString("%1,%2,%3").arg(entry.hash).arg(entry.size).arg(entry.modified));
+}
+
+void ContentIndex::remove(const QString& path) {
+    QString key = normalize(path);
+    QString prefix = key + "/";
+
+    // A folder's entries go into the journal as one record.
+    store->startTransaction();
+    Snapshot::iterator it = entries.find(key);
+    if (it != entries.end()) {
+        files.remove(it.value().hash, key);
+        table->remove(key);
+        entries.erase(it);
+    }
+
+    // Removing a folder drops everything below it, which sorts right after the prefix.
+    it = entries.lowerBound(prefix);
+    while (it != entries.end() && it.key().startsWith(prefix)) {
+        files.remove(it.value().hash, it.key());
+        table->remove(it.key());
+        it = entries.erase(it);
+    }
+    store->commitTransaction();
+}
+
+void ContentIndex::index(const QString& path) {
+    QString key = normalize(path);
+    QString name = fileName(key);
+    QSharedPointer<Entry> entry(new Entry());
+    pool->run([name, entry]() {
+        *entry = hashFile(name);
+    }, this, [this, key, entry]() {
+        if (!entry->hash.isEmpty()) {
+            add(key, *entry);
+        }
+    });
+}
+
+void ContentIndex::scan() {
+    QSet<QString> known;
+    for (Snapshot::const_iterator it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        known.insert(it.key());
+    }
+
+    QSharedPointer<Snapshot> found(new Snapshot());
+    QStringList directories = roots->roots();
+    pool->run([known, found, directories]() {
+        foreach (const QString& directory, directories) {
+            QDir root(directory);
+            QDirIterator it(directory, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                QString key = root.relativeFilePath(it.next());
+                // Dot-prefixed top-level folders are groups being moved in.
+                if (!key.startsWith('.') && !known.contains(key)) {
+                    found->insert(key, hashFile(it.filePath()));
+                }
+            }
+        }
+    }, this, [this, found]() {
+        store->startTransaction();
+        for (Snapshot::const_iterator it = found->constBegin(); it != found->constEnd(); ++it) {
+            if (!it.value().hash.isEmpty() && !entries.contains(it.key())) {
+                add(it.key(), it.value());
+            }
+        }
+        store->commitTransaction();
+    });
+}
+
+QString ContentIndex::normalize(const QString& path) const {
+    return roots->relative(path);
+}
+
+QString ContentIndex::fileName(const QString& path) const {
+    return roots->path(QDir::toNativeSeparators(normalize(path)));
+}
+
+ContentIndex::Entry ContentIndex::hashFile(const QString& fileName) {
+    Entry entry{QString(), -1, -1};
+
+    QFileInfo before(fileName);
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return entry;
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!hash.addData(&file)) {
+        return entry;
+    }
+
+    entry.hash = QString::fromLatin1(hash.result().toHex());
+    entry.size = before.size();
+    entry.modified = before.lastModified().toMSecsSinceEpoch();
+
+    // A file that changed while it was read has no trustworthy hash yet.
+    if (!entry.matches(fileName)) {
+        return Entry{QString(), -1, -1};
+    }
+    return entry;
+}
@@ -0,0 +1,64 @@
+#ifndef CONTENTINDEX_H
+#define CONTENTINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QMultiHash>
+#include <QObject>
+
+#include "dataroots.h"
+#include "iopool.h"
+#include "metadatastore.h"
+
+// SHA-256 of the files under the data roots, so an upload whose content the server
+// already holds can be satisfied with a link instead of its bytes. Each entry
+// remembers the size and modification time the hash was taken at and is only
+// trusted while the file still matches them. The index is persisted in the
+// metadata journal's "content" table as path=hash,size,modified, so saving it
+// never rewrites a file on the event loop; the reverse lookup lives in memory
+// only. Paths are
+// relative to their data root and always use '/', so moving a group to
+// another root leaves its entries untouched.
+class ContentIndex : public QObject {
+    Q_OBJECT
+
+public:
+    struct Entry {
+        QString hash;
+        qint64 size;
+        qint64 modified;
+
+        bool matches(const QString& fileName) const;
+    };
+
+    // Sorted, so the entries below a folder are one contiguous range.
+    typedef QMap<QString, Entry> Snapshot;
+
+    static constexpr const char* LegacyFileName = "database\\content.dat";
+
+    ContentIndex(MetadataStore* store, DataRoots* roots, IoPool* pool, QObject* parent = nullptr);
+
+    Entry entry(const QString& path) const;
+    QStringList paths(const QString& hash) const;
+    Snapshot snapshot() const;
+
+    void add(const QString& path, const Entry& entry);
+    void remove(const QString& path);
+    void index(const QString& path);
+    void scan();
+
+    QString normalize(const QString& path) const;
+    QString fileName(const QString& path) const;
+
+    static Entry hashFile(const QString& fileName);
+
+private:
+    MetadataStore* store;
+    MetadataTable* table;
+    DataRoots* roots;
+    IoPool* pool;
+    Snapshot entries;
+    QMultiHash<QString, QString> files;
+};
+
+#endif // CONTENTINDEX_H
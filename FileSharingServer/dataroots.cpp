@@ -0,0 +1,304 @@
+#include "dataroots.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSharedPointer>
+#include <QStorageInfo>
+#include <QtEndian>
+#include <cmath>
+
+DataRoots::DataRoots(const QStringList& roots, Policy policy, MetadataStore* store, IoPool* pool, QObject* parent) : QObject(parent), pool(pool), policy(policy) {
+    table = store->table("placements");
+
+    // Servers from before the journal kept placements in an INI file of their own.
+    QStringList groups = table->allKeys();
+    if (groups.isEmpty() && QFile::exists(LegacyFileName)) {
+        store->startTransaction();
+        store->import("placements", LegacyFileName);
+        store->commitTransaction();
+        groups = table->allKeys();
+    }
+
+    foreach (const QString& group, groups) {
+        placements.insert(group, table->value(group).toString());
+    }
+
+    usageTimer = new QTimer(this);
+    connect(usageTimer, &QTimer::timeout, this, &DataRoots::refreshUsage);
+    usageTimer->start(UsageRefreshInterval);
+
+    setRoots(roots);
+    next = placements.size();
+}
+
+DataRoots* DataRoots::create(QSettings* config, MetadataStore* store, IoPool* pool, QObject* parent) {
+    QStringList roots = config->value("storage/roots", QStringList() << DefaultRoot).toStringList();
+    Policy policy = policyFromString(config->value("storage/placement", "hash").toString());
+    return new DataRoots(roots, policy, store, pool, parent);
+}
+
+DataRoots::Policy DataRoots::policyFromString(const QString& name) {
+    if (name.compare("least-used", Qt::CaseInsensitive) == 0) {
+        return LeastUsed;
+    }
+    if (name.compare("round-robin", Qt::CaseInsensitive) == 0) {
+        return RoundRobin;
+    }
+    return Hash;
+}
+
+QStringList DataRoots::roots() const {
+    return m_roots;
+}
+
+void DataRoots::setRoots(const QStringList& roots) {
+    m_roots.clear();
+    foreach (const QString& root, roots) {
+        QString trimmed = root.trimmed();
+        if (!trimmed.isEmpty() && !m_roots.contains(trimmed)) {
+            m_roots.append(trimmed);
+        }
+    }
+    if (m_roots.isEmpty()) {
+        m_roots.append(DefaultRoot);
+    }
+
+    // Group folders created before placement was tracked stay where they are.
+    QStringList directories = m_roots;
+    QSharedPointer<QList<QPair<QString, QString>>> found(new QList<QPair<QString, QString>>());
+    pool->run([directories, found]() {
+        foreach (const QString& root, directories) {
+            QDir().mkpath(root);
+            foreach (const QFileInfo& info, QDir(root).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+                if (!info.fileName().startsWith('.')) {
+                    found->append(qMakePair(info.fileName(), root));
+                }
+            }
+        }
+    }, this, [this, found]() {
+        adopt(*found);
+    });
+    refreshUsage();
+}
+
+bool DataRoots::contains(const QString& group) const {
+    return placements.contains(group);
+}
+
+QString DataRoots::root(const QString& group) const {
+    QHash<QString, QString>::const_iterator it = placements.constFind(group);
+    if (it != placements.constEnd()) {
+        return it.value();
+    }
+
+    // Group names are case-insensitive everywhere else in the server.
+    for (it = placements.constBegin(); it != placements.constEnd(); ++it) {
+        if (it.key().compare(group, Qt::CaseInsensitive) == 0) {
+            return it.value();
+        }
+    }
+    return m_roots.first();
+}
+
+QString DataRoots::place(const QString& group) {
+    QString root;
+    switch (policy) {
+        case Hash:
+            root = hashRoot(group);
+            break;
+
+        case LeastUsed:
+            root = leastUsedRoot();
+            break;
+
+        case RoundRobin:
+            root = m_roots.at(next % m_roots.size());
+            next++;
+            break;
+    }
+
+    move(group, root);
+    return root;
+}
+
+void DataRoots::move(const QString& group, const QString& root) {
+    placements.insert(group, root);
+    table->setValue(group, root);
+}
+
+void DataRoots::remove(const QString& group) {
+    QStringList names;
+    for (QHash<QString, QString>::const_iterator it = placements.constBegin(); it != placements.constEnd(); ++it) {
+        if (it.key().compare(group, Qt::CaseInsensitive) == 0) {
+            names.append(it.key());
+        }
+    }
+
+    foreach (const QString& name, names) {
+        placements.remove(name);
+        table->remove(name);
+    }
+}
+
+qint64 DataRoots::bytesAvailable(const QString& root) const {
+    return available.value(root, -1);
+}
+
+QString DataRoots::path(const QString& relative) const {
+    QString group = QDir::fromNativeSeparators(relative).section('/', 0, 0);
+    return root(group) + QDir::separator() + relative;
+}
+
+QString DataRoots::relative(const QString& fileName) const {
+    QString path = QDir::fromNativeSeparators(fileName);
+
+    QStringList candidates = m_roots;
+    foreach (const QString& root, placements) {
+        if (!candidates.contains(root)) {
+            candidates.append(root);
+        }
+    }
+
+    foreach (const QString& root, candidates) {
+        QStringList prefixes;
+        prefixes << QDir(root).absolutePath() + "/" << QDir::fromNativeSeparators(root) + "/";
+        foreach (const QString& prefix, prefixes) {
+            if (path.startsWith(prefix)) {
+                return path.mid(prefix.size());
+            }
+        }
+    }
+    return path;
+}
+
+DataRoots::Moves DataRoots::plan() const {
+    Moves moves;
+
+    if (policy == Hash) {
+        // Rendezvous hashing: adding a root only claims the groups that now hash to it.
+        for (QHash<QString, QString>::const_iterator it = placements.constBegin(); it != placements.constEnd(); ++it) {
+            QString target = hashRoot(it.key());
+            if (target != it.value()) {
+                moves.append(qMakePair(it.key(), target));
+            }
+        }
+        return moves;
+    }
+
+    // The other policies even out the number of groups per root, starting
+    // with groups left on roots that are no longer configured.
+    QHash<QString, QStringList> byRoot;
+    QStringList surplus;
+    for (QHash<QString, QString>::const_iterator it = placements.constBegin(); it != placements.constEnd(); ++it) {
+        if (m_roots.contains(it.value())) {
+            byRoot[it.value()].append(it.key());
+        } else {
+            surplus.append(it.key());
+        }
+    }
+
+    int quota = int(std::ceil(double(placements.size()) / m_roots.size()));
+    foreach (const QString& root, m_roots) {
+        QStringList& groups = byRoot[root];
+        groups.sort();
+        while (groups.size() > quota) {
+            surplus.append(groups.takeLast());
+        }
+    }
+
+    foreach (const QString& group, surplus) {
+        QString target = m_roots.first();
+        foreach (const QString& root, m_roots) {
+            if (byRoot.value(root).size() < byRoot.value(target).size()) {
+                target = root;
+            }
+        }
+        byRoot[target].append(group);
+        moves.append(qMakePair(group, target));
+    }
+    return moves;
+}
+
+bool DataRoots::copyTree(const QString& source, const QString& target) {
+    if (!QDir().mkpath(target)) {
+        return false;
+    }
+
+    QDir sourceDir(source);
+    QDirIterator it(source, QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        QString destination = target + QDir::separator() + sourceDir.relativeFilePath(info.filePath());
+
+        if (info.isDir()) {
+            if (!QDir().mkpath(destination)) {
+                return false;
+            }
+            continue;
+        }
+
+        if (!QFile::copy(info.filePath(), destination)) {
+            return false;
+        }
+
+        // Keeps content index entries, which are checked against the modification time, valid.
+        QFile copy(destination);
+        if (!copy.open(QIODevice::Append) || !copy.setFileTime(info.lastModified(), QFileDevice::FileModificationTime)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QString DataRoots::hashRoot(const QString& group) const {
+    QString best;
+    quint64 bestWeight = 0;
+    foreach (const QString& root, m_roots) {
+        QByteArray digest = QCryptographicHash::hash((group.toLower() + "\n" + root).toUtf8(), QCryptographicHash::Md5);
+        quint64 weight = qFromBigEndian<quint64>(digest.constData());
+        if (best.isEmpty() || weight > bestWeight) {
+            best = root;
+            bestWeight = weight;
+        }
+    }
+    return best;
+}
+
+QString DataRoots::leastUsedRoot() const {
+    QString best = m_roots.first();
+    qint64 bestAvailable = -1;
+    foreach (const QString& root, m_roots) {
+        qint64 free = bytesAvailable(root);
+        if (free > bestAvailable) {
+            best = root;
+            bestAvailable = free;
+        }
+    }
+    return best;
+}
+
+void DataRoots::refreshUsage() {
+    QStringList directories = m_roots;
+    QSharedPointer<QHash<QString, qint64>> usage(new QHash<QString, qint64>());
+    pool->run([directories, usage]() {
+        foreach (const QString& root, directories) {
+            QStorageInfo storage(root);
+            usage->insert(root, storage.isValid() ? storage.bytesAvailable() : -1);
+        }
+    }, this, [this, usage]() {
+        available = *usage;
+    });
+}
+
+void DataRoots::adopt(const QList<QPair<QString, QString>>& found) {
+    for (const QPair<QString, QString>& folder : found) {
+        if (m_roots.contains(folder.second) && !placements.contains(folder.first)) {
+            qDebug() << "Adopting group" << folder.first << "on" << folder.second;
+            move(folder.first, folder.second);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef DATAROOTS_H
+#define DATAROOTS_H
+
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QSettings>
+#include <QStringList>
+#include <QTimer>
+
+#include "iopool.h"
+#include "metadatastore.h"
+
+// The directories group folders live in, typically one per disk, and which
+// group lives where. Each new group is placed on a root by the configured
+// policy and the choice is persisted as group=root in the metadata journal's
+// "placements" table, so it commits together with the group, and moving the
+// group later only changes that entry. Paths handed to the rest of the server keep their
+// "group/..." form; only path() and relative() know about roots. Creating the
+// roots, adopting folders found on them and measuring their free space touch
+// the disk, so they run on the I/O pool and the free space is served from the
+// last measurement.
+class DataRoots : public QObject {
+    Q_OBJECT
+
+public:
+    enum Policy {
+        Hash,
+        LeastUsed,
+        RoundRobin,
+    };
+
+    typedef QList<QPair<QString, QString>> Moves;
+
+    static constexpr const char* DefaultRoot = "data";
+    static constexpr const char* LegacyFileName = "database\\placement.dat";
+    static constexpr int UsageRefreshInterval = 5000;
+
+    DataRoots(const QStringList& roots, Policy policy, MetadataStore* store, IoPool* pool, QObject* parent = nullptr);
+
+    static DataRoots* create(QSettings* config, MetadataStore* store, IoPool* pool, QObject* parent = nullptr);
+    static Policy policyFromString(const QString& name);
+
+    QStringList roots() const;
+    void setRoots(const QStringList& roots);
+
+    bool contains(const QString& group) const;
+    QString root(const QString& group) const;
+    QString place(const QString& group);
+    void move(const QString& group, const QString& root);
+    void remove(const QString& group);
+
+    qint64 bytesAvailable(const QString& root) const;
+
+    QString path(const QString& relative) const;
+    QString relative(const QString& fileName) const;
+
+    Moves plan() const;
+
+    static bool copyTree(const QString& source, const QString& target);
+
+private:
+    QString hashRoot(const QString& group) const;
+    QString leastUsedRoot() const;
+    void refreshUsage();
+    void adopt(const QList<QPair<QString, QString>>& found);
+
+    MetadataTable* table;
+    IoPool* pool;
+    QTimer* usageTimer;
+    QHash<QString, qint64> available;
+    QStringList m_roots;
+    Policy policy;
+    int next;
+    QHash<QString, QString> placements;
+};
+
+#endif // DATAROOTS_H
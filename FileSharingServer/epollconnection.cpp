@@ -0,0 +1,204 @@
+#include "epollconnection.h"
+
+#include <QHostAddress>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+EpollConnection::EpollConnection(int fd, EpollServer* server, Storage* storage, QObject* parent) : Connection(fd, storage, parent), fd(fd), server(server) {
+    input = server->acquireBuffer();
+    inputStart = 0;
+    inputEnd = 0;
+    readable = true;
+    peerClosed = false;
+
+    output.reserve(OutputBufferSize);
+    outputStart = 0;
+    closing = false;
+
+    // Looked up once, since the address is gone from the socket after it closes.
+    sockaddr_storage peer;
+    socklen_t length = sizeof(peer);
+    if (getpeername(fd, reinterpret_cast<sockaddr*>(&peer), &length) == 0) {
+        address = QHostAddress(reinterpret_cast<sockaddr*>(&peer)).toString();
+    }
+}
+
+EpollConnection::~EpollConnection() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    if (server) {
+        server->releaseBuffer(input);
+    } else {
+        delete[] input;
+    }
+}
+
+QString EpollConnection::peerAddress() const {
+    return address;
+}
+
+void EpollConnection::handleEvents(quint32 events) {
+    if (fd < 0) {
+        return;
+    }
+
+    if (events & EPOLLERR) {
+        abort();
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        flush();
+    }
+
+    if (fd >= 0 && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+        readable = true;
+        onReadyRead();
+    }
+}
+
+bool EpollConnection::isOpen() const {
+    return fd >= 0;
+}
+
+void EpollConnection::closeSocket() {
+    if (bytesToWrite() > 0) {
+        closing = true;
+        return;
+    }
+
+    abort();
+}
+
+void EpollConnection::abort() {
+    if (fd < 0) {
+        return;
+    }
+
+    ::close(fd);
+    fd = -1;
+    onDisconnected();
+}
+
+qint64 EpollConnection::bytesAvailable() {
+    if (readable && inputEnd < EpollServer::InputBufferSize) {
+        fill();
+    }
+    return inputEnd - inputStart;
+}
+
+qint64 EpollConnection::readData(char* data, qint64 maxSize) {
+    qint64 length = qMin(maxSize, inputEnd - inputStart);
+    memcpy(data, input + inputStart, length);
+    inputStart += length;
+
+    if (inputStart == inputEnd) {
+        inputStart = 0;
+        inputEnd = 0;
+    }
+    return length;
+}
+
+void EpollConnection::writeData(const QByteArray& bytes) {
+    if (fd < 0 || closing) {
+        return;
+    }
+
+    if (outputStart < output.size()) {
+        output.append(bytes);
+        return;
+    }
+
+    output.resize(0);
+    outputStart = 0;
+
+    qint64 written = 0;
+    while (written < bytes.size()) {
+        ssize_t count = ::send(fd, bytes.constData() + written, bytes.size() - written, MSG_NOSIGNAL);
+        if (count > 0) {
+            written += count;
+        } else if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            abort();
+            return;
+        }
+    }
+
+    if (written < bytes.size()) {
+        output.append(bytes.constData() + written, bytes.size() - written);
+    }
+}
+
+qint64 EpollConnection::bytesToWrite() const {
+    return output.size() - outputStart;
+}
+
+void EpollConnection::fill() {
+    if (inputStart > 0) {
+        memmove(input, input + inputStart, inputEnd - inputStart);
+        inputEnd -= inputStart;
+        inputStart = 0;
+    }
+
+    while (inputEnd < EpollServer::InputBufferSize) {
+        ssize_t count = ::recv(fd, input + inputEnd, EpollServer::InputBufferSize - inputEnd, 0);
+        if (count > 0) {
+            inputEnd += count;
+        } else if (count < 0 && errno == EINTR) {
+            continue;
+        } else {
+            // EAGAIN means drained; end of stream and errors end the connection once the input is handled.
+            if (!peerClosed && (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))) {
+                peerClosed = true;
+                QMetaObject::invokeMethod(this, [this]() {
+                    abort();
+                }, Qt::QueuedConnection);
+            }
+            readable = false;
+            return;
+        }
+    }
+}
+
+void EpollConnection::flush() {
+    qint64 written = 0;
+    while (outputStart < output.size()) {
+        ssize_t count = ::send(fd, output.constData() + outputStart, output.size() - outputStart, MSG_NOSIGNAL);
+        if (count > 0) {
+            outputStart += count;
+            written += count;
+        } else if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            abort();
+            return;
+        }
+    }
+
+    if (outputStart == output.size()) {
+        output.resize(0);
+        outputStart = 0;
+
+        if (closing) {
+            abort();
+            return;
+        }
+    } else if (outputStart > OutputBufferSize) {
+        output.remove(0, outputStart);
+        outputStart = 0;
+    }
+
+    if (written > 0) {
+        onBytesWritten(written);
+    }
+}
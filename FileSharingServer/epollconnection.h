@@ -0,0 +1,53 @@
+#ifndef EPOLLCONNECTION_H
+#define EPOLLCONNECTION_H
+
+#include <QPointer>
+
+#include "connection.h"
+#include "epollserver.h"
+
+// Connection served by EpollServer. Input goes through a fixed buffer borrowed
+// from the server's pool; output is written straight to the socket and only
+// the part the kernel does not take is kept until EPOLLOUT.
+class EpollConnection : public Connection {
+    Q_OBJECT
+
+public:
+    static constexpr int OutputBufferSize = 64 * 1024;
+
+    EpollConnection(int fd, EpollServer* server, Storage* storage, QObject* parent = nullptr);
+    ~EpollConnection();
+
+    void handleEvents(quint32 events);
+
+    QString peerAddress() const override;
+    bool isOpen() const override;
+    void abort() override;
+
+protected:
+    qint64 bytesAvailable() override;
+    qint64 readData(char* data, qint64 maxSize) override;
+    void writeData(const QByteArray& bytes) override;
+    qint64 bytesToWrite() const override;
+    void closeSocket() override;
+
+private:
+    void fill();
+    void flush();
+
+    int fd;
+    QPointer<EpollServer> server;
+    QString address;
+
+    char* input;
+    qint64 inputStart;
+    qint64 inputEnd;
+    bool readable;
+    bool peerClosed;
+
+    QByteArray output;
+    qint64 outputStart;
+    bool closing;
+};
+
+#endif // EPOLLCONNECTION_H
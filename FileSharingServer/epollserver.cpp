@@ -0,0 +1,177 @@
+#include "epollserver.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <QTimer>
+
+#include "epollconnection.h"
+
+EpollServer::EpollServer(Storage* storage, int maxConnections, int preallocatedBuffers, QObject* parent) : QObject(parent), storage(storage) {
+    this->maxConnections = maxConnections > 0 ? maxConnections : DefaultMaxConnections;
+    active = 0;
+    listenFd = -1;
+    reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    epollFd = -1;
+    notifier = nullptr;
+    events.resize(MaxEvents);
+
+    for (int i = 0; i < qMin(preallocatedBuffers, this->maxConnections); i++) {
+        freeBuffers.append(new char[InputBufferSize]);
+    }
+}
+
+EpollServer::~EpollServer() {
+    if (listenFd >= 0) {
+        ::close(listenFd);
+    }
+
+    if (epollFd >= 0) {
+        ::close(epollFd);
+    }
+
+    if (reserveFd >= 0) {
+        ::close(reserveFd);
+    }
+
+    qDeleteAll(children());
+
+    foreach (char* buffer, freeBuffers) {
+        delete[] buffer;
+    }
+}
+
+bool EpollServer::listen(quint16 port) {
+    listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        m_errorString = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    int enable = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listenFd, SOMAXCONN) < 0) {
+        m_errorString = QString::fromLocal8Bit(strerror(errno));
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        m_errorString = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = nullptr;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+    notifier = new QSocketNotifier(epollFd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &EpollServer::onActivated);
+
+    return true;
+}
+
+QString EpollServer::errorString() const {
+    return m_errorString;
+}
+
+int EpollServer::activeConnections() const {
+    return active;
+}
+
+char* EpollServer::acquireBuffer() {
+    active++;
+    if (freeBuffers.isEmpty()) {
+        return new char[InputBufferSize];
+    }
+    return freeBuffers.takeLast();
+}
+
+void EpollServer::releaseBuffer(char* buffer) {
+    active--;
+    freeBuffers.append(buffer);
+}
+
+void EpollServer::onActivated() {
+    forever {
+        int count = epoll_wait(epollFd, events.data(), events.size(), 0);
+        if (count <= 0) {
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void* target = events[i].data.ptr;
+            if (!target) {
+                acceptAll();
+            } else {
+                static_cast<EpollConnection*>(target)->handleEvents(events[i].events);
+            }
+        }
+
+        if (count < events.size()) {
+            return;
+        }
+    }
+}
+
+void EpollServer::acceptAll() {
+    forever {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // No edge comes for the backlog already queued, so it is shed through the spare descriptor or retried.
+            if (errno == EMFILE || errno == ENFILE) {
+                if (reserveFd >= 0) {
+                    ::close(reserveFd);
+                    int dropped = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (dropped >= 0) {
+                        ::close(dropped);
+                    }
+                    reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                    if (dropped >= 0) {
+                        continue;
+                    }
+                }
+                QTimer::singleShot(AcceptRetryDelay, this, &EpollServer::acceptAll);
+            }
+            return;
+        }
+
+        if (active >= maxConnections) {
+            ::close(fd);
+            continue;
+        }
+
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        EpollConnection* connection = new EpollConnection(fd, this, storage, this);
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = connection;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+
+        emit newConnection(connection);
+    }
+}
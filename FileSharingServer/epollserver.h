@@ -0,0 +1,62 @@
+#ifndef EPOLLSERVER_H
+#define EPOLLSERVER_H
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <QVector>
+
+#include <sys/epoll.h>
+
+#include "connection.h"
+
+class EpollConnection;
+
+// Linux-native alternative to QTcpServer. All sockets are non-blocking and
+// registered edge-triggered with a single epoll instance, whose descriptor is
+// the only thing the Qt event loop watches. Per-connection input buffers are
+// recycled through a free list so accepting and serving a client does not
+// allocate once the pool is warm. A spare descriptor is held back so that,
+// when the process runs out of them, pending clients can still be accepted
+// and turned away instead of stalling the edge-triggered listener.
+class EpollServer : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultMaxConnections = 16384;
+    static constexpr int DefaultPreallocatedBuffers = 1024;
+    static constexpr qint64 InputBufferSize = 16 * 1024;
+    static constexpr int MaxEvents = 256;
+    static constexpr int AcceptRetryDelay = 100;
+
+    EpollServer(Storage* storage, int maxConnections, int preallocatedBuffers, QObject* parent = nullptr);
+    ~EpollServer();
+
+    bool listen(quint16 port);
+    QString errorString() const;
+    int activeConnections() const;
+
+    char* acquireBuffer();
+    void releaseBuffer(char* buffer);
+
+signals:
+    void newConnection(Connection* connection);
+
+private slots:
+    void onActivated();
+
+private:
+    void acceptAll();
+
+    Storage* storage;
+    int maxConnections;
+    int active;
+    int listenFd;
+    int reserveFd;
+    int epollFd;
+    QSocketNotifier* notifier;
+    QVector<epoll_event> events;
+    QVector<char*> freeBuffers;
+    QString m_errorString;
+};
+
+#endif // EPOLLSERVER_H
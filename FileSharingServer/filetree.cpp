@@ -0,0 +1,100 @@
+#include "filetree.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRegExp>
+
+FileTree::Roots FileTree::roots(const QMap<QString, MetadataTable*>& groupMembers, const QString& user, const DataRoots* dataRoots) {
+    Roots roots;
+    foreach (const QString& key, groupMembers.keys()) {
+        if (groupMembers.value(key)->allKeys().contains(user, Qt::CaseInsensitive)) {
+            QString leader;
+            if (groupMembers.value(key)->value(user).toString().compare("1") == 0) {
+                leader = user;
+            }
+            roots.append(qMakePair(dataRoots->path(key), leader));
+        }
+    }
+    return roots;
+}
+
+QJsonObject FileTree::getData(const QString &path, const QString& leader, const ContentIndex::Snapshot& hashes) {
+    // Paths in the tree are relative to the data root holding the group folder.
+    return getData(path, QFileInfo(path).path().size() + 1, leader, hashes);
+}
+
+QJsonObject FileTree::getData(const QString &path, int prefix, const QString& leader, const ContentIndex::Snapshot& hashes) {
+    QString relative = path.mid(prefix);
+    QJsonObject object;
+    object.insert("leader", leader);
+
+    QFileInfo info(path);
+    object.insert("name", info.fileName());
+    object.insert("path", relative);
+
+    if (info.isDir()) {
+        object.insert("type", "dir");
+        QDir dir(path);
+        QJsonArray children;
+        foreach (const QFileInfo& file, dir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries, QDir::DirsFirst | QDir::Name)) {
+            children.push_back(getData(file.filePath().replace("/", QDir::separator()).replace("\\", QDir::separator()), prefix, leader, hashes));
+        }
+        object.insert("children", children);
+    } else {
+        object.insert("type", "file");
+        object.insert("size", info.size());
+
+        // Only a hash taken from the file as it is now; a stale one would poison client caches.
+        ContentIndex::Snapshot::const_iterator it = hashes.constFind(QDir::fromNativeSeparators(relative));
+        if (it != hashes.constEnd() && it->size == info.size() && it->modified == info.lastModified().toMSecsSinceEpoch()) {
+            object.insert("hash", it->hash);
+        }
+    }
+
+    return object;
+}
+
+QJsonObject FileTree::build(const Roots& roots, const ContentIndex::Snapshot& hashes) {
+    QJsonArray array;
+    for (const QPair<QString, QString>& root : roots) {
+        array.push_back(getData(root.first, root.second, hashes));
+    }
+
+    QJsonObject data;
+    data.insert("name", "");
+    data.insert("path", "");
+    data.insert("type", "root");
+    data.insert("children", array);
+    return data;
+}
+
+QByteArray FileTree::serialize(const Roots& roots, const ContentIndex::Snapshot& hashes) {
+    QJsonDocument jsonDocument;
+    jsonDocument.setObject(build(roots, hashes));
+
+    return jsonDocument.toJson(QJsonDocument::Compact);
+}
+
+QString FileTree::tag(const QByteArray& epoch, const Roots& roots, const QHash<QString, quint64>& versions) {
+    // A user's tree is fully determined by the groups they see, their role in
+    // each and what each group contains, so it can be tagged without a walk.
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(epoch);
+    for (const QPair<QString, QString>& root : roots) {
+        QString group = QFileInfo(root.first).fileName().toLower();
+        hash.addData(QString("\n%1\t%2\t%3").arg(group, root.second).arg(versions.value(group)).toUtf8());
+    }
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+bool FileTree::isValidGroupName(const QString &groupName) {
+    if (groupName.isEmpty()) {
+        return false;
+    }
+
+    QRegExp regex("^[A-Za-z0-9_\\- ]*$");
+    return regex.exactMatch(groupName);
+}
@@ -0,0 +1,32 @@
+#ifndef FILETREE_H
+#define FILETREE_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QString>
+
+#include "contentindex.h"
+#include "metadatastore.h"
+
+// Builds the JSON tree sent in Get responses. Kept free of MainWindow so the
+// work can run on the I/O pool and be benchmarked on its own.
+class FileTree {
+public:
+    typedef QList<QPair<QString, QString>> Roots;
+
+    static Roots roots(const QMap<QString, MetadataTable*>& groupMembers, const QString& user, const DataRoots* dataRoots);
+    static QJsonObject getData(const QString& path, const QString& leader, const ContentIndex::Snapshot& hashes = ContentIndex::Snapshot());
+    static QJsonObject build(const Roots& roots, const ContentIndex::Snapshot& hashes = ContentIndex::Snapshot());
+    static QByteArray serialize(const Roots& roots, const ContentIndex::Snapshot& hashes = ContentIndex::Snapshot());
+    static QString tag(const QByteArray& epoch, const Roots& roots, const QHash<QString, quint64>& versions);
+
+    static bool isValidGroupName(const QString& groupName);
+
+private:
+    static QJsonObject getData(const QString& path, int prefix, const QString& leader, const ContentIndex::Snapshot& hashes);
+};
+
+#endif // FILETREE_H
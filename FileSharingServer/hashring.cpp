@@ -0,0 +1,49 @@
+#include "hashring.h"
+
+#include <QCryptographicHash>
+#include <QtEndian>
+
+HashRing::HashRing(int virtualNodes) : virtualNodes(qMax(1, virtualNodes)) {
+}
+
+QStringList HashRing::nodes() const {
+    return m_nodes;
+}
+
+void HashRing::setNodes(const QStringList& nodes) {
+    m_nodes.clear();
+    points.clear();
+
+    foreach (const QString& node, nodes) {
+        QString trimmed = node.trimmed();
+        if (trimmed.isEmpty() || m_nodes.contains(trimmed)) {
+            continue;
+        }
+
+        m_nodes.append(trimmed);
+        for (int i = 0; i < virtualNodes; i++) {
+            points.insert(hash(QString("%1#%2").arg(trimmed).arg(i)), trimmed);
+        }
+    }
+}
+
+bool HashRing::isEmpty() const {
+    return points.isEmpty();
+}
+
+QString HashRing::owner(const QString& group) const {
+    if (points.isEmpty()) {
+        return QString();
+    }
+
+    QMap<quint64, QString>::const_iterator it = points.lowerBound(hash(group.toLower()));
+    if (it == points.constEnd()) {
+        it = points.constBegin();
+    }
+    return it.value();
+}
+
+quint64 HashRing::hash(const QString& key) {
+    QByteArray digest = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5);
+    return qFromBigEndian<quint64>(digest.constData());
+}
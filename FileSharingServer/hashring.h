@@ -0,0 +1,31 @@
+#ifndef HASHRING_H
+#define HASHRING_H
+
+#include <QMap>
+#include <QStringList>
+
+// Consistent hashing of group names onto cluster nodes. Every node is placed
+// on the ring at a number of virtual points, and a group belongs to the first
+// point at or after the hash of its lower-cased name. Adding a node only takes
+// over the groups that now fall on its points; every other group stays put.
+class HashRing {
+public:
+    static constexpr int DefaultVirtualNodes = 64;
+
+    explicit HashRing(int virtualNodes = DefaultVirtualNodes);
+
+    QStringList nodes() const;
+    void setNodes(const QStringList& nodes);
+    bool isEmpty() const;
+
+    QString owner(const QString& group) const;
+
+private:
+    static quint64 hash(const QString& key);
+
+    int virtualNodes;
+    QStringList m_nodes;
+    QMap<quint64, QString> points;
+};
+
+#endif // HASHRING_H
@@ -0,0 +1,89 @@
+#include "iopool.h"
+
+#include <QMutexLocker>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+IoPool::IoPool(int threads, QObject* parent) : QObject(parent) {
+    pool.setMaxThreadCount(threads > 0 ? threads : DefaultThreads);
+    pool.setExpiryTimeout(-1);
+}
+
+IoPool::~IoPool() {
+    pool.waitForDone();
+}
+
+void IoPool::run(const std::function<void()>& work, QObject* context, const std::function<void()>& done) {
+    run(nullptr, work, context, done);
+}
+
+void IoPool::run(const void* strand, const std::function<void()>& work, QObject* context, const std::function<void()>& done) {
+    Job job;
+    job.work = work;
+    job.context = context;
+    job.done = done;
+
+    pending.fetchAndAddRelaxed(1);
+
+    if (strand) {
+        QMutexLocker locker(&mutex);
+        QHash<const void*, QQueue<Job>>::iterator it = strands.find(strand);
+        if (it != strands.end()) {
+            it.value().enqueue(job);
+            return;
+        }
+        strands.insert(strand, QQueue<Job>());
+    }
+
+    start(strand, job);
+}
+
+int IoPool::queueDepth() const {
+    return pending.loadRelaxed();
+}
+
+void IoPool::start(const void* strand, const Job& job) {
+    pool.start([this, strand, job]() {
+        job.work();
+
+        if (job.done) {
+            QPointer<QObject> context = job.context;
+            std::function<void()> done = job.done;
+            QMetaObject::invokeMethod(this, [context, done]() {
+                if (context) {
+                    done();
+                }
+            }, Qt::QueuedConnection);
+        }
+        pending.fetchAndSubRelaxed(1);
+
+        if (strand) {
+            QMutexLocker locker(&mutex);
+            QHash<const void*, QQueue<Job>>::iterator it = strands.find(strand);
+            if (it.value().isEmpty()) {
+                strands.erase(it);
+            } else {
+                Job next = it.value().dequeue();
+                locker.unlock();
+                start(strand, next);
+            }
+        }
+    });
+}
+
+bool IoPool::sync(QFile* file) {
+    if (!file->flush()) {
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(file->handle())));
+#else
+    return ::fsync(file->handle()) == 0;
+#endif
+}
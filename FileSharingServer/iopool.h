@@ -0,0 +1,48 @@
+#ifndef IOPOOL_H
+#define IOPOOL_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QQueue>
+#include <QFile>
+#include <QPointer>
+#include <functional>
+
+// Runs filesystem work off the event-loop thread. The completion callback is
+// posted back to the thread owning the pool and dropped if the context object
+// has been destroyed in the meantime. Jobs submitted with the same strand key run
+// one after another in submission order, which keeps writes to a file ordered.
+class IoPool : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultThreads = 4;
+
+    explicit IoPool(int threads, QObject* parent = nullptr);
+    ~IoPool();
+
+    void run(const std::function<void()>& work, QObject* context, const std::function<void()>& done);
+    void run(const void* strand, const std::function<void()>& work, QObject* context, const std::function<void()>& done);
+
+    int queueDepth() const;
+
+    static bool sync(QFile* file);
+
+private:
+    struct Job {
+        std::function<void()> work;
+        QPointer<QObject> context;
+        std::function<void()> done;
+    };
+
+    void start(const void* strand, const Job& job);
+
+    QThreadPool pool;
+    QMutex mutex;
+    QHash<const void*, QQueue<Job>> strands;
+    QAtomicInt pending;
+};
+
+#endif // IOPOOL_H
@@ -0,0 +1,239 @@
+#include "logger.h"
+
+#include <QDateTime>
+#include <QDir>
+
+Logger::Logger(const QString& directory, int bufferSize, qint64 maxFileSize, int maxFiles, int tailLines, QObject* parent) : QObject(parent), directory(directory) {
+    quint64 capacity = 2;
+    while (capacity < quint64(qMax(bufferSize, 2))) {
+        capacity <<= 1;
+    }
+
+    ring.reset(new Slot[capacity]);
+    for (quint64 i = 0; i < capacity; i++) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask = capacity - 1;
+    enqueuePosition.store(0);
+    dequeuePosition = 0;
+    droppedRecords.store(0);
+    minimumLevel.store(Info);
+
+    sleeping.store(false);
+    stopping.store(false);
+
+    this->maxFileSize = maxFileSize > 0 ? maxFileSize : DefaultMaxFileSize;
+    this->maxFiles = qMax(1, maxFiles);
+    tailSize = qMax(0, tailLines);
+    tailSequence = 0;
+
+    QDir().mkpath(directory);
+    file.setFileName(QDir(directory).filePath("server.log"));
+    file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+
+    thread = QThread::create([this]() { run(); });
+    thread->start(QThread::LowPriority);
+}
+
+Logger::~Logger() {
+    stopping.store(true);
+    wake.release();
+    thread->wait();
+    delete thread;
+}
+
+Logger* Logger::create(QSettings* config, QObject* parent) {
+    Logger* logger = new Logger(config->value("log/directory", "logs").toString(),
+                                config->value("log/bufferSize", DefaultBufferSize).toInt(),
+                                config->value("log/maxFileSize", DefaultMaxFileSize).toLongLong(),
+                                config->value("log/maxFiles", DefaultMaxFiles).toInt(),
+                                config->value("log/tailLines", DefaultTailLines).toInt(),
+                                parent);
+    logger->setLevel(parseLevel(config->value("log/level", "info").toString()));
+    return logger;
+}
+
+Logger::Level Logger::parseLevel(const QString& name) {
+    QString level = name.toLower();
+    if (level == "debug") {
+        return Debug;
+    } else if (level == "warning") {
+        return Warning;
+    } else if (level == "error") {
+        return Error;
+    }
+    return Info;
+}
+
+void Logger::setLevel(Level level) {
+    minimumLevel.store(level);
+}
+
+bool Logger::isEnabled(Level level) const {
+    return level >= minimumLevel.load(std::memory_order_relaxed);
+}
+
+void Logger::log(Level level, qint64 connection, const QString& user, const QString& op, qint64 duration, const QString& result) {
+    if (!isEnabled(level)) {
+        return;
+    }
+
+    Record record;
+    record.time = QDateTime::currentMSecsSinceEpoch();
+    record.level = level;
+    record.connection = connection;
+    record.user = user;
+    record.op = op;
+    record.duration = duration;
+    record.result = result;
+
+    if (!push(std::move(record))) {
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (sleeping.exchange(false)) {
+        wake.release();
+    }
+}
+
+QStringList Logger::tail(quint64& sequence) const {
+    QMutexLocker locker(&tailMutex);
+
+    quint64 available = qMin<quint64>(tailSequence - sequence, tailLines.size());
+    sequence = tailSequence;
+    return tailLines.mid(tailLines.size() - int(available));
+}
+
+quint64 Logger::dropped() const {
+    return droppedRecords.load(std::memory_order_relaxed);
+}
+
+// Bounded multi-producer queue after Dmitry Vyukov: each slot carries a
+// sequence number telling producers and the consumer whose turn it is.
+bool Logger::push(Record&& record) {
+    quint64 position = enqueuePosition.load(std::memory_order_relaxed);
+    forever {
+        Slot& slot = ring[position & mask];
+        quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+        qint64 difference = qint64(sequence) - qint64(position);
+
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.record = std::move(record);
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Logger::pop(Record& record) {
+    Slot& slot = ring[dequeuePosition & mask];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) {
+        return false;
+    }
+
+    record = std::move(slot.record);
+    slot.record = Record();
+    slot.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+    dequeuePosition++;
+    return true;
+}
+
+bool Logger::isEmpty() const {
+    return ring[dequeuePosition & mask].sequence.load(std::memory_order_acquire) != dequeuePosition + 1;
+}
+
+void Logger::run() {
+    forever {
+        Record record;
+        QStringList lines;
+        while (pop(record)) {
+            lines.append(format(record));
+        }
+
+        if (!lines.isEmpty()) {
+            foreach (const QString& line, lines) {
+                write(line);
+            }
+            file.flush();
+
+            QMutexLocker locker(&tailMutex);
+            tailLines.append(lines);
+            if (tailLines.size() > tailSize) {
+                tailLines.erase(tailLines.begin(), tailLines.begin() + (tailLines.size() - tailSize));
+            }
+            tailSequence += lines.size();
+            continue;
+        }
+
+        if (stopping.load()) {
+            return;
+        }
+
+        // Producers only touch the semaphore when they see the sink asleep.
+        sleeping.store(true);
+        if (isEmpty()) {
+            wake.tryAcquire(1, 100);
+        }
+        sleeping.store(false);
+    }
+}
+
+void Logger::write(const QString& line) {
+    if (!file.isOpen()) {
+        return;
+    }
+
+    QByteArray bytes = line.toUtf8();
+    bytes.append('\n');
+    if (file.size() > 0 && file.size() + bytes.size() > maxFileSize) {
+        rotate();
+    }
+    file.write(bytes);
+}
+
+void Logger::rotate() {
+    file.close();
+
+    QDir dir(directory);
+    dir.remove(QString("server.log.%1").arg(maxFiles));
+    for (int i = maxFiles - 1; i >= 1; i--) {
+        dir.rename(QString("server.log.%1").arg(i), QString("server.log.%1").arg(i + 1));
+    }
+    dir.rename("server.log", "server.log.1");
+
+    file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+}
+
+QString Logger::format(const Record& record) {
+    static const char* levels[] = {"debug", "info", "warning", "error"};
+
+    auto quote = [](const QString& value) {
+        if (!value.isEmpty() && !value.contains(' ') && !value.contains('"') && !value.contains('=') && !value.contains('\n') && !value.contains('\r')) {
+            return value;
+        }
+        return QString("\"%1\"").arg(QString(value).replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n").replace("\r", "\\r"));
+    };
+
+    QString line = QString("ts=%1 level=%2").arg(QDateTime::fromMSecsSinceEpoch(record.time, Qt::UTC).toString(Qt::ISODateWithMs)).arg(levels[record.level]);
+    if (record.connection >= 0) {
+        line += QString(" conn=%1").arg(record.connection);
+    }
+    if (!record.user.isEmpty()) {
+        line += " user=" + quote(record.user);
+    }
+    if (!record.op.isEmpty()) {
+        line += " op=" + quote(record.op);
+    }
+    if (record.duration >= 0) {
+        line += QString(" duration_ms=%1").arg(record.duration / 1000.0, 0, 'f', 3);
+    }
+    line += " result=" + quote(record.result);
+    return line;
+}
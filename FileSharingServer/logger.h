@@ -0,0 +1,96 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QObject>
+#include <QFile>
+#include <QMutex>
+#include <QSemaphore>
+#include <QSettings>
+#include <QStringList>
+#include <QThread>
+#include <atomic>
+#include <memory>
+
+// Structured server log. Producers push records into a bounded lock-free ring
+// and never block; when the ring is full the record is dropped and counted. A
+// background thread formats records as key=value lines into a rotating file
+// and keeps the most recent lines for the optional log view.
+class Logger : public QObject {
+    Q_OBJECT
+
+public:
+    enum Level {
+        Debug,
+        Info,
+        Warning,
+        Error,
+    };
+
+    struct Record {
+        qint64 time;
+        Level level;
+        qint64 connection;
+        QString user;
+        QString op;
+        qint64 duration;
+        QString result;
+    };
+
+    static constexpr int DefaultBufferSize = 8192;
+    static constexpr int DefaultTailLines = 1000;
+    static constexpr qint64 DefaultMaxFileSize = 10 * 1024 * 1024;
+    static constexpr int DefaultMaxFiles = 5;
+
+    Logger(const QString& directory, int bufferSize, qint64 maxFileSize, int maxFiles, int tailLines, QObject* parent = nullptr);
+    ~Logger();
+
+    static Logger* create(QSettings* config, QObject* parent);
+    static Level parseLevel(const QString& name);
+
+    void setLevel(Level level);
+    bool isEnabled(Level level) const;
+
+    void log(Level level, qint64 connection, const QString& user, const QString& op, qint64 duration, const QString& result);
+
+    QStringList tail(quint64& sequence) const;
+    quint64 dropped() const;
+
+private:
+    struct Slot {
+        std::atomic<quint64> sequence;
+        Record record;
+    };
+
+    bool push(Record&& record);
+    bool pop(Record& record);
+    bool isEmpty() const;
+
+    void run();
+    void write(const QString& line);
+    void rotate();
+    static QString format(const Record& record);
+
+    std::unique_ptr<Slot[]> ring;
+    quint64 mask;
+    std::atomic<quint64> enqueuePosition;
+    quint64 dequeuePosition;
+    std::atomic<quint64> droppedRecords;
+    std::atomic<int> minimumLevel;
+
+    std::atomic<bool> sleeping;
+    std::atomic<bool> stopping;
+    QSemaphore wake;
+    QThread* thread;
+
+    QString directory;
+    qint64 maxFileSize;
+    int maxFiles;
+    QFile file;
+
+    mutable QMutex tailMutex;
+    QStringList tailLines;
+    int tailSize;
+    quint64 tailSequence;
+};
+
+#endif // LOGGER_H
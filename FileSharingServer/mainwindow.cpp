@@ -2,29 +2,53 @@
 #include "ui_mainwindow.h"
 
 #include <QMessageBox>
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDir>
+#include <QDirIterator>
+#include <QFileSystemWatcher>
+#include <QRandomGenerator>
+#include <QTimer>
 
+#include "filetree.h"
 #include "structs.h"
+#include "tcpconnection.h"
+#ifdef Q_OS_LINUX
+#include "epollserver.h"
+#endif
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow) {
     ui->setupUi(this);
 
     setWindowFlags(windowFlags() | Qt::MSWindowsFixedSizeDialogHint);
 
-    if (!QDir("data").exists()) {
-        QDir().mkdir("data");
-    }
-
     if (!QDir("database").exists()) {
         QDir().mkdir("database");
     }
 
-    users = new QSettings("database\\users.dat", QSettings::IniFormat);
-    groups = new QSettings("database\\groups.dat", QSettings::IniFormat);
+    config = new QSettings("server.ini", QSettings::IniFormat);
+    logger = Logger::create(config, this);
+    ioPool = new IoPool(config->value("io/threads", IoPool::DefaultThreads).toInt(), this);
+
+    // Users, groups and members go through the metadata journal; see MetadataStore.
+    metadata = MetadataStore::create(config, ioPool, this);
+    if (!metadata->open()) {
+        QMessageBox::critical(this, "Metadata", QString("Unable to load the metadata: %1.").arg(metadata->errorString()));
+        exit(EXIT_FAILURE);
+    }
+    connect(metadata, &MetadataStore::failed, this, [this](const QString& message) {
+        logger->log(Logger::Error, -1, QString(), "metadata", -1, message);
+    });
+    importMetadata();
+    users = metadata->table("users");
+    groups = metadata->table("groups");
+
+    // Tags from an earlier run must not match: files may have changed while the server was down.
+    serverEpoch = QByteArray::number(QDateTime::currentMSecsSinceEpoch()) + QByteArray::number(QRandomGenerator::global()->generate());
 
     QStringList groupList = groups->allKeys();
     foreach (const QString& group, groupList) {
-        groupMembers.insert(group, new QSettings("database\\" + group + ".group", QSettings::IniFormat));
+        groupMembers.insert(group, metadata->table("members/" + group));
 
         qDebug() << "Group:" << group;
         foreach (const QString& key, groupMembers.value(group)->allKeys()) {
@@ -32,183 +56,494 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
         }
     }
 
+    storage = Storage::create(config, ioPool, this);
+    dataRoots = DataRoots::create(config, metadata, ioPool, this);
+
+    // Uploads and replicated files cut short by the previous run left their staging files behind.
+    foreach (const QString& root, dataRoots->roots()) {
+        QDir(root + QDir::separator() + UploadStagingFolder).removeRecursively();
+        QDir(root + QDir::separator() + ReplicaStagingFolder).removeRecursively();
+    }
+    createStagingFolders();
+
+    // Ranged uploads reserve their whole size up front, so abandoned ones are dropped after a while.
+    maxUploadSize = config->value("storage/maxUploadSize", 0).toLongLong();
+    partialUploadTimeout = config->value("storage/partialUploadTimeout", DefaultPartialUploadTimeout).toLongLong();
+    QTimer* uploadReaper = new QTimer(this);
+    connect(uploadReaper, &QTimer::timeout, this, &MainWindow::expirePartialUploads);
+    uploadReaper->start(PartialUploadCheckInterval);
+
+    contentIndex = new ContentIndex(metadata, dataRoots, ioPool, this);
+    contentIndex->scan();
+    nameIndex = new NameIndex(dataRoots, ioPool, this);
+    nameIndex->scan();
+
+    QString role = config->value("replication/role", "none").toString();
+    replicationLog = nullptr;
+    replica = nullptr;
+    replicaSnapshotting = false;
+    if (role.compare("primary", Qt::CaseInsensitive) == 0) {
+        replicationLog = new ReplicationLog(config->value("replication/logSize", ReplicationLog::DefaultCapacity).toInt(), this);
+        connect(replicationLog, &ReplicationLog::appended, this, [this]() {
+            answerReplicas();
+        });
+
+        // Parked polls are answered now and then even without changes, so replicas see the primary is alive.
+        QTimer* heartbeat = new QTimer(this);
+        connect(heartbeat, &QTimer::timeout, this, [this]() {
+            answerReplicas(true);
+        });
+        heartbeat->start(ReplicationHeartbeat);
+    } else if (role.compare("replica", Qt::CaseInsensitive) == 0) {
+        replica = new ReplicaClient(config->value("replication/primaryHost", "127.0.0.1").toString(),
+                                    config->value("replication/primaryPort", 1234).toUInt(),
+                                    config->value("replication/secret").toString(),
+                                    "database\\replica.dat", storage, this);
+        replica->setApplier([this](const QJsonObject& event, const std::function<void()>& done) {
+            applyReplicationEvent(event, done);
+        });
+        connect(replica, &ReplicaClient::stateChanged, this, [this](bool connected) {
+            writeLog(QString("Replication: %1 primary %2").arg(connected ? "connected to" : "lost").arg(replica->primary()));
+        });
+        connect(replica, &ReplicaClient::errorOccurred, this, [this](const QString& message) {
+            logger->log(Logger::Warning, -1, QString(), "replicate", -1, message);
+        });
+    }
+
+    // Groups are spread over the nodes in cluster/nodes; this node is cluster/self.
+    clusterRing = HashRing(config->value("cluster/virtualNodes", HashRing::DefaultVirtualNodes).toInt());
+    clusterSelf = config->value("cluster/self").toString().trimmed();
+    clusterSecret = config->value("cluster/secret").toString();
+    handingOff = false;
+
+    // Connections that go quiet, or never get as far as a first request, are closed.
+    idleTimeout = config->value("connection/idleTimeout", DefaultIdleTimeout).toLongLong();
+    handshakeTimeout = config->value("connection/handshakeTimeout", DefaultHandshakeTimeout).toLongLong();
+    heartbeatInterval = config->value("connection/heartbeatInterval", DefaultHeartbeatInterval).toLongLong();
+    connectionsReaped = 0;
+    idleWheel = new TimerWheel(TimerWheel::DefaultTick, TimerWheel::DefaultSlots, [this](Connection* connection) {
+        return connectionDeadline(connection);
+    }, this);
+    connect(idleWheel, &TimerWheel::expired, this, &MainWindow::onConnectionExpired);
+
+    // Past these limits requests are answered with ResponseRetryLater instead of being served.
+    rateLimiter = RateLimiter::create(config, this);
+    maxConnections = config->value("limits/maxConnections", 0).toInt();
+    maxHeavyRequests = config->value("limits/maxHeavyRequests", DefaultMaxHeavyRequests).toInt();
+    requestsThrottled = 0;
+
+    metrics = new Metrics(this);
+    metrics->setGauges([this]() {
+        int signedIn = 0;
+        foreach (const auto& client, clients) {
+            signedIn += client.second.isEmpty() ? 0 : 1;
+        }
+
+        QVector<Metrics::Gauge> gauges({
+            {"fileshare_signed_in_users", "Connections with a signed-in user.", signedIn},
+            {"fileshare_io_queue_depth", "Jobs waiting for or running on the I/O thread pool.", ioPool->queueDepth()},
+            {"fileshare_group_moves_pending", "Groups waiting to be moved to another data root.", groupMoves.size()},
+            {"fileshare_connections_tracked", "Connections watched for idleness.", idleWheel->size()},
+            {"fileshare_connections_reaped", "Connections closed for being idle or silent since startup.", qint64(connectionsReaped)},
+            {"fileshare_search_index_entries", "Files and folders in the name index.", nameIndex->size()},
+            {"fileshare_heavy_requests_in_flight", "Tree walks and hash lookups being served.", heavyRequests.size()},
+            {"fileshare_requests_throttled", "Requests answered with a retry-after since startup.", qint64(requestsThrottled)},
+            {"fileshare_metadata_journal_bytes", "Size of the metadata journal since the last checkpoint.", metadata->journalSize()},
+            {"fileshare_metadata_commits", "Batches of metadata changes fsynced since startup.", qint64(metadata->commits())},
+        });
+
+        if (replicationLog) {
+            qint64 maxLag = 0;
+            foreach (const ReplicaState& state, replicas) {
+                maxLag = qMax<qint64>(maxLag, replicationLog->head() - state.position);
+            }
+            gauges.append({"fileshare_replicas", "Replicas following this primary.", replicas.size()});
+            gauges.append({"fileshare_replication_head", "Sequence number of the last change.", qint64(replicationLog->head())});
+            gauges.append({"fileshare_replication_max_lag_events", "Changes the furthest behind replica has not applied yet.", maxLag});
+        } else if (replica) {
+            gauges.append({"fileshare_replication_connected", "Whether the link to the primary is up.", replica->isConnected() ? 1 : 0});
+            gauges.append({"fileshare_replication_lag_events", "Changes made on the primary and not applied here yet.", replica->lagEvents()});
+            gauges.append({"fileshare_replication_lag_ms", "Age of the oldest change not applied here yet.", replica->lagMilliseconds()});
+        }
+
+        if (!clusterSelf.isEmpty()) {
+            int connected = 0;
+            foreach (PeerLink* link, clusterPeers) {
+                connected += link->isConnected() ? 1 : 0;
+            }
+            gauges.append({"fileshare_cluster_nodes", "Nodes on the hash ring, this one included.", clusterRing.nodes().size()});
+            gauges.append({"fileshare_cluster_peers_connected", "Other nodes this node has a link to.", connected});
+            gauges.append({"fileshare_cluster_handoffs_pending", "Groups held here that belong to another node.", handoffs.size()});
+        }
+        return gauges;
+    });
+
+    tracer = Tracer::create(config, this);
+    metrics->addEndpoint("/trace", "application/json", [this]() {
+        return tracer->toChromeJson();
+    });
+
     model = new QStringListModel(this);
 
     ui->listView->setEditTriggers(QAbstractItemView::NoEditTriggers);
     ui->listView->setModel(model);
 
-    server = new QTcpServer();
-    if (server->listen(QHostAddress::Any, 1234)) {
+    logSequence = 0;
+    if (config->value("log/view", true).toBool()) {
+        QTimer* logTimer = new QTimer(this);
+        connect(logTimer, &QTimer::timeout, this, &MainWindow::refreshLog);
+        logTimer->start(250);
+    } else {
+        ui->listView->hide();
+    }
+
+    quint16 port = config->value("server/port", 1234).toUInt();
+    QString engine = config->value("server/engine", "qt").toString();
+
+    bool listening = false;
+    QString errorString;
+    server = nullptr;
+
+#ifdef Q_OS_LINUX
+    if (engine.compare("epoll", Qt::CaseInsensitive) == 0) {
+        engine = "epoll";
+        int maxConnections = config->value("server/maxConnections", EpollServer::DefaultMaxConnections).toInt();
+        int preallocatedBuffers = config->value("server/preallocatedBuffers", EpollServer::DefaultPreallocatedBuffers).toInt();
+        EpollServer* epollServer = new EpollServer(storage, maxConnections, preallocatedBuffers, this);
+        connect(epollServer, &EpollServer::newConnection, this, &MainWindow::addClient);
+        listening = epollServer->listen(port);
+        errorString = epollServer->errorString();
+    }
+#else
+    if (engine.compare("epoll", Qt::CaseInsensitive) == 0) {
+        qDebug() << "The epoll engine is only available on Linux";
+    }
+#endif
+
+    if (engine != "epoll") {
+        engine = "qt";
+        server = new QTcpServer();
         connect(server, &QTcpServer::newConnection, this, &MainWindow::newClientConnection);
-        ui->statusbar->showMessage("Server is listening on port 1234...");
-        writeLog("Server is listening on port 1234...");
+        listening = server->listen(QHostAddress::Any, port);
+        errorString = server->errorString();
+    }
+
+    if (listening) {
+        QString message = QString("Server is listening on port %1...").arg(port);
+        ui->statusbar->showMessage(message);
+        writeLog(message);
+        writeLog(QString("Network engine: %1").arg(engine));
+        writeLog(QString("Storage backend: %1").arg(storage->name()));
+        writeLog(QString("Data roots: %1").arg(dataRoots->roots().join(", ")));
+        writeLog(QString("Replication: %1").arg(replica ? "replica of " + replica->primary() : role.toLower()));
+
+        quint16 metricsPort = config->value("metrics/port", Metrics::DefaultPort).toUInt();
+        if (metricsPort == 0) {
+            writeLog("Metrics endpoint: disabled");
+        } else if (metrics->listen(metricsPort)) {
+            writeLog(QString("Metrics endpoint: http://127.0.0.1:%1/metrics").arg(metricsPort));
+        } else {
+            writeLog(QString("Metrics endpoint: %1").arg(metrics->errorString()));
+        }
+
+        if (tracer->isEnabled()) {
+            writeLog(QString("Tracing: enabled, slow requests above %1 ms are logged").arg(config->value("trace/slowThreshold", Tracer::DefaultSlowThreshold).toInt()));
+        }
     } else {
-        QMessageBox::critical(this, "QTcpServer", QString("Unable to start the server: %1.").arg(server->errorString()));
+        QMessageBox::critical(this, "QTcpServer", QString("Unable to start the server: %1.").arg(errorString));
         exit(EXIT_FAILURE);
     }
 
-    qDebug() << isValidGroupName("group1");
-}
+    // Roots added to server.ini are picked up and filled without a restart.
+    QFileSystemWatcher* configWatcher = new QFileSystemWatcher(QStringList() << config->fileName(), this);
+    connect(configWatcher, &QFileSystemWatcher::fileChanged, this, [this, configWatcher](const QString& path) {
+        if (!configWatcher->files().contains(path)) {
+            // Editors that save by replacing the file drop it from the watch list.
+            configWatcher->addPath(path);
+        }
+        onConfigChanged();
+    });
 
-MainWindow::~MainWindow() {
-    foreach (QTcpSocket* socket, clients.keys()) {
-        socket->close();
-        socket->deleteLater();
+    rebalancePending = false;
+    if (config->value("storage/rebalance", true).toBool()) {
+        QTimer::singleShot(0, this, &MainWindow::rebalance);
+    }
+
+    updateCluster();
+
+    if (replica) {
+        replica->start();
     }
 
-    foreach (const QString& key, groupMembers.keys()) {
-        groupMembers.value(key)->deleteLater();
+    qDebug() << FileTree::isValidGroupName("group1");
+}
+
+MainWindow::~MainWindow() {
+    foreach (Connection* connection, clients.keys()) {
+        connection->close();
+        connection->deleteLater();
     }
 
-    users->deleteLater();
-    groups->deleteLater();
+    config->deleteLater();
     model->deleteLater();
 
-    server->close();
-    server->deleteLater();
+    if (server) {
+        server->close();
+        server->deleteLater();
+    }
 
     delete ui;
 }
 
 void MainWindow::writeLog(const QString& log) {
-    if(model->insertRow(model->rowCount())) {
-        QModelIndex index = model->index(model->rowCount() - 1, 0);
-        model->setData(index, log);
-        ui->listView->setCurrentIndex(model->index(model->rowCount() - 1));
+    logger->log(Logger::Info, -1, QString(), QString(), -1, log);
+}
+
+void MainWindow::writeLog(Connection *sender, const QString &op, const QString &result, Logger::Level level) {
+    if (!logger->isEnabled(level)) {
+        return;
     }
+
+    logger->log(level, sender->descriptor(), clients.value(sender).second, op, metrics->requestElapsed(sender), result);
+}
+
+void MainWindow::refreshLog() {
+    QStringList lines = logger->tail(logSequence);
+    if (lines.isEmpty()) {
+        return;
+    }
+
+    // The view holds the same bounded tail as the logger, not the whole history.
+    QStringList rows = model->stringList() + lines;
+    int limit = config->value("log/tailLines", Logger::DefaultTailLines).toInt();
+    if (rows.size() > limit) {
+        rows.erase(rows.begin(), rows.begin() + (rows.size() - limit));
+    }
+    model->setStringList(rows);
+    ui->listView->scrollToBottom();
 }
 
 void MainWindow::newClientConnection() {
     while (server->hasPendingConnections()) {
         QTcpSocket* socket = server->nextPendingConnection();
-        QPair<qint64, QString> pair;
-        pair.first = socket->socketDescriptor();
-        pair.second = QString();
-        clients.insert(socket, pair);
-        connect(socket, &QTcpSocket::readyRead, this, &MainWindow::onClientReadyRead);
-        connect(socket, &QTcpSocket::disconnected, this, &MainWindow::onClientDisconnected);
         connect(socket, &QAbstractSocket::errorOccurred, this, &MainWindow::onErrorOccurred);
-        writeLog(QString("Client(%1) has just connected").arg(socket->socketDescriptor()));
+        addClient(new TcpConnection(socket, storage, this));
     }
 }
 
-void MainWindow::onClientDisconnected() {
-    QTcpSocket* socket = reinterpret_cast<QTcpSocket*>(sender());
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator it = clients.find(socket);
+void MainWindow::addClient(Connection* connection) {
+    qint64 lowWatermark = config->value("connection/lowWatermark", Connection::DefaultLowWatermark).toLongLong();
+    qint64 highWatermark = config->value("connection/highWatermark", Connection::DefaultHighWatermark).toLongLong();
+    connection->setWatermarks(lowWatermark, highWatermark);
+
+    if (maxConnections > 0 && clients.size() >= maxConnections) {
+        // Kept long enough to tell the client when to come back.
+        overCapacity.insert(connection);
+    }
+
+    QPair<qint64, QString> pair;
+    pair.first = connection->descriptor();
+    pair.second = QString();
+    clients.insert(connection, pair);
+    metrics->connectionOpened(connection);
+    connect(connection, &Connection::messageReceived, this, &MainWindow::handleMessage);
+    connect(connection, &Connection::uploadStarted, this, &MainWindow::onUploadStarted);
+    connect(connection, &Connection::uploadReceived, this, &MainWindow::processUploadData);
+    connect(connection, &Connection::uploadFinished, this, &MainWindow::processUploadFinished);
+    connect(connection, &Connection::disconnected, this, &MainWindow::onClientDisconnected);
+    idleWheel->add(connection);
+    writeLog(connection, "connect", "Client has just connected");
+}
+
+void MainWindow::onClientDisconnected(Connection* connection) {
+    QMap<Connection*, QPair<qint64, QString>>::iterator it = clients.find(connection);
     if (it != clients.end()) {
-        writeLog(QString("Client(%1) has just disconnected").arg(it.value().first));
+        writeLog(connection, "disconnect", "Client has just disconnected");
         clients.erase(it);
     }
+    if (replicas.remove(connection) > 0) {
+        writeLog(QString("Replication: replica %1 disconnected").arg(connection->descriptor()));
+    }
+    clusterConnections.remove(connection);
+    idleWheel->remove(connection);
+    overCapacity.remove(connection);
+    heavyRequests.remove(connection);
+    bytesCharged.remove(connection);
+    refusedUntil.remove(connection);
+    rateLimiter->forget(RateLimiter::PerConnection, QString::number(quintptr(connection), 16));
+    metrics->connectionClosed(connection);
+    tracer->discard(connection);
 
-    socket->deleteLater();
-}
-
-void MainWindow::onErrorOccurred(QAbstractSocket::SocketError error) {
-    switch (error) {
-        case QAbstractSocket::RemoteHostClosedError:
-            break;
-
-        case QAbstractSocket::HostNotFoundError:
-            QMessageBox::information(this, "QTcpServer", "The host was not found.");
-            break;
+    // An upload cut short only leaves its staging file behind.
+    QSharedPointer<QFile> file = connection->uploadFile();
+    if (file) {
+        storage->remove(file->fileName(), nullptr, nullptr);
+    }
 
-        case QAbstractSocket::ConnectionRefusedError:
-            QMessageBox::information(this, "QTcpServer", "The connection was refused by the peer.");
-            break;
+    connection->deleteLater();
+}
 
-        default:
-            QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
-            QMessageBox::information(this, "QTcpServer", QString("The following error occurred: %1.").arg(socket->errorString()));
-            break;
+qint64 MainWindow::connectionDeadline(Connection* connection) const {
+    if (!connection->hasRequested()) {
+        return connection->connectedAt() + handshakeTimeout;
+    }
+    if (connection->isBusy()) {
+        return Connection::now() + idleTimeout;
     }
+    return connection->lastActivity() + idleTimeout;
 }
 
-void MainWindow::onClientReadyRead() {
-    QTcpSocket* socket = reinterpret_cast<QTcpSocket*>(sender());
-
-    QByteArray buffer;
-
-    QDataStream socketStream(socket);
-    socketStream.setVersion(QDataStream::Qt_5_15);
+void MainWindow::onConnectionExpired(Connection* connection) {
+    if (!clients.contains(connection)) {
+        return;
+    }
 
-    socketStream.startTransaction();
-    socketStream >> buffer;
+    connectionsReaped++;
+    QString msg = connection->hasRequested() ? QString("Idle for %1 ms").arg(Connection::now() - connection->lastActivity())
+                                             : QString("No request within %1 ms").arg(handshakeTimeout);
+    writeLog(connection, "timeout", msg, Logger::Warning);
+    connection->abort();
+}
 
-    if(!socketStream.commitTransaction()) {
-        QString message = QString("%1::Waiting for more data to come..").arg(socket->socketDescriptor());
-        qDebug() << message;
+void MainWindow::onErrorOccurred(QAbstractSocket::SocketError error) {
+    if (error == QAbstractSocket::RemoteHostClosedError) {
         return;
     }
 
-    handleMessage(socket, buffer);
+    // One client's socket failing is no reason to stop the server on a dialog.
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    Connection* connection = socket ? qobject_cast<Connection*>(socket->parent()) : nullptr;
+    if (!connection) {
+        return;
+    }
+    writeLog(connection, "socket", socket->errorString(), Logger::Warning);
 }
 
-void MainWindow::handleMessage(QTcpSocket* sender, QByteArray bytes) {
+void MainWindow::handleMessage(Connection* sender, QByteArray bytes) {
     int request = bytes.mid(0, 8).toInt();
     bytes = bytes.mid(8);
+    startRequest(sender, request);
+
+    if (throttle(sender, request) || redirectWrite(sender, request) || redirectGroup(sender, request, bytes)) {
+        return;
+    }
 
     switch (request) {
         case RequestNone:
-            writeLog(QString("%1> RequestNone(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestNone", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             break;
 
         case RequestSignIn:
-            writeLog(QString("%1> RequestSignIn(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestSignIn", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processSignIn(sender, bytes);
             break;
 
         case RequestSignUp:
-            writeLog(QString("%1> RequestSignUp(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestSignUp", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processSignUp(sender, bytes);
             break;
 
         case RequestSignOut:
-            writeLog(QString("%1> RequestSignOut(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestSignOut", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processSignOut(sender, bytes);
             break;
 
         case RequestGet:
-            writeLog(QString("%1> RequestGet(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestGet", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processGet(sender, bytes);
             break;
 
         case RequestCreateGroup:
-            writeLog(QString("%1> RequestCreateGroup(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestCreateGroup", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processCreateGroup(sender, bytes);
             break;
 
         case RequestJoinGroup:
-            writeLog(QString("%1> RequestJoinGroup(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestJoinGroup", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processJoinGroup(sender, bytes);
             break;
 
         case RequestCreateFolder:
-            writeLog(QString("%1> RequestCreateFolder(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestCreateFolder", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processCreateFolder(sender, bytes);
             break;
 
         case RequestUploadFile:
-            writeLog(QString("%1> RequestUploadFile(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
-            processUploadFile(sender, bytes);
+            processUploadFile(sender, bytes, 0);
+            processUploadFinished(sender);
             break;
 
         case RequestDownloadFile:
-            writeLog(QString("%1> RequestDownloadFile(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestDownloadFile", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processDownloadFile(sender, bytes);
             break;
 
         case RequestDelete:
-            writeLog(QString("%1> RequestDelete(%2)").arg(sender->socketDescriptor()).arg(bytes.size()));
+            writeLog(sender, "RequestDelete", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
             processDelete(sender, bytes);
             break;
 
+        case RequestStats:
+            writeLog(sender, "RequestStats", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processStats(sender, bytes);
+            break;
+
+        case RequestDownloadRange:
+            writeLog(sender, "RequestDownloadRange", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processDownloadRange(sender, bytes);
+            break;
+
+        case RequestUploadRange:
+            writeLog(sender, "RequestUploadRange", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processUploadRange(sender, bytes);
+            break;
+
+        case RequestUploadCancel:
+            writeLog(sender, "RequestUploadCancel", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processUploadCancel(sender, bytes);
+            break;
+
+        case RequestUploadHash:
+            writeLog(sender, "RequestUploadHash", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processUploadHash(sender, bytes);
+            break;
+
+        case RequestReplicate:
+            writeLog(sender, "RequestReplicate", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processReplicate(sender, bytes);
+            break;
+
+        case RequestClusterUsers:
+            writeLog(sender, "RequestClusterUsers", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processClusterUsers(sender, bytes);
+            break;
+
+        case RequestClusterGroup:
+            writeLog(sender, "RequestClusterGroup", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processClusterGroup(sender, bytes);
+            break;
+
+        case RequestClusterTransfer:
+            writeLog(sender, "RequestClusterTransfer", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processClusterTransfer(sender, bytes);
+            break;
+
+        case RequestPing:
+            processPing(sender, bytes);
+            break;
+
+        case RequestSearch:
+            writeLog(sender, "RequestSearch", QString("%1 bytes").arg(bytes.size()), Logger::Debug);
+            processSearch(sender, bytes);
+            break;
+
         default:
-            writeLog(QString("%1> Invalid request (%2): %3").arg(sender->socketDescriptor()).arg(request).arg(bytes.size()));
+            writeLog(sender, "InvalidRequest", QString("%1, %2 bytes").arg(request).arg(bytes.size()), Logger::Warning);
             break;
     }
 }
 
-void MainWindow::processSignIn(QTcpSocket *sender, QByteArray bytes) {
+void MainWindow::processSignIn(Connection *sender, QByteArray bytes) {
     QByteArray errorCode = QByteArray::number(ResponseSignInError);
     errorCode.resize(8);
     QByteArray successCode = QByteArray::number(ResponseSignInSuccess);
@@ -218,7 +553,7 @@ void MainWindow::processSignIn(QTcpSocket *sender, QByteArray bytes) {
     QStringList list = dataStr.split(";");
     if (list.size() < 2 || list[0].isEmpty() || list[1].isEmpty()) {
         QString msg = "Invalid data";
-        writeLog(QString("%1> processSignIn: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processSignIn", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -228,7 +563,7 @@ void MainWindow::processSignIn(QTcpSocket *sender, QByteArray bytes) {
 
     if (!users->allKeys().contains(list[0], Qt::CaseInsensitive)) {
         QString msg = list[0] + " doesn't exist";
-        writeLog(QString("%1> processSignIn: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processSignIn", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -238,7 +573,7 @@ void MainWindow::processSignIn(QTcpSocket *sender, QByteArray bytes) {
 
     if (QString::compare(list[1], users->value(list[0], QString()).toString()) != 0) {
         QString msg = list[0] + "The password is incorrect";
-        writeLog(QString("%1> processSignIn: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processSignIn", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -246,12 +581,21 @@ void MainWindow::processSignIn(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QMapIterator<QTcpSocket*, QPair<qint64, QString>> iter(clients);
+    // A connection that has missed its heartbeats is most likely half-open: the
+    // client went away without the server noticing, and is now back.
+    QList<Connection*> stale;
+    QMapIterator<Connection*, QPair<qint64, QString>> iter(clients);
     while(iter.hasNext()) {
         iter.next();
         if (QString::compare(list[0], iter.value().second) == 0) {
+            Connection* previous = iter.key();
+            if (previous != sender && !previous->isBusy() && Connection::now() - previous->lastActivity() > heartbeatInterval) {
+                stale.append(previous);
+                continue;
+            }
+
             QString msg = list[0] + " already signed in";
-            writeLog(QString("%1> processSignIn: %2").arg(sender->socketDescriptor()).arg(msg));
+            writeLog(sender, "processSignIn", msg, Logger::Warning);
 
             QByteArray byteArray = msg.toUtf8();
             byteArray.prepend(errorCode);
@@ -260,20 +604,27 @@ void MainWindow::processSignIn(QTcpSocket *sender, QByteArray bytes) {
         }
     }
 
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator it = clients.find(sender);
+    foreach (Connection* previous, stale) {
+        writeLog(previous, "processSignIn", list[0] + " signed in again, closing the silent connection", Logger::Warning);
+        clients[previous].second.clear();
+        previous->abort();
+    }
+
+    QMap<Connection*, QPair<qint64, QString>>::iterator it = clients.find(sender);
     if (it != clients.end()) {
         it.value().second = list[0];
     }
 
-    QString msg = "SignIn success";
+    // Cluster nodes name themselves, so clients recognize the node behind any address they used.
+    QString msg = clusterSelf.isEmpty() ? "SignIn success" : "SignIn success;" + clusterSelf;
     QByteArray byteArray = msg.toUtf8();
     byteArray.prepend(successCode);
     sendResponse(sender, byteArray);
 
-    writeLog(QString("%1> processSignIn: %2").arg(sender->socketDescriptor()).arg("Success!"));
+    writeLog(sender, "processSignIn", "Success!");
 }
 
-void MainWindow::processSignUp(QTcpSocket *sender, QByteArray bytes) {
+void MainWindow::processSignUp(Connection *sender, QByteArray bytes) {
     QByteArray errorCode = QByteArray::number(ResponseSignUpError);
     errorCode.resize(8);
     QByteArray successCode = QByteArray::number(ResponseSignUpSuccess);
@@ -283,7 +634,7 @@ void MainWindow::processSignUp(QTcpSocket *sender, QByteArray bytes) {
     QStringList list = dataStr.split(";");
     if (list.size() < 2 || list[0].isEmpty() || list[1].isEmpty()) {
         QString msg = "Invalid data";
-        writeLog(QString("%1> processSignUp: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processSignUp", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -293,7 +644,7 @@ void MainWindow::processSignUp(QTcpSocket *sender, QByteArray bytes) {
 
     if (users->allKeys().contains(list[0], Qt::CaseInsensitive)) {
         QString msg = list[0] + " already exist";
-        writeLog(QString("%1> processSignUp: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processSignUp", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -302,20 +653,28 @@ void MainWindow::processSignUp(QTcpSocket *sender, QByteArray bytes) {
     }
 
     users->setValue(list[0], list[1]);
+    replicate(QJsonObject({{"type", "user"}, {"name", list[0]}, {"value", list[1]}}));
+    pushUsers(QJsonObject({{list[0], list[1]}}));
+
+    // The account is only confirmed once the journal has it on disk.
+    QString name = list[0];
+    sender->pauseReading();
+    metadata->whenDurable(sender, [this, sender, name, successCode]() {
+        QString msg = "SignUp success";
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(successCode);
+        sendResponse(sender, byteArray);
+        sender->resumeReading();
 
-    QString msg = "SignUp success";
-    QByteArray byteArray = msg.toUtf8();
-    byteArray.prepend(successCode);
-    sendResponse(sender, byteArray);
-
-    writeLog(QString("%1> processSignUp: (%2, %3) %4").arg(sender->socketDescriptor()).arg(list[0], list[1], "Success!"));
+        writeLog(sender, "processSignUp", QString("%1 Success!").arg(name));
+    });
 }
 
-void MainWindow::processSignOut(QTcpSocket *sender, QByteArray bytes) {
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator it = clients.find(sender);
+void MainWindow::processSignOut(Connection *sender, QByteArray bytes) {
+    QMap<Connection*, QPair<qint64, QString>>::iterator it = clients.find(sender);
     if (it == clients.end()) {
         QString msg = "An error occurred";
-        writeLog(QString("%1> processSignOut: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processSignOut", msg, Logger::Warning);
 
         QByteArray errorCode = QByteArray::number(ResponseSignOutError);
         errorCode.resize(8);
@@ -334,19 +693,19 @@ void MainWindow::processSignOut(QTcpSocket *sender, QByteArray bytes) {
     byteArray.prepend(typeArray);
     sendResponse(sender, byteArray);
 
-    writeLog(QString("%1> processSignOut: %2").arg(sender->socketDescriptor()).arg("Success!"));
+    writeLog(sender, "processSignOut", "Success!");
 }
 
-void MainWindow::processGet(QTcpSocket *sender, QByteArray bytes) {
+void MainWindow::processGet(Connection *sender, QByteArray bytes) {
     QByteArray successCode = QByteArray::number(ResponseGetSuccess);
     successCode.resize(8);
     QByteArray errorCode = QByteArray::number(ResponseGetError);
     errorCode.resize(8);
 
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
+    QMap<Connection*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
     if (iter == clients.end()) {
         QString msg = "An error occurred";
-        writeLog(QString("%1> processGet: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processGet", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -357,7 +716,7 @@ void MainWindow::processGet(QTcpSocket *sender, QByteArray bytes) {
     QString user = iter.value().second;
     if (user.isEmpty()) {
         QString msg = "You are not signed in";
-        writeLog(QString("%1> processCreateGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -365,44 +724,31 @@ void MainWindow::processGet(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QJsonArray array;
-    foreach (const QString& key, groupMembers.keys()) {
-        if (groupMembers.value(key)->allKeys().contains(user, Qt::CaseInsensitive)) {
-            QString leader;
-            if (groupMembers.value(key)->value(user).toString().compare("1") == 0) {
-                leader = user;
-            }
-            array.push_back(getData(QString("data") + QDir::separator() + key, leader));
+    // "user;tag" asks for the tree only if the user's view has changed since tag.
+    if (bytes.contains(';')) {
+        QByteArray knownTag = bytes.mid(bytes.indexOf(';') + 1);
+        QByteArray tag = FileTree::tag(serverEpoch, FileTree::roots(groupMembers, user, dataRoots), groupVersions).toLatin1();
+        if (knownTag == tag) {
+            QByteArray notModifiedCode = QByteArray::number(ResponseGetNotModified);
+            notModifiedCode.resize(8);
+            sendResponse(sender, notModifiedCode + tag);
+            return;
         }
     }
 
-    QJsonObject data;
-    data.insert("name", "");
-    data.insert("path", "");
-    data.insert("type", "root");
-    data.insert("children", array);
-
-    QJsonDocument jsonDocument;
-    jsonDocument.setObject(data);
-
-    QString responseMessage = jsonDocument.toJson(QJsonDocument::Compact);
-
-    QByteArray responseData = responseMessage.toUtf8();
-    responseData.prepend(successCode);
-
-    sendResponse(sender, responseData);
+    sendTree(sender, user, successCode);
 }
 
-void MainWindow::processCreateGroup(QTcpSocket *sender, QByteArray bytes) {
+void MainWindow::processCreateGroup(Connection *sender, QByteArray bytes) {
     QByteArray successCode = QByteArray::number(ResponseCreateGroupSuccess);
     successCode.resize(8);
     QByteArray errorCode = QByteArray::number(ResponseCreateGroupError);
     errorCode.resize(8);
 
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
+    QMap<Connection*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
     if (iter == clients.end()) {
         QString msg = "An error occurred";
-        writeLog(QString("%1> processCreateGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -413,7 +759,7 @@ void MainWindow::processCreateGroup(QTcpSocket *sender, QByteArray bytes) {
     QString user = iter.value().second;
     if (user.isEmpty()) {
         QString msg = "You are not signed in";
-        writeLog(QString("%1> processCreateGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -422,9 +768,9 @@ void MainWindow::processCreateGroup(QTcpSocket *sender, QByteArray bytes) {
     }
 
     QString groupName = bytes;
-    if (!isValidGroupName(groupName)) {
+    if (!FileTree::isValidGroupName(groupName)) {
         QString msg = "Group name is invalid";
-        writeLog(QString("%1> processCreateGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -434,7 +780,7 @@ void MainWindow::processCreateGroup(QTcpSocket *sender, QByteArray bytes) {
 
     if (groups->allKeys().contains(groupName, Qt::CaseInsensitive)) {
         QString msg = groupName + " already exist";
-        writeLog(QString("%1> processCreateGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -442,58 +788,49 @@ void MainWindow::processCreateGroup(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QDir dir(QString("data") + QDir::separator() + groupName);
-    if (dir.exists()) {
-        dir.removeRecursively();
-    }
-    QDir().mkdir(QString("data") + QDir::separator() + groupName);
-
+    // The group, its owner and its placement reach the journal as one record.
+    metadata->startTransaction();
     groups->setValue(groupName, user);
-    groupMembers.insert(groupName, new QSettings("database\\" + groupName + ".group", QSettings::IniFormat));
-    QSettings* members = groupMembers.value(groupName);
+    groupMembers.insert(groupName, metadata->table("members/" + groupName));
+    MetadataTable* members = groupMembers.value(groupName);
     members->clear();
     members->setValue(user, "1");
-
-    QJsonArray array;
-    foreach (const QString& key, groupMembers.keys()) {
-        if (groupMembers.value(key)->allKeys().contains(user, Qt::CaseInsensitive)) {
-            QString leader;
-            if (groupMembers.value(key)->value(user).toString().compare("1") == 0) {
-                leader = user;
-            }
-            array.push_back(getData(QString("data") + QDir::separator() + key, leader));
+    QString path = dataRoots->place(groupName) + QDir::separator() + groupName;
+    metadata->commitTransaction();
+    replicate(QJsonObject({{"type", "group"}, {"name", groupName}, {"owner", user}}));
+    replicate(QJsonObject({{"type", "member"}, {"group", groupName}, {"user", user}, {"role", "1"}}));
+
+    tracer->mark(sender, "handler");
+    sender->pauseReading();
+    ioPool->run([path]() {
+        QDir dir(path);
+        if (dir.exists()) {
+            dir.removeRecursively();
         }
-    }
-
-    QJsonObject data;
-    data.insert("name", "");
-    data.insert("path", "");
-    data.insert("type", "root");
-    data.insert("children", array);
-
-    QJsonDocument jsonDocument;
-    jsonDocument.setObject(data);
-
-    QString responseMessage = jsonDocument.toJson(QJsonDocument::Compact);
-
-    QByteArray responseData = responseMessage.toUtf8();
-    responseData.prepend(successCode);
-
-    sendResponse(sender, responseData);
-
-    writeLog(QString("%1> processCreateGroup: %2").arg(sender->socketDescriptor()).arg("Success!"));
+        QDir().mkdir(path);
+    }, sender, [this, sender, user, path, successCode]() {
+        tracer->mark(sender, "mkdir");
+        nameIndex->add(path, true);
+        metadata->whenDurable(sender, [this, sender, user, successCode]() {
+            tracer->mark(sender, "journal");
+            sendTree(sender, user, successCode);
+            sender->resumeReading();
+
+            writeLog(sender, "processCreateGroup", "Success!");
+        });
+    });
 }
 
-void MainWindow::processJoinGroup(QTcpSocket *sender, QByteArray bytes) {
+void MainWindow::processJoinGroup(Connection *sender, QByteArray bytes) {
     QByteArray successCode = QByteArray::number(ResponseJoinGroupSuccess);
     successCode.resize(8);
     QByteArray errorCode = QByteArray::number(ResponseJoinGroupError);
     errorCode.resize(8);
 
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
+    QMap<Connection*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
     if (iter == clients.end()) {
         QString msg = "An error occurred";
-        writeLog(QString("%1> processJoinGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processJoinGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -504,7 +841,7 @@ void MainWindow::processJoinGroup(QTcpSocket *sender, QByteArray bytes) {
     QString user = iter.value().second;
     if (user.isEmpty()) {
         QString msg = "You are not signed in";
-        writeLog(QString("%1> processJoinGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processJoinGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -515,7 +852,7 @@ void MainWindow::processJoinGroup(QTcpSocket *sender, QByteArray bytes) {
     QString groupName = bytes;
     if (!groups->allKeys().contains(groupName, Qt::CaseInsensitive)) {
         QString msg = groupName + " not exist";
-        writeLog(QString("%1> processJoinGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processJoinGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -523,10 +860,10 @@ void MainWindow::processJoinGroup(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QSettings* members = groupMembers.value(groupName);
+    MetadataTable* members = groupMembers.value(groupName);
     if (members->allKeys().contains(user, Qt::CaseInsensitive)) {
         QString msg = groupName + " already in group";
-        writeLog(QString("%1> processJoinGroup: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processJoinGroup", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -535,47 +872,27 @@ void MainWindow::processJoinGroup(QTcpSocket *sender, QByteArray bytes) {
     }
 
     members->setValue(user, "0");
+    replicate(QJsonObject({{"type", "member"}, {"group", groupName}, {"user", user}, {"role", "0"}}));
 
-    QJsonArray array;
-    foreach (const QString& key, groupMembers.keys()) {
-        if (groupMembers.value(key)->allKeys().contains(user, Qt::CaseInsensitive)) {
-            QString leader;
-            if (groupMembers.value(key)->value(user).toString().compare("1") == 0) {
-                leader = user;
-            }
-            array.push_back(getData(QString("data") + QDir::separator() + key, leader));
-        }
-    }
-
-    QJsonObject data;
-    data.insert("name", "");
-    data.insert("path", "");
-    data.insert("type", "root");
-    data.insert("children", array);
-
-    QJsonDocument jsonDocument;
-    jsonDocument.setObject(data);
+    sender->pauseReading();
+    metadata->whenDurable(sender, [this, sender, user, successCode]() {
+        sendTree(sender, user, successCode);
+        sender->resumeReading();
 
-    QString responseMessage = jsonDocument.toJson(QJsonDocument::Compact);
-
-    QByteArray responseData = responseMessage.toUtf8();
-    responseData.prepend(successCode);
-
-    sendResponse(sender, responseData);
-
-    writeLog(QString("%1> processJoinGroup: %2").arg(sender->socketDescriptor()).arg("Success!"));
+        writeLog(sender, "processJoinGroup", "Success!");
+    });
 }
 
-void MainWindow::processCreateFolder(QTcpSocket *sender, QByteArray bytes) {
+void MainWindow::processCreateFolder(Connection *sender, QByteArray bytes) {
     QByteArray successCode = QByteArray::number(ResponseCreateFolderSuccess);
     successCode.resize(8);
     QByteArray errorCode = QByteArray::number(ResponseCreateFolderError);
     errorCode.resize(8);
 
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
+    QMap<Connection*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
     if (iter == clients.end()) {
         QString msg = "An error occurred";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -586,7 +903,7 @@ void MainWindow::processCreateFolder(QTcpSocket *sender, QByteArray bytes) {
     QString user = iter.value().second;
     if (user.isEmpty()) {
         QString msg = "You are not signed in";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -597,7 +914,7 @@ void MainWindow::processCreateFolder(QTcpSocket *sender, QByteArray bytes) {
     QString folderPath = bytes;
     if (!folderPath.contains(QDir::separator())) {
         QString msg = "Invalid folder path";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -609,7 +926,7 @@ void MainWindow::processCreateFolder(QTcpSocket *sender, QByteArray bytes) {
     QString groupName = folderPath.left(folderPath.indexOf(QDir::separator()));
     if (!groups->allKeys().contains(groupName, Qt::CaseInsensitive)) {
         QString msg = groupName + " not exist";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -617,10 +934,10 @@ void MainWindow::processCreateFolder(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QSettings* members = groupMembers.value(groupName);
+    MetadataTable* members = groupMembers.value(groupName);
     if (!members->allKeys().contains(user, Qt::CaseInsensitive)) {
         QString msg = "Access denied";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -628,20 +945,20 @@ void MainWindow::processCreateFolder(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QDir dir(QString("data") + QDir::separator() + folderPath);
-    if (dir.exists()) {
-        QString msg = "Folder already exists";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+    QString moving = checkMoving(folderPath);
+    if (!moving.isEmpty()) {
+        writeLog(sender, "processCreateFolder", moving, Logger::Warning);
 
-        QByteArray byteArray = msg.toUtf8();
+        QByteArray byteArray = moving.toUtf8();
         byteArray.prepend(errorCode);
         sendResponse(sender, byteArray);
         return;
     }
 
-    if (!QDir().mkpath(dir.absolutePath())) {
-        QString msg = "Cannot create folder";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+    QDir dir(dataRoots->path(folderPath));
+    if (dir.exists()) {
+        QString msg = "Folder already exists";
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -649,46 +966,55 @@ void MainWindow::processCreateFolder(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QJsonArray array;
-    foreach (const QString& key, groupMembers.keys()) {
-        if (groupMembers.value(key)->allKeys().contains(user, Qt::CaseInsensitive)) {
-            QString leader;
-            if (groupMembers.value(key)->value(user).toString().compare("1") == 0) {
-                leader = user;
-            }
-            array.push_back(getData(QString("data") + QDir::separator() + key, leader));
-        }
-    }
-
-    QJsonObject data;
-    data.insert("name", "");
-    data.insert("path", "");
-    data.insert("type", "root");
-    data.insert("children", array);
+    QString path = dir.absolutePath();
+    QSharedPointer<bool> created(new bool(false));
+    tracer->mark(sender, "handler");
+    sender->pauseReading();
+    ioPool->run([path, created]() {
+        *created = QDir().mkpath(path);
+    }, sender, [this, sender, user, folderPath, path, successCode, errorCode, created]() {
+        tracer->mark(sender, "mkdir");
+        if (!*created) {
+            QString msg = "Cannot create folder";
+            writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
-    QJsonDocument jsonDocument;
-    jsonDocument.setObject(data);
+            QByteArray byteArray = msg.toUtf8();
+            byteArray.prepend(errorCode);
+            sendResponse(sender, byteArray);
+        } else {
+            touchGroup(path);
+            nameIndex->add(path, true);
+            replicate(QJsonObject({{"type", "folder"}, {"path", folderPath}}));
+            sendTree(sender, user, successCode);
 
-    QString responseMessage = jsonDocument.toJson(QJsonDocument::Compact);
+            writeLog(sender, "processCreateFolder", "Success!");
+        }
+        sender->resumeReading();
+    });
+}
 
-    QByteArray responseData = responseMessage.toUtf8();
-    responseData.prepend(successCode);
+void MainWindow::onUploadStarted(Connection *sender, QByteArray bytes, qint64 size) {
+    // A frame too short to stream arrives through handleMessage, which already traced and metered it.
+    startRequest(sender, RequestUploadFile);
 
-    sendResponse(sender, responseData);
+    // The body that follows is dropped, as for any other rejected upload.
+    if (throttle(sender, RequestUploadFile) || redirectWrite(sender, RequestUploadFile) || redirectGroup(sender, RequestUploadFile, bytes)) {
+        return;
+    }
 
-    writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg("Success!"));
+    processUploadFile(sender, bytes, size);
 }
 
-void MainWindow::processUploadFile(QTcpSocket *sender, QByteArray bytes) {
-    QByteArray successCode = QByteArray::number(ResponseUploadFileSuccess);
-    successCode.resize(8);
+void MainWindow::processUploadFile(Connection *sender, QByteArray bytes, qint64 size) {
+    writeLog(sender, "RequestUploadFile", QString("%1 bytes").arg(size), Logger::Debug);
+
     QByteArray errorCode = QByteArray::number(ResponseUploadFileError);
     errorCode.resize(8);
 
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
+    QMap<Connection*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
     if (iter == clients.end()) {
         QString msg = "An error occurred";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -699,7 +1025,7 @@ void MainWindow::processUploadFile(QTcpSocket *sender, QByteArray bytes) {
     QString user = iter.value().second;
     if (user.isEmpty()) {
         QString msg = "You are not signed in";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -708,11 +1034,10 @@ void MainWindow::processUploadFile(QTcpSocket *sender, QByteArray bytes) {
     }
 
     QString filePath = bytes.mid(0, 256);
-    bytes = bytes.mid(256);
 
     if (!filePath.contains(QDir::separator())) {
         QString msg = "Invalid folder path";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -724,7 +1049,7 @@ void MainWindow::processUploadFile(QTcpSocket *sender, QByteArray bytes) {
     QString groupName = filePath.left(filePath.indexOf(QDir::separator()));
     if (!groups->allKeys().contains(groupName, Qt::CaseInsensitive)) {
         QString msg = groupName + " not exist";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -732,10 +1057,10 @@ void MainWindow::processUploadFile(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QSettings* members = groupMembers.value(groupName);
+    MetadataTable* members = groupMembers.value(groupName);
     if (!members->allKeys().contains(user, Qt::CaseInsensitive)) {
         QString msg = "Access denied";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -743,10 +1068,30 @@ void MainWindow::processUploadFile(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QFileInfo info(QString("data") + QDir::separator() + filePath);
+    QString moving = checkMoving(filePath);
+    if (!moving.isEmpty()) {
+        writeLog(sender, "processUploadFile", moving, Logger::Warning);
+
+        QByteArray byteArray = moving.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QString tooLarge = checkUploadSize(filePath, size);
+    if (!tooLarge.isEmpty()) {
+        writeLog(sender, "processUploadFile", tooLarge, Logger::Warning);
+
+        QByteArray byteArray = tooLarge.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QFileInfo info(dataRoots->path(filePath));
     if (info.exists()) {
         QString msg = "File already exists";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -754,60 +1099,113 @@ void MainWindow::processUploadFile(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QFile file = info.filePath();
-    if (file.open(QIODevice::WriteOnly)) {
-        file.write(bytes);
+    // Nothing appears under the file's name until the upload is complete.
+    QSharedPointer<QFile> file(new QFile(stagingPath(filePath, QString::number(QRandomGenerator::global()->generate64(), 16))));
+    sender->setUploadFile(file, info.filePath());
+    tracer->mark(sender, "handler");
+    sender->pauseReading();
+    openStaging(file, QIODevice::WriteOnly, size, sender, [this, sender, file](bool opened) {
+        tracer->mark(sender, "open");
+        if (!opened) {
+            failUpload(sender, file);
+        }
+        sender->resumeReading();
+    });
+}
+
+void MainWindow::processUploadData(Connection *sender, QByteArray bytes) {
+    QSharedPointer<QFile> file = sender->uploadFile();
+    if (!file) {
+        return;
+    }
 
-        QJsonArray array;
-        foreach (const QString& key, groupMembers.keys()) {
-            if (groupMembers.value(key)->allKeys().contains(user, Qt::CaseInsensitive)) {
-                QString leader;
-                if (groupMembers.value(key)->value(user).toString().compare("1") == 0) {
-                    leader = user;
-                }
-                array.push_back(getData(QString("data") + QDir::separator() + key, leader));
-            }
+    qint64 size = bytes.size();
+    qint64 offset = sender->reserveUpload(size);
+    storage->write(file, offset, bytes, sender, [this, sender, file, size](bool written) {
+        sender->removeUploadPending(size);
+        if (!written) {
+            failUpload(sender, file);
+        }
+    });
+}
+
+void MainWindow::processUploadFinished(Connection *sender) {
+    QSharedPointer<QFile> file = sender->uploadFile();
+    if (!file) {
+        return;
+    }
+
+    tracer->mark(sender, "receive");
+    sender->pauseReading();
+    QString target = sender->uploadTarget();
+    storage->commit(file, target, sender, [this, sender, file, target](bool committed) {
+        tracer->mark(sender, "commit");
+        if (sender->uploadFile() != file) {
+            // A write failed in the meantime and the error has already been reported.
+            sender->resumeReading();
+            return;
         }
+        sender->setUploadFile(QSharedPointer<QFile>());
 
-        QJsonObject data;
-        data.insert("name", "");
-        data.insert("path", "");
-        data.insert("type", "root");
-        data.insert("children", array);
+        if (!committed) {
+            storage->remove(file->fileName(), nullptr, nullptr);
 
-        QJsonDocument jsonDocument;
-        jsonDocument.setObject(data);
+            QString msg = "An error occurred while trying to write the file";
 
-        QString responseMessage = jsonDocument.toJson(QJsonDocument::Compact);
+            QByteArray errorCode = QByteArray::number(ResponseUploadFileError);
+            errorCode.resize(8);
+            QByteArray byteArray = msg.toUtf8();
+            byteArray.prepend(errorCode);
+            sendResponse(sender, byteArray);
 
-        QByteArray responseData = responseMessage.toUtf8();
-        responseData.prepend(successCode);
+            writeLog(sender, "processUploadFile", msg, Logger::Warning);
+        } else {
+            QByteArray successCode = QByteArray::number(ResponseUploadFileSuccess);
+            successCode.resize(8);
 
-        sendResponse(sender, responseData);
+            QString user = clients.value(sender).second;
 
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg("Success!"));
-    } else {
-        QString msg = "An error occurred while trying to write the file";
+            touchGroup(target);
+            contentIndex->index(target);
+            nameIndex->add(target, false);
+            replicate(QJsonObject({{"type", "file"}, {"path", QDir::toNativeSeparators(dataRoots->relative(target))}}));
+            sendTree(sender, user, successCode);
 
-        QByteArray byteArray = msg.toUtf8();
-        byteArray.prepend(errorCode);
-        sendResponse(sender, byteArray);
+            writeLog(sender, "processUploadFile", "Success!");
+        }
+        sender->resumeReading();
+    });
+}
 
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+void MainWindow::failUpload(Connection *sender, QSharedPointer<QFile> file) {
+    if (sender->uploadFile() != file) {
         return;
     }
+    sender->setUploadFile(QSharedPointer<QFile>());
+
+    storage->remove(file->fileName(), nullptr, nullptr);
+
+    QString msg = "An error occurred while trying to write the file";
+
+    QByteArray errorCode = QByteArray::number(ResponseUploadFileError);
+    errorCode.resize(8);
+    QByteArray byteArray = msg.toUtf8();
+    byteArray.prepend(errorCode);
+    sendResponse(sender, byteArray);
+
+    writeLog(sender, "processUploadFile", msg, Logger::Warning);
 }
 
-void MainWindow::processDownloadFile(QTcpSocket *sender, QByteArray bytes) {
+void MainWindow::processDownloadFile(Connection *sender, QByteArray bytes) {
     QByteArray successCode = QByteArray::number(ResponseDownloadFileSuccess);
     successCode.resize(8);
     QByteArray errorCode = QByteArray::number(ResponseDownloadFileError);
     errorCode.resize(8);
 
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
+    QMap<Connection*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
     if (iter == clients.end()) {
         QString msg = "An error occurred";
-        writeLog(QString("%1> processDownloadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processDownloadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -818,7 +1216,7 @@ void MainWindow::processDownloadFile(QTcpSocket *sender, QByteArray bytes) {
     QString user = iter.value().second;
     if (user.isEmpty()) {
         QString msg = "You are not signed in";
-        writeLog(QString("%1> processDownloadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processDownloadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -830,7 +1228,7 @@ void MainWindow::processDownloadFile(QTcpSocket *sender, QByteArray bytes) {
 
     if (!filePath.contains(QDir::separator())) {
         QString msg = "Invalid folder path";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -842,7 +1240,7 @@ void MainWindow::processDownloadFile(QTcpSocket *sender, QByteArray bytes) {
     QString groupName = filePath.left(filePath.indexOf(QDir::separator()));
     if (!groups->allKeys().contains(groupName, Qt::CaseInsensitive)) {
         QString msg = groupName + " not exist";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -850,10 +1248,10 @@ void MainWindow::processDownloadFile(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QSettings* members = groupMembers.value(groupName);
+    MetadataTable* members = groupMembers.value(groupName);
     if (!members->allKeys().contains(user, Qt::CaseInsensitive)) {
         QString msg = "Access denied";
-        writeLog(QString("%1> processUploadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processUploadFile", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -861,7 +1259,7 @@ void MainWindow::processDownloadFile(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QFileInfo info(QString("data") + QDir::separator() + filePath);
+    QFileInfo info(dataRoots->path(filePath));
     if (!info.exists() || !info.isFile()) {
         QString msg = "Invalid data";
 
@@ -869,23 +1267,23 @@ void MainWindow::processDownloadFile(QTcpSocket *sender, QByteArray bytes) {
         byteArray.prepend(errorCode);
         sendResponse(sender, byteArray);
 
-        writeLog(QString("%1> processDownloadFile: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processDownloadFile", msg, Logger::Warning);
         return;
     }
 
-    sendFile(sender, info.filePath());
+    sendFile(sender, info.filePath(), successCode, errorCode);
 }
 
-void MainWindow::processDelete(QTcpSocket *sender, QByteArray bytes) {
+void MainWindow::processDelete(Connection *sender, QByteArray bytes) {
     QByteArray successCode = QByteArray::number(ResponseDeleteSuccess);
     successCode.resize(8);
     QByteArray errorCode = QByteArray::number(ResponseDeleteError);
     errorCode.resize(8);
 
-    QMap<QTcpSocket*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
+    QMap<Connection*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
     if (iter == clients.end()) {
         QString msg = "An error occurred";
-        writeLog(QString("%1> processDelete: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processDelete", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -896,7 +1294,7 @@ void MainWindow::processDelete(QTcpSocket *sender, QByteArray bytes) {
     QString user = iter.value().second;
     if (user.isEmpty()) {
         QString msg = "You are not signed in";
-        writeLog(QString("%1> processDelete: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processDelete", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -907,7 +1305,7 @@ void MainWindow::processDelete(QTcpSocket *sender, QByteArray bytes) {
     QString path = bytes;
     if (!path.contains(QDir::separator())) {
         QString msg = "Invalid folder path";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -919,7 +1317,7 @@ void MainWindow::processDelete(QTcpSocket *sender, QByteArray bytes) {
     QString groupName = path.left(path.indexOf(QDir::separator()));
     if (!groups->allKeys().contains(groupName, Qt::CaseInsensitive)) {
         QString msg = groupName + " not exist";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -927,10 +1325,10 @@ void MainWindow::processDelete(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QSettings* members = groupMembers.value(groupName);
+    MetadataTable* members = groupMembers.value(groupName);
     if (!members->allKeys().contains(user, Qt::CaseInsensitive)) {
         QString msg = "Access denied";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -940,7 +1338,7 @@ void MainWindow::processDelete(QTcpSocket *sender, QByteArray bytes) {
 
     if (members->value(user).toString().compare("1") != 0) {
         QString msg = "Access denied";
-        writeLog(QString("%1> processCreateFolder: %2").arg(sender->socketDescriptor()).arg(msg));
+        writeLog(sender, "processCreateFolder", msg, Logger::Warning);
 
         QByteArray byteArray = msg.toUtf8();
         byteArray.prepend(errorCode);
@@ -948,153 +1346,1915 @@ void MainWindow::processDelete(QTcpSocket *sender, QByteArray bytes) {
         return;
     }
 
-    QFileInfo info(QString("data") + QDir::separator() + path);
-    if (info.exists()) {
-        if (info.isFile()) {
-            if (!QFile(info.filePath()).remove()) {
-                QString msg = "Cannot delete file";
-
-                QByteArray byteArray = msg.toUtf8();
-                byteArray.prepend(errorCode);
-                sendResponse(sender, byteArray);
-
-                writeLog(QString("%1> processDelete: %2").arg(sender->socketDescriptor()).arg(msg));
-                return;
-            }
-        } else if (info.isDir()) {
-            if (!QDir(info.filePath()).removeRecursively()) {
-                QString msg = "Cannot delete folder";
-
-                QByteArray byteArray = msg.toUtf8();
-                byteArray.prepend(errorCode);
-                sendResponse(sender, byteArray);
-
-                writeLog(QString("%1> processDelete: %2").arg(sender->socketDescriptor()).arg(msg));
-                return;
-            }
-        }
-    }
-
+    QString moving = checkMoving(path);
+    if (!moving.isEmpty()) {
+        writeLog(sender, "processDelete", moving, Logger::Warning);
 
-    QJsonArray array;
-    foreach (const QString& key, groupMembers.keys()) {
-        if (groupMembers.value(key)->allKeys().contains(user, Qt::CaseInsensitive)) {
-            QString leader;
-            if (groupMembers.value(key)->value(user).toString().compare("1") == 0) {
-                leader = user;
-            }
-            array.push_back(getData(QString("data") + QDir::separator() + key, leader));
-        }
+        QByteArray byteArray = moving.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
     }
 
-    QJsonObject data;
-    data.insert("name", "");
-    data.insert("path", "");
-    data.insert("type", "root");
-    data.insert("children", array);
+    QString target = dataRoots->path(path);
+    tracer->mark(sender, "handler");
+    sender->pauseReading();
+    storage->remove(target, sender, [this, sender, user, path, target, successCode, errorCode](bool removed) {
+        tracer->mark(sender, "remove");
+        touchGroup(target);
+        if (!removed) {
+            // Part of a folder may be gone; the indexes are brought in line with what is left.
+            reindexSubtree(target);
 
-    QJsonDocument jsonDocument;
-    jsonDocument.setObject(data);
+            QString msg = QFileInfo(target).isDir() ? "Cannot delete folder" : "Cannot delete file";
 
-    QString responseMessage = jsonDocument.toJson(QJsonDocument::Compact);
-
-    QByteArray responseData = responseMessage.toUtf8();
-    responseData.prepend(successCode);
+            QByteArray byteArray = msg.toUtf8();
+            byteArray.prepend(errorCode);
+            sendResponse(sender, byteArray);
 
-    sendResponse(sender, responseData);
+            writeLog(sender, "processDelete", msg, Logger::Warning);
+        } else {
+            contentIndex->remove(target);
+            nameIndex->remove(target);
+            replicate(QJsonObject({{"type", "delete"}, {"path", path}}));
+            sendTree(sender, user, successCode);
 
-    writeLog(QString("%1> processDelete: %2").arg(sender->socketDescriptor()).arg("Success"));
+            writeLog(sender, "processDelete", "Success");
+        }
+        sender->resumeReading();
+    });
 }
 
-QJsonObject MainWindow::getData(const QString &path, const QString& leader) {
-    QString tmpPath = path;
-    QJsonObject object;
-    object.insert("leader", leader);
+void MainWindow::processStats(Connection *sender, QByteArray bytes) {
+    QByteArray successCode = QByteArray::number(ResponseStatsSuccess);
+    successCode.resize(8);
+    QByteArray errorCode = QByteArray::number(ResponseStatsError);
+    errorCode.resize(8);
 
-    QFileInfo info(path);
-    object.insert("name", info.fileName());
-    object.insert("path", tmpPath.replace(QString("data") + QDir::separator(), ""));
+    QMap<Connection*, QPair<qint64, QString>>::iterator iter = clients.find(sender);
+    if (iter == clients.end() || iter.value().second.isEmpty()) {
+        QString msg = "You are not signed in";
+        writeLog(sender, "processStats", msg, Logger::Warning);
 
-    if (info.isDir()) {
-        object.insert("type", "dir");
-        QDir dir(path);
-        QJsonArray children;
-        foreach (const QFileInfo& file, dir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries, QDir::DirsFirst | QDir::Name)) {
-            children.push_back(getData(file.filePath().replace("/", QDir::separator()).replace("\\", QDir::separator()), leader));
-        }
-        object.insert("children", children);
-    } else {
-        object.insert("type", "file");
-        object.insert("size", info.size());
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
     }
 
-    return object;
-}
-
-void MainWindow::sendResponse(QTcpSocket *socket, QByteArray bytes) {
-    if(socket) {
-        if(socket->isOpen()) {
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-            socketStream << bytes;
-        } else {
-            QMessageBox::critical(this, "QTcpServer", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpServer", "Not connected");
-    }
+    QByteArray byteArray = metrics->render();
+    byteArray.prepend(successCode);
+    sendResponse(sender, byteArray);
 }
 
-void MainWindow::sendFile(QTcpSocket *socket, QString filePath) {
-    QByteArray successCode = QByteArray::number(ResponseDownloadFileSuccess);
+void MainWindow::processDownloadRange(Connection *sender, QByteArray bytes) {
+    QByteArray successCode = QByteArray::number(ResponseDownloadRangeSuccess);
     successCode.resize(8);
-    QByteArray errorCode = QByteArray::number(ResponseDownloadFileError);
+    QByteArray errorCode = QByteArray::number(ResponseDownloadRangeError);
     errorCode.resize(8);
 
-    if(socket) {
-        if(socket->isOpen()) {
-            QFile file(filePath);
-            if(file.open(QIODevice::ReadOnly)){
-                writeLog(QString("%1> sendFile: %2").arg(socket->socketDescriptor()).arg("OK!"));
-
-                QFileInfo fileInfo(filePath);
-                QString fileName(fileInfo.fileName());
-
-                QDataStream socketStream(socket);
-                socketStream.setVersion(QDataStream::Qt_5_15);
-
-                QByteArray header;
-                header.prepend(QString("%1,%2").arg(fileName).arg(file.size()).toUtf8());
-                header.resize(128);
-
-                QByteArray byteArray = file.readAll();
-                byteArray.prepend(header);
+    QString dataStr = bytes;
+    bool offsetOk = false;
+    bool lengthOk = false;
+    qint64 offset = dataStr.section(',', 0, 0).toLongLong(&offsetOk);
+    qint64 length = dataStr.section(',', 1, 1).toLongLong(&lengthOk);
+    QString filePath = dataStr.section(',', 2);
+    if (!offsetOk || !lengthOk || offset < 0 || length < 0) {
+        QString msg = "Invalid data";
+        writeLog(sender, "processDownloadRange", msg, Logger::Warning);
 
-                byteArray.prepend(successCode);
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
 
-                socketStream << byteArray;
-            } else {
-                QString msg = "Couldn't open the file";
-                writeLog(QString("%1::sendFile: %2").arg(socket->socketDescriptor()).arg(msg));
+    QString msg = authorize(sender, filePath);
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processDownloadRange", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QFileInfo info(dataRoots->path(filePath));
+    if (!info.exists() || !info.isFile() || partialUploads.contains(filePath)) {
+        QString msg = "Invalid data";
+        writeLog(sender, "processDownloadRange", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    sendFile(sender, info.filePath(), successCode, errorCode, offset, qMin(length, Connection::MaxRangeSize));
+}
+
+void MainWindow::processUploadRange(Connection *sender, QByteArray bytes) {
+    QByteArray errorCode = QByteArray::number(ResponseUploadRangeError);
+    errorCode.resize(8);
+
+    QString header = bytes.mid(0, 256);
+    QByteArray data = bytes.mid(256);
+
+    bool offsetOk = false;
+    bool totalOk = false;
+    qint64 offset = header.section(',', 0, 0).toLongLong(&offsetOk);
+    qint64 total = header.section(',', 1, 1).toLongLong(&totalOk);
+    QString filePath = header.section(',', 2);
+    if (!offsetOk || !totalOk || offset < 0 || offset + data.size() > total) {
+        QString msg = "Invalid data";
+        writeLog(sender, "processUploadRange", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QString msg = authorize(sender, filePath);
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processUploadRange", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    msg = checkMoving(filePath);
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processUploadRange", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QString user = clients.value(sender).second;
+    QString target = dataRoots->path(filePath);
+    QString staging = stagingPath(filePath);
+
+    // The target and the staging file are looked at on the I/O pool, then checked against the uploads in progress.
+    QSharedPointer<bool> exists(new bool(false));
+    QSharedPointer<qint64> staged(new qint64(0));
+    tracer->mark(sender, "handler");
+    sender->pauseReading();
+    ioPool->run([target, staging, exists, staged]() {
+        *exists = QFileInfo::exists(target);
+        *staged = QFileInfo(staging).size();
+    }, sender, [=]() {
+        tracer->mark(sender, "stat");
+        bool owned = partialUploads.value(filePath) == user;
+
+        QString msg;
+        if (offset == 0 && *exists) {
+            msg = "File already exists";
+        } else if (offset == 0 && partialUploads.contains(filePath) && !owned) {
+            // Restarting would truncate the other user's staging file.
+            msg = "File is being uploaded by another user";
+        } else if (offset == 0) {
+            msg = checkUploadSize(filePath, total);
+        } else if (!owned || *staged < offset) {
+            // Ranges may be resent after a reconnect, but never skip ahead.
+            msg = "Upload is not in progress";
+        }
+
+        if (!msg.isEmpty()) {
+            writeLog(sender, "processUploadRange", msg, Logger::Warning);
+
+            QByteArray byteArray = msg.toUtf8();
+            byteArray.prepend(errorCode);
+            sendResponse(sender, byteArray);
+            sender->resumeReading();
+            return;
+        }
+
+        writeUploadRange(sender, filePath, target, offset, total, data);
+    });
+}
+
+void MainWindow::writeUploadRange(Connection *sender, const QString &filePath, const QString &target, qint64 offset, qint64 total, const QByteArray &data) {
+    QByteArray successCode = QByteArray::number(ResponseUploadRangeSuccess);
+    successCode.resize(8);
+    QByteArray errorCode = QByteArray::number(ResponseUploadRangeError);
+    errorCode.resize(8);
+
+    QString user = clients.value(sender).second;
+    partialUploads.insert(filePath, user);
+    partialUploadActivity.insert(filePath, Connection::now());
+
+    // The ranges go to a staging file named after the path, so a resumed upload finds it again.
+    bool last = offset + data.size() == total;
+    QSharedPointer<QFile> file(new QFile(stagingPath(filePath)));
+    QIODevice::OpenMode mode = offset == 0 ? QIODevice::WriteOnly : QIODevice::ReadWrite;
+
+    auto fail = [this, sender, file, filePath, errorCode]() {
+        partialUploads.remove(filePath);
+        partialUploadActivity.remove(filePath);
+        storage->close(file, this, [this, file](bool) {
+            storage->remove(file->fileName(), nullptr, nullptr);
+        });
+
+        QString msg = "An error occurred while trying to write the file";
+        writeLog(sender, "processUploadRange", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        sender->resumeReading();
+    };
+
+    openStaging(file, mode, offset == 0 ? total : 0, sender, [=](bool opened) {
+        tracer->mark(sender, "open");
+        if (!opened) {
+            fail();
+            return;
+        }
+
+        storage->write(file, offset, data, sender, [=](bool written) {
+            tracer->mark(sender, "store");
+            if (!written) {
+                fail();
+                return;
+            }
+
+            if (!last) {
+                // Answered once the range is in the file, so the next one sees it in the staging size.
+                storage->close(file, sender, [=](bool closed) {
+                    if (!closed) {
+                        fail();
+                        return;
+                    }
+
+                    QByteArray byteArray = QByteArray::number(offset + data.size());
+                    byteArray.prepend(successCode);
+                    sendResponse(sender, byteArray);
+                    sender->resumeReading();
+                });
+                return;
+            }
+
+            storage->commit(file, target, sender, [=](bool committed) {
+                tracer->mark(sender, "commit");
+                if (!committed) {
+                    fail();
+                    return;
+                }
+
+                partialUploads.remove(filePath);
+                partialUploadActivity.remove(filePath);
+                touchGroup(filePath);
+                contentIndex->index(filePath);
+                nameIndex->add(filePath, false);
+                replicate(QJsonObject({{"type", "file"}, {"path", filePath}}));
+                sendTree(sender, user, successCode);
+
+                writeLog(sender, "processUploadRange", "Success!");
+                sender->resumeReading();
+            });
+        });
+    });
+}
+
+void MainWindow::processUploadCancel(Connection *sender, QByteArray bytes) {
+    QByteArray successCode = QByteArray::number(ResponseUploadCancelSuccess);
+    successCode.resize(8);
+    QByteArray errorCode = QByteArray::number(ResponseUploadCancelError);
+    errorCode.resize(8);
+
+    QString filePath = bytes;
+    QString user = clients.value(sender).second;
+    if (user.isEmpty() || partialUploads.value(filePath) != user) {
+        QString msg = "Upload is not in progress";
+        writeLog(sender, "processUploadCancel", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    partialUploads.remove(filePath);
+    partialUploadActivity.remove(filePath);
+
+    tracer->mark(sender, "handler");
+    sender->pauseReading();
+    storage->remove(stagingPath(filePath), sender, [this, sender, user, successCode](bool removed) {
+        Q_UNUSED(removed);
+        tracer->mark(sender, "remove");
+        sendTree(sender, user, successCode);
+
+        writeLog(sender, "processUploadCancel", "Success!");
+        sender->resumeReading();
+    });
+}
+
+void MainWindow::processUploadHash(Connection *sender, QByteArray bytes) {
+    QByteArray successCode = QByteArray::number(ResponseUploadHashSuccess);
+    successCode.resize(8);
+    QByteArray errorCode = QByteArray::number(ResponseUploadHashError);
+    errorCode.resize(8);
+
+    QString dataStr = bytes;
+    bool sizeOk = false;
+    qint64 size = dataStr.section(',', 0, 0).toLongLong(&sizeOk);
+    QString hash = dataStr.section(',', 1, 1).toLower();
+    QString filePath = dataStr.section(',', 2);
+    if (!sizeOk || size < 0 || hash.size() != 64) {
+        QString msg = "Invalid data";
+        writeLog(sender, "processUploadHash", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QString msg = authorize(sender, filePath);
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processUploadHash", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    msg = checkMoving(filePath);
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processUploadHash", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QFileInfo info(dataRoots->path(filePath));
+    if (info.exists() || partialUploads.contains(filePath)) {
+        QString msg = "File already exists";
+        writeLog(sender, "processUploadHash", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    // Only content the user could download anyway, so knowing a hash never
+    // grants access to a file in someone else's group.
+    QString source;
+    foreach (const QString& candidate, contentIndex->paths(hash)) {
+        if (contentIndex->entry(candidate).size == size && authorize(sender, QDir::toNativeSeparators(candidate)).isEmpty()) {
+            source = candidate;
+            break;
+        }
+    }
+
+    if (source.isEmpty()) {
+        QString msg = "Content not found";
+        writeLog(sender, "processUploadHash", msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QString user = clients.value(sender).second;
+    QString sourceName = contentIndex->fileName(source);
+    QString targetName = info.filePath();
+    ContentIndex::Entry entry = contentIndex->entry(source);
+    QSharedPointer<bool> valid(new bool(false));
+
+    tracer->mark(sender, "handler");
+    sender->pauseReading();
+    ioPool->run([entry, sourceName, valid]() {
+        *valid = entry.matches(sourceName);
+    }, sender, [=]() {
+        tracer->mark(sender, "verify");
+        if (!*valid) {
+            contentIndex->remove(source);
+
+            QString msg = "Content not found";
+            writeLog(sender, "processUploadHash", msg);
+
+            QByteArray byteArray = msg.toUtf8();
+            byteArray.prepend(errorCode);
+            sendResponse(sender, byteArray);
+            sender->resumeReading();
+            return;
+        }
+
+        storage->link(sourceName, targetName, sender, [=](bool linked) {
+            tracer->mark(sender, "link");
+            if (!linked) {
+                QString msg = "Cannot link the file";
+                writeLog(sender, "processUploadHash", msg, Logger::Warning);
 
                 QByteArray byteArray = msg.toUtf8();
                 byteArray.prepend(errorCode);
-                sendResponse(socket, byteArray);
+                sendResponse(sender, byteArray);
+                sender->resumeReading();
                 return;
             }
-        } else {
-            QMessageBox::critical(this,"QTcpServer","Socket doesn't seem to be opened");
+
+            // A hard link shares the source's inode and so its entry; a copy has to be hashed again.
+            if (entry.matches(targetName)) {
+                contentIndex->add(filePath, entry);
+            } else {
+                contentIndex->index(filePath);
+            }
+            nameIndex->add(filePath, false);
+            touchGroup(filePath);
+            replicate(QJsonObject({{"type", "file"}, {"path", filePath}, {"hash", entry.hash}}));
+            sendTree(sender, user, successCode);
+
+            writeLog(sender, "processUploadHash", QString("Linked %1").arg(source));
+            sender->resumeReading();
+        });
+    });
+}
+
+void MainWindow::processReplicate(Connection *sender, QByteArray bytes) {
+    QByteArray errorCode = QByteArray::number(ResponseReplicateError);
+    errorCode.resize(8);
+
+    QString dataStr = bytes;
+    QString secret = dataStr.section(';', 0, 0);
+    QString cursor = dataStr.section(';', 1);
+
+    QString msg;
+    QString expected = config->value("replication/secret").toString();
+    if (!replicationLog) {
+        msg = "Replication is not enabled on this server";
+    } else if (expected.isEmpty() || secret != expected) {
+        msg = "Access denied";
+    }
+
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processReplicate", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    if (!replicas.contains(sender)) {
+        writeLog(sender, "processReplicate", "Replica connected");
+        replicas.insert(sender, ReplicaState{0, false, QSharedPointer<QJsonArray>(), 0});
+    }
+    ReplicaState& state = replicas[sender];
+
+    // Cursors are "epoch:seq" in the log or "epoch:snapshot:page:base" inside a snapshot.
+    QStringList fields = cursor.split(':');
+    if (fields.size() == 2 && fields[0] == serverEpoch && replicationLog->covers(fields[1].toULongLong())) {
+        state.position = fields[1].toULongLong();
+        state.snapshot.reset();
+        if (state.position == replicationLog->head()) {
+            state.waiting = true;
+            return;
         }
-    } else {
-        QMessageBox::critical(this,"QTcpServer","Not connected");
+        sendReplicationBatch(sender);
+        return;
+    }
+
+    if (fields.size() == 4 && fields[0] == serverEpoch && fields[1] == "snapshot" && state.snapshot && fields[3].toULongLong() == state.snapshotBase) {
+        sendReplicationSnapshot(sender, fields[2].toInt());
+        return;
+    }
+
+    startReplicationSnapshot(sender);
+}
+
+void MainWindow::replicate(const QJsonObject &event) {
+    if (replicationLog) {
+        replicationLog->append(event);
+    }
+}
+
+void MainWindow::answerReplicas(bool heartbeat) {
+    foreach (Connection* connection, replicas.keys()) {
+        const ReplicaState& state = replicas[connection];
+        if (state.waiting && (heartbeat || state.position < replicationLog->head())) {
+            sendReplicationBatch(connection);
+        }
+    }
+}
+
+void MainWindow::sendReplicationBatch(Connection *sender) {
+    QByteArray successCode = QByteArray::number(ResponseReplicateSuccess);
+    successCode.resize(8);
+
+    ReplicaState& state = replicas[sender];
+    state.waiting = false;
+
+    QJsonArray events = replicationLog->since(state.position, ReplicationBatchSize);
+    quint64 position = state.position + events.size();
+
+    QJsonObject batch;
+    batch.insert("cursor", QString("%1:%2").arg(QString::fromLatin1(serverEpoch)).arg(position));
+    batch.insert("position", qint64(position));
+    batch.insert("head", qint64(replicationLog->head()));
+    batch.insert("events", events);
+    sendResponse(sender, successCode + QJsonDocument(batch).toJson(QJsonDocument::Compact));
+}
+
+void MainWindow::startReplicationSnapshot(Connection *sender) {
+    writeLog(sender, "processReplicate", "Sending a snapshot");
+
+    // Metadata is captured here; the walk over the group folders runs on the pool.
+    QSharedPointer<QJsonArray> snapshot(new QJsonArray());
+    snapshot->append(QJsonObject({{"type", "snapshotBegin"}}));
+    foreach (const QString& user, users->allKeys()) {
+        snapshot->append(QJsonObject({{"type", "user"}, {"name", user}, {"value", users->value(user).toString()}}));
+    }
+
+    QList<QPair<QString, QString>> folders;
+    foreach (const QString& group, groups->allKeys()) {
+        snapshot->append(QJsonObject({{"type", "group"}, {"name", group}, {"owner", groups->value(group).toString()}}));
+        MetadataTable* members = groupMembers.value(group);
+        if (members) {
+            foreach (const QString& user, members->allKeys()) {
+                snapshot->append(QJsonObject({{"type", "member"}, {"group", group}, {"user", user}, {"role", members->value(user).toString()}}));
+            }
+        }
+        folders.append(qMakePair(group, dataRoots->path(group)));
+    }
+
+    // Files still being uploaded are announced once they are complete.
+    QSet<QString> incomplete = incompleteUploads();
+    quint64 base = replicationLog->head();
+    ContentIndex::Snapshot hashes = contentIndex->snapshot();
+
+    sender->pauseReading();
+    ioPool->run([snapshot, folders, incomplete, hashes]() {
+        for (const QPair<QString, QString>& folder : folders) {
+            foreach (const QJsonValue& event, listGroup(folder.first, folder.second, incomplete, hashes)) {
+                snapshot->append(event);
+            }
+        }
+        snapshot->append(QJsonObject({{"type", "snapshotEnd"}}));
+    }, sender, [this, sender, snapshot, base]() {
+        sender->resumeReading();
+        if (!replicas.contains(sender)) {
+            return;
+        }
+
+        ReplicaState& state = replicas[sender];
+        state.snapshot = snapshot;
+        state.snapshotBase = base;
+        sendReplicationSnapshot(sender, 0);
+    });
+}
+
+void MainWindow::sendReplicationSnapshot(Connection *sender, int page) {
+    QByteArray successCode = QByteArray::number(ResponseReplicateSuccess);
+    successCode.resize(8);
+
+    ReplicaState& state = replicas[sender];
+    state.waiting = false;
+
+    QJsonArray events;
+    int first = qMax(0, page) * ReplicationBatchSize;
+    for (int i = first; i < state.snapshot->size() && events.size() < ReplicationBatchSize; i++) {
+        events.append(state.snapshot->at(i));
     }
+
+    // Changes made while the snapshot was taken follow from the log, starting at base.
+    bool last = first + events.size() >= state.snapshot->size();
+    QString epoch = QString::fromLatin1(serverEpoch);
+    QJsonObject batch;
+    batch.insert("cursor", last ? QString("%1:%2").arg(epoch).arg(state.snapshotBase)
+                                : QString("%1:snapshot:%2:%3").arg(epoch).arg(page + 1).arg(state.snapshotBase));
+    batch.insert("position", qint64(last ? state.snapshotBase : 0));
+    batch.insert("head", qint64(replicationLog->head()));
+    batch.insert("events", events);
+
+    if (last) {
+        state.snapshot.reset();
+        state.position = state.snapshotBase;
+    }
+    sendResponse(sender, successCode + QJsonDocument(batch).toJson(QJsonDocument::Compact));
 }
 
-bool MainWindow::isValidGroupName(const QString &groupName) {
-    if (groupName.isEmpty()) {
+bool MainWindow::redirectWrite(Connection *sender, int request) {
+    if (!replica) {
         return false;
     }
 
-    QRegExp regex("^[A-Za-z0-9_\\- ]*$");
-    return regex.exactMatch(groupName);
+    switch (request) {
+        case RequestSignUp:
+        case RequestCreateGroup:
+        case RequestJoinGroup:
+        case RequestCreateFolder:
+        case RequestUploadFile:
+        case RequestDelete:
+        case RequestUploadRange:
+        case RequestUploadCancel:
+        case RequestUploadHash:
+            break;
+
+        default:
+            return false;
+    }
+
+    QByteArray redirectCode = QByteArray::number(ResponseRedirect);
+    redirectCode.resize(8);
+    writeLog(sender, "redirect", QString("Request %1 sent to %2").arg(request).arg(replica->primary()), Logger::Debug);
+    sendResponse(sender, redirectCode + replica->primary().toUtf8());
+    return true;
+}
+
+void MainWindow::applyReplicationEvent(const QJsonObject &event, const std::function<void()> &done) {
+    QString type = event.value("type").toString();
+    QString path = event.value("path").toString();
+    if (path.contains("..")) {
+        done();
+        return;
+    }
+
+    if (type == "snapshotBegin") {
+        writeLog("Replication: receiving a snapshot");
+        replicaSnapshotting = true;
+        replicaSeen.clear();
+        done();
+        return;
+    }
+
+    if (type == "snapshotEnd") {
+        finishReplicationSnapshot(done);
+        return;
+    }
+
+    if (type == "user") {
+        QString name = event.value("name").toString();
+        users->setValue(name, event.value("value").toString());
+        replicaSeen.insert("user:" + name);
+        done();
+        return;
+    }
+
+    if (type == "group") {
+        QString name = event.value("name").toString();
+        if (!FileTree::isValidGroupName(name)) {
+            done();
+            return;
+        }
+
+        groups->setValue(name, event.value("owner").toString());
+        if (!groupMembers.contains(name)) {
+            groupMembers.insert(name, metadata->table("members/" + name));
+        }
+        replicaSeen.insert("group:" + name);
+
+        QString folder = dataRoots->contains(name) ? dataRoots->path(name) : dataRoots->place(name) + QDir::separator() + name;
+        ioPool->run([folder]() {
+            QDir().mkpath(folder);
+        }, this, [this, name, done]() {
+            nameIndex->add(name, true);
+            touchGroup(name);
+            done();
+        });
+        return;
+    }
+
+    if (type == "member") {
+        QString group = event.value("group").toString();
+        QString user = event.value("user").toString();
+        MetadataTable* members = groupMembers.value(group);
+        if (members) {
+            members->setValue(user, event.value("role").toString());
+            touchGroup(group);
+        }
+        replicaSeen.insert("member:" + group + "/" + user);
+        done();
+        return;
+    }
+
+    if (type == "folder") {
+        replicaSeen.insert("path:" + QDir::fromNativeSeparators(path));
+        QString folder = dataRoots->path(path);
+        ioPool->run([folder]() {
+            QDir().mkpath(folder);
+        }, this, [this, path, done]() {
+            nameIndex->add(path, true);
+            touchGroup(path);
+            done();
+        });
+        return;
+    }
+
+    if (type == "delete") {
+        QString target = dataRoots->path(path);
+        storage->remove(target, this, [this, target, done](bool removed) {
+            Q_UNUSED(removed);
+            contentIndex->remove(target);
+            nameIndex->remove(target);
+            touchGroup(target);
+            done();
+        });
+        return;
+    }
+
+    if (type == "file") {
+        replicaSeen.insert("path:" + QDir::fromNativeSeparators(path));
+        applyReplicatedFile(replica->link(), path, event.value("hash").toString(), [done](bool applied) {
+            Q_UNUSED(applied);
+            done();
+        });
+        return;
+    }
+
+    done();
+}
+
+void MainWindow::applyReplicatedFile(PeerLink *source, const QString &path, const QString &hash, const std::function<void(bool)> &done) {
+    QString target = dataRoots->path(path);
+    ContentIndex::Entry entry = contentIndex->entry(path);
+    if (!hash.isEmpty() && entry.hash == hash && entry.matches(target)) {
+        done(true);
+        return;
+    }
+
+    // Content this server already holds under another name is linked rather than fetched.
+    QString local;
+    if (!hash.isEmpty()) {
+        foreach (const QString& candidate, contentIndex->paths(hash)) {
+            if (contentIndex->entry(candidate).matches(contentIndex->fileName(candidate))) {
+                local = contentIndex->fileName(candidate);
+                break;
+            }
+        }
+    }
+
+    // Staged on the same root as the target so the final rename is atomic.
+    QString group = QDir::fromNativeSeparators(path).section('/', 0, 0);
+    QString stagingDir = dataRoots->root(group) + QDir::separator() + ReplicaStagingFolder;
+    QString staging = stagingDir + QDir::separator() + QString::number(QRandomGenerator::global()->generate64(), 16);
+
+    QString from = source->address();
+    auto install = [this, path, from, target, staging, done](bool copied) {
+        if (!copied) {
+            storage->remove(staging, nullptr, nullptr);
+            logger->log(Logger::Warning, -1, QString(), "replicate", -1, QString("Cannot copy %1 from %2").arg(path, from));
+            done(false);
+            return;
+        }
+
+        QSharedPointer<bool> renamed(new bool(false));
+        ioPool->run([target, staging, renamed]() {
+            QDir().mkpath(QFileInfo(target).path());
+            *renamed = Storage::replaceFile(staging, target);
+            if (!*renamed) {
+                QFile::remove(staging);
+            }
+        }, this, [this, path, renamed, done]() {
+            if (*renamed) {
+                contentIndex->index(path);
+                nameIndex->add(path, false);
+                touchGroup(path);
+            }
+            done(*renamed);
+        });
+    };
+
+    ioPool->run([stagingDir]() {
+        QDir().mkpath(stagingDir);
+    }, this, [this, source, path, local, staging, install]() {
+        if (!local.isEmpty()) {
+            storage->link(local, staging, this, install);
+        } else {
+            source->fetch(path, staging, this, install);
+        }
+    });
+}
+
+void MainWindow::finishReplicationSnapshot(const std::function<void()> &done) {
+    replicaSnapshotting = false;
+
+    // Whatever the snapshot did not mention no longer exists on the primary.
+    foreach (const QString& user, users->allKeys()) {
+        if (!replicaSeen.contains("user:" + user)) {
+            users->remove(user);
+        }
+    }
+
+    QList<QPair<QString, QString>> folders;
+    foreach (const QString& group, groups->allKeys()) {
+        if (!replicaSeen.contains("group:" + group)) {
+            dropGroup(group);
+            continue;
+        }
+
+        MetadataTable* members = groupMembers.value(group);
+        foreach (const QString& user, members ? members->allKeys() : QStringList()) {
+            if (!replicaSeen.contains("member:" + group + "/" + user)) {
+                members->remove(user);
+                touchGroup(group);
+            }
+        }
+        folders.append(qMakePair(group, dataRoots->path(group)));
+    }
+
+    QSet<QString> seen = replicaSeen;
+    replicaSeen.clear();
+
+    QSharedPointer<QStringList> removed(new QStringList());
+    ioPool->run([folders, seen, removed]() {
+        for (const QPair<QString, QString>& folder : folders) {
+            QDir root(folder.second);
+            QStringList stale;
+            QDirIterator it(folder.second, QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                it.next();
+                QString relative = folder.first + "/" + root.relativeFilePath(it.filePath());
+                if (!seen.contains("path:" + relative)) {
+                    stale.append(it.filePath());
+                    removed->append(relative);
+                }
+            }
+
+            foreach (const QString& fileName, stale) {
+                if (QFileInfo(fileName).isDir()) {
+                    QDir(fileName).removeRecursively();
+                } else {
+                    QFile::remove(fileName);
+                }
+            }
+        }
+    }, this, [this, removed, done]() {
+        foreach (const QString& path, *removed) {
+            contentIndex->remove(path);
+            nameIndex->remove(path);
+            touchGroup(path);
+        }
+        writeLog(QString("Replication: snapshot applied, %1 stale entries removed").arg(removed->size()));
+        done();
+    });
+}
+
+void MainWindow::processClusterUsers(Connection *sender, QByteArray bytes) {
+    QByteArray errorCode = QByteArray::number(ResponseClusterError);
+    errorCode.resize(8);
+    QByteArray successCode = QByteArray::number(ResponseClusterSuccess);
+    successCode.resize(8);
+
+    int separator = bytes.indexOf(';');
+    QString msg = checkCluster(sender, QString::fromUtf8(bytes.left(separator)));
+    if (separator < 0) {
+        msg = "Invalid data";
+    }
+
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processClusterUsers", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    // Accounts are only ever added; the node that signed the user up keeps the password it was given.
+    QJsonObject accounts = QJsonDocument::fromJson(bytes.mid(separator + 1)).object();
+    QStringList known = users->allKeys();
+    int added = 0;
+    for (QJsonObject::const_iterator it = accounts.constBegin(); it != accounts.constEnd(); ++it) {
+        if (it.key().isEmpty() || known.contains(it.key(), Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        users->setValue(it.key(), it.value().toString());
+        replicate(QJsonObject({{"type", "user"}, {"name", it.key()}, {"value", it.value().toString()}}));
+        known.append(it.key());
+        added++;
+    }
+
+    sendResponse(sender, successCode);
+
+    if (added > 0) {
+        writeLog(sender, "processClusterUsers", QString("%1 accounts added").arg(added));
+    }
+}
+
+void MainWindow::processClusterGroup(Connection *sender, QByteArray bytes) {
+    QByteArray errorCode = QByteArray::number(ResponseClusterError);
+    errorCode.resize(8);
+    QByteArray successCode = QByteArray::number(ResponseClusterSuccess);
+    successCode.resize(8);
+
+    QString dataStr = bytes;
+    QString group = dataStr.section(';', 1);
+    QString msg = checkCluster(sender, dataStr.section(';', 0, 0));
+    if (msg.isEmpty()) {
+        group = localGroup(group);
+        if (group.isEmpty()) {
+            msg = dataStr.section(';', 1) + " not exist";
+        }
+    }
+
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processClusterGroup", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QSharedPointer<QJsonObject> manifest(new QJsonObject());
+    manifest->insert("name", group);
+    manifest->insert("owner", groups->value(group).toString());
+
+    QJsonObject members;
+    MetadataTable* settings = groupMembers.value(group);
+    foreach (const QString& user, settings ? settings->allKeys() : QStringList()) {
+        members.insert(user, settings->value(user).toString());
+    }
+    manifest->insert("members", members);
+
+    QString folder = dataRoots->path(group);
+    QSet<QString> incomplete = incompleteUploads();
+    ContentIndex::Snapshot hashes = contentIndex->snapshot();
+
+    sender->pauseReading();
+    ioPool->run([manifest, group, folder, incomplete, hashes]() {
+        manifest->insert("entries", listGroup(group, folder, incomplete, hashes));
+    }, sender, [this, sender, manifest, successCode]() {
+        sendResponse(sender, successCode + QJsonDocument(*manifest).toJson(QJsonDocument::Compact));
+        sender->resumeReading();
+
+        writeLog(sender, "processClusterGroup", QString("Listed %1").arg(manifest->value("name").toString()));
+    });
+}
+
+void MainWindow::processClusterTransfer(Connection *sender, QByteArray bytes) {
+    QByteArray errorCode = QByteArray::number(ResponseClusterError);
+    errorCode.resize(8);
+    QByteArray successCode = QByteArray::number(ResponseClusterSuccess);
+    successCode.resize(8);
+
+    QString dataStr = bytes;
+    QString group = dataStr.section(';', 1, 1);
+    QString from = dataStr.section(';', 2);
+    QString msg = checkCluster(sender, dataStr.section(';', 0, 0));
+    if (msg.isEmpty()) {
+        if (!FileTree::isValidGroupName(group)) {
+            msg = "Group name is invalid";
+        } else if (!clusterPeers.contains(from)) {
+            msg = from + " is not a node of this cluster";
+        } else if (clusterRing.owner(group) != clusterSelf) {
+            msg = group + " does not belong to this node";
+        }
+    }
+
+    if (!msg.isEmpty()) {
+        writeLog(sender, "processClusterTransfer", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    writeLog(sender, "processClusterTransfer", QString("Taking over %1 from %2").arg(group, from));
+
+    // The answer is held back until the whole group is here; the old owner deletes its copy when it arrives.
+    PeerLink* source = clusterPeers.value(from);
+    QPointer<Connection> guard(sender);
+    auto finish = [this, guard, group, from, successCode, errorCode](bool pulled) {
+        if (!guard) {
+            return;
+        }
+
+        QString result = pulled ? "Success!" : QString("Cannot copy %1 from %2").arg(group, from);
+        writeLog(guard, "processClusterTransfer", result, pulled ? Logger::Info : Logger::Warning);
+        sendResponse(guard, (pulled ? successCode : errorCode) + result.toUtf8());
+        guard->resumeReading();
+    };
+
+    sender->pauseReading();
+    source->request(RequestClusterGroup, (clusterSecret + ";" + group).toUtf8(), [this, source, finish](QByteArray data) {
+        if (data.mid(0, 8).toInt() != ResponseClusterSuccess) {
+            finish(false);
+            return;
+        }
+
+        QJsonObject manifest = QJsonDocument::fromJson(data.mid(8)).object();
+        QString name = manifest.value("name").toString();
+        if (!FileTree::isValidGroupName(name)) {
+            finish(false);
+            return;
+        }
+
+        QString folder = dataRoots->contains(name) ? dataRoots->path(name) : dataRoots->place(name) + QDir::separator() + name;
+        QSharedPointer<QJsonArray> entries(new QJsonArray(manifest.value("entries").toArray()));
+        ioPool->run([folder]() {
+            QDir().mkpath(folder);
+        }, this, [this, source, name, manifest, entries, finish]() {
+            pullGroupEntries(source, name, entries, 0, [this, name, manifest, entries, finish](bool pulled) {
+                if (!pulled) {
+                    finish(false);
+                    return;
+                }
+
+                // The group only becomes visible once its files are all here.
+                metadata->startTransaction();
+                groups->setValue(name, manifest.value("owner").toString());
+                MetadataTable* members = groupMembers.value(name);
+                if (!members) {
+                    members = metadata->table("members/" + name);
+                    groupMembers.insert(name, members);
+                }
+                members->clear();
+
+                QJsonObject list = manifest.value("members").toObject();
+                replicate(QJsonObject({{"type", "group"}, {"name", name}, {"owner", manifest.value("owner").toString()}}));
+                for (QJsonObject::const_iterator it = list.constBegin(); it != list.constEnd(); ++it) {
+                    members->setValue(it.key(), it.value().toString());
+                    replicate(QJsonObject({{"type", "member"}, {"group", name}, {"user", it.key()}, {"role", it.value().toString()}}));
+                }
+                metadata->commitTransaction();
+                foreach (const QJsonValue& entry, *entries) {
+                    replicate(entry.toObject());
+                }
+
+                nameIndex->add(name, true);
+                touchGroup(name);
+
+                // The old owner deletes its copy on our answer, so the group must be on disk first.
+                metadata->whenDurable(this, [finish]() {
+                    finish(true);
+                });
+            });
+        });
+    });
+}
+
+void MainWindow::processPing(Connection *sender, QByteArray bytes) {
+    QByteArray successCode = QByteArray::number(ResponsePingSuccess);
+    successCode.resize(8);
+
+    // Receiving the ping already counted as activity; the echo lets the client measure its side.
+    QByteArray byteArray = bytes;
+    byteArray.prepend(successCode);
+    sendResponse(sender, byteArray);
+}
+
+void MainWindow::processSearch(Connection *sender, QByteArray bytes) {
+    QByteArray successCode = QByteArray::number(ResponseSearchSuccess);
+    successCode.resize(8);
+    QByteArray errorCode = QByteArray::number(ResponseSearchError);
+    errorCode.resize(8);
+
+    QString user = clients.value(sender).second;
+    if (user.isEmpty()) {
+        QString msg = "You are not signed in";
+        writeLog(sender, "processSearch", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    QString dataStr = bytes;
+    bool offsetOk = false;
+    bool limitOk = false;
+    int offset = dataStr.section(',', 0, 0).toInt(&offsetOk);
+    int limit = dataStr.section(',', 1, 1).toInt(&limitOk);
+    QString query = dataStr.section(',', 2).trimmed();
+    if (!offsetOk || !limitOk || offset < 0 || limit <= 0 || query.isEmpty()) {
+        QString msg = "Invalid data";
+        writeLog(sender, "processSearch", msg, Logger::Warning);
+
+        QByteArray byteArray = msg.toUtf8();
+        byteArray.prepend(errorCode);
+        sendResponse(sender, byteArray);
+        return;
+    }
+
+    // Only the groups held here; in a cluster the client asks every node.
+    QSet<QString> groupNames;
+    for (QMap<QString, MetadataTable*>::const_iterator it = groupMembers.constBegin(); it != groupMembers.constEnd(); ++it) {
+        if (it.value()->allKeys().contains(user, Qt::CaseInsensitive)) {
+            groupNames.insert(it.key().toLower());
+        }
+    }
+
+    int total = 0;
+    QVector<NameIndex::Hit> hits = nameIndex->search(query, groupNames, incompleteUploads(), offset, limit, &total);
+
+    QJsonArray array;
+    foreach (const NameIndex::Hit& hit, hits) {
+        array.append(QJsonObject({{"name", hit.name}, {"path", QDir::toNativeSeparators(hit.path)}, {"type", hit.folder ? "dir" : "file"}}));
+    }
+
+    QJsonObject result({{"query", query}, {"offset", offset}, {"total", total}, {"hits", array}});
+    if (!clusterSelf.isEmpty()) {
+        result.insert("node", clusterSelf);
+    }
+
+    tracer->mark(sender, "search");
+    QByteArray byteArray = QJsonDocument(result).toJson(QJsonDocument::Compact);
+    byteArray.prepend(successCode);
+    sendResponse(sender, byteArray);
+}
+
+bool MainWindow::throttle(Connection *sender, int request) {
+    // Pings keep links alive, and other servers are trusted once they have proven the shared secret.
+    if (request == RequestPing || clusterConnections.contains(sender) || replicas.contains(sender)) {
+        return false;
+    }
+
+    if (overCapacity.contains(sender)) {
+        sendRetryLater(sender, OverloadRetryDelay, "The server has too many connections");
+        sender->close();
+        return true;
+    }
+
+    // Whatever the client pipelined behind a refused request is refused too, so its retries keep their order.
+    qint64 refused = refusedUntil.value(sender) - Connection::now();
+    if (refused > 0) {
+        sendRetryLater(sender, refused, "Waiting for an earlier request to be retried");
+        return true;
+    }
+
+    QStringList keys;
+    keys << QString::number(quintptr(sender), 16) << clients.value(sender).second.toLower() << sender->peerAddress();
+
+    // Bytes are charged once they have moved; byte-heavy requests then wait for the debt to be paid off.
+    qint64 traffic = sender->bytesReceived() + sender->bytesSent();
+    qint64 &charged = bytesCharged[sender];
+    rateLimiter->charge(RateLimiter::Bytes, keys, traffic - charged);
+    charged = traffic;
+
+    qint64 delay = isTransferRequest(request) ? rateLimiter->acquire(RateLimiter::Bytes, keys, 0) : 0;
+    if (delay == 0) {
+        delay = rateLimiter->acquire(RateLimiter::Requests, keys, 1);
+    }
+    if (delay > 0) {
+        sendRetryLater(sender, delay, "Too many requests");
+        return true;
+    }
+
+    if (isHeavyRequest(request)) {
+        if (maxHeavyRequests > 0 && heavyRequests.size() >= maxHeavyRequests) {
+            sendRetryLater(sender, HeavyRetryDelay, "The server is busy");
+            return true;
+        }
+        heavyRequests.insert(sender);
+    }
+    return false;
+}
+
+void MainWindow::sendRetryLater(Connection *sender, qint64 delay, const QString &msg) {
+    QByteArray retryCode = QByteArray::number(ResponseRetryLater);
+    retryCode.resize(8);
+
+    requestsThrottled++;
+    refusedUntil.insert(sender, Connection::now() + delay);
+    writeLog(sender, "throttle", QString("%1, retry after %2 ms").arg(msg).arg(delay), Logger::Warning);
+
+    QByteArray byteArray = QString("%1;%2").arg(delay).arg(msg).toUtf8();
+    byteArray.prepend(retryCode);
+    sendResponse(sender, byteArray);
+}
+
+bool MainWindow::isHeavyRequest(int request) {
+    switch (request) {
+        case RequestGet:
+        case RequestUploadHash:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool MainWindow::isTransferRequest(int request) {
+    switch (request) {
+        case RequestUploadFile:
+        case RequestDownloadFile:
+        case RequestDownloadRange:
+        case RequestUploadRange:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void MainWindow::pullGroupEntries(PeerLink *source, const QString &group, QSharedPointer<QJsonArray> entries, int index, const std::function<void(bool)> &done) {
+    if (index >= entries->size()) {
+        done(true);
+        return;
+    }
+
+    auto next = [this, source, group, entries, index, done](bool pulled) {
+        if (!pulled) {
+            done(false);
+            return;
+        }
+
+        // Queued so that a long run of files already here does not recurse.
+        QMetaObject::invokeMethod(this, [this, source, group, entries, index, done]() {
+            pullGroupEntries(source, group, entries, index + 1, done);
+        }, Qt::QueuedConnection);
+    };
+
+    QJsonObject entry = entries->at(index).toObject();
+    QString path = entry.value("path").toString();
+    if (path.contains("..") || groupOf(path) != group.toLower()) {
+        next(true);
+        return;
+    }
+
+    if (entry.value("type").toString() == "folder") {
+        QString folder = dataRoots->path(path);
+        ioPool->run([folder]() {
+            QDir().mkpath(folder);
+        }, this, [this, path, next]() {
+            nameIndex->add(path, true);
+            next(true);
+        });
+        return;
+    }
+
+    applyReplicatedFile(source, path, entry.value("hash").toString(), next);
+}
+
+QString MainWindow::checkCluster(Connection *sender, const QString &secret) {
+    if (clusterSelf.isEmpty()) {
+        return "Clustering is not enabled on this server";
+    }
+    if (clusterSecret.isEmpty() || secret != clusterSecret) {
+        return "Access denied";
+    }
+
+    clusterConnections.insert(sender);
+    return QString();
+}
+
+QString MainWindow::localGroup(const QString &group) const {
+    foreach (const QString& key, groups->allKeys()) {
+        if (key.compare(group, Qt::CaseInsensitive) == 0) {
+            return key;
+        }
+    }
+    return QString();
+}
+
+QString MainWindow::requestGroup(int request, const QByteArray &bytes) {
+    QString path;
+    switch (request) {
+        case RequestCreateGroup:
+        case RequestJoinGroup:
+            return QString(bytes);
+
+        case RequestCreateFolder:
+        case RequestDownloadFile:
+        case RequestDelete:
+        case RequestUploadCancel:
+            path = bytes;
+            break;
+
+        case RequestUploadFile:
+            path = bytes.mid(0, 256);
+            break;
+
+        case RequestDownloadRange:
+        case RequestUploadHash:
+            path = QString(bytes).section(',', 2);
+            break;
+
+        case RequestUploadRange:
+            path = QString(bytes.mid(0, 256)).section(',', 2);
+            break;
+
+        default:
+            return QString();
+    }
+
+    // Clients on any platform may have built the path.
+    return path.replace('\\', '/').section('/', 0, 0);
+}
+
+bool MainWindow::redirectGroup(Connection *sender, int request, const QByteArray &bytes) {
+    if (clusterSelf.isEmpty() || clusterConnections.contains(sender)) {
+        return false;
+    }
+
+    // A group still held here is served here, even once the ring has given it to another node.
+    QString group = requestGroup(request, bytes);
+    if (group.isEmpty() || !localGroup(group).isEmpty()) {
+        return false;
+    }
+
+    QString owner = clusterRing.owner(group);
+    if (owner.isEmpty() || owner == clusterSelf) {
+        return false;
+    }
+
+    QByteArray redirectCode = QByteArray::number(ResponseRedirect);
+    redirectCode.resize(8);
+    writeLog(sender, "redirect", QString("%1 is served by %2").arg(group, owner), Logger::Debug);
+    sendResponse(sender, redirectCode + (owner + ";" + group).toUtf8());
+    return true;
+}
+
+void MainWindow::updateCluster() {
+    if (clusterSelf.isEmpty()) {
+        return;
+    }
+
+    QStringList nodes = config->value("cluster/nodes").toStringList();
+    nodes.prepend(clusterSelf);
+    QStringList previous = clusterRing.nodes();
+    clusterRing.setNodes(nodes);
+    if (clusterRing.nodes() == previous) {
+        return;
+    }
+
+    writeLog(QString("Cluster: %1, nodes %2").arg(clusterSelf, clusterRing.nodes().join(", ")));
+
+    // Links to nodes dropped from the list stay open; the ring no longer hands them any group.
+    foreach (const QString& node, clusterRing.nodes()) {
+        if (node == clusterSelf || clusterPeers.contains(node)) {
+            continue;
+        }
+
+        PeerLink* link = new PeerLink(node.section(':', 0, -2), node.section(':', -1).toUShort(), storage, this);
+        connect(link, &PeerLink::stateChanged, this, [this, link](bool connected) {
+            writeLog(QString("Cluster: %1 node %2").arg(connected ? "connected to" : "lost").arg(link->address()));
+            if (connected) {
+                // Accounts created while the link was down.
+                QJsonObject accounts;
+                foreach (const QString& user, users->allKeys()) {
+                    accounts.insert(user, users->value(user).toString());
+                }
+                pushUsers(accounts, link);
+                handOffGroups();
+            }
+        });
+        clusterPeers.insert(node, link);
+        link->start();
+    }
+
+    handOffGroups();
+}
+
+void MainWindow::pushUsers(const QJsonObject &accounts, PeerLink *peer) {
+    QByteArray payload = (clusterSecret + ";").toUtf8() + QJsonDocument(accounts).toJson(QJsonDocument::Compact);
+    foreach (PeerLink* link, peer ? QList<PeerLink*>({peer}) : clusterPeers.values()) {
+        // A link that is down gets every account once it is back.
+        link->request(RequestClusterUsers, payload, [this, link](QByteArray data) {
+            if (!data.isEmpty() && data.mid(0, 8).toInt() != ResponseClusterSuccess) {
+                logger->log(Logger::Warning, -1, QString(), "cluster", -1, QString("%1: %2").arg(link->address(), QString::fromUtf8(data.mid(8))));
+            }
+        });
+    }
+}
+
+void MainWindow::handOffGroups() {
+    if (clusterSelf.isEmpty()) {
+        return;
+    }
+
+    foreach (const QString& group, groups->allKeys()) {
+        if (clusterRing.owner(group) != clusterSelf && !handoffs.contains(group)) {
+            handoffs.append(group);
+        }
+    }
+
+    if (!handoffs.isEmpty() && !handingOff) {
+        writeLog(QString("Cluster: %1 groups to hand off").arg(handoffs.size()));
+        handOffNextGroup();
+    }
+}
+
+void MainWindow::handOffNextGroup() {
+    if (handoffs.isEmpty()) {
+        if (handingOff) {
+            writeLog("Cluster: hand-off done");
+        }
+        handingOff = false;
+        return;
+    }
+
+    handingOff = true;
+    QString group = handoffs.first();
+    QString owner = clusterRing.owner(group);
+
+    // The ring may have changed back, or the group may be gone.
+    if (owner == clusterSelf || localGroup(group).isEmpty()) {
+        handoffs.removeFirst();
+        handOffNextGroup();
+        return;
+    }
+
+    // Open uploads and moves between roots finish first; the group goes to the back of the line meanwhile.
+    PeerLink* link = clusterPeers.value(owner);
+    if (!link || !link->isConnected() || isGroupBusy(group) || movingGroups.contains(group.toLower())) {
+        handoffs.append(handoffs.takeFirst());
+        QTimer::singleShot(HandoffRetryInterval, this, &MainWindow::handOffNextGroup);
+        return;
+    }
+
+    // Writes are refused while the new owner copies the group; reads keep being served here.
+    movingGroups.insert(group.toLower());
+    writeLog(QString("Cluster: handing %1 to %2").arg(group, owner));
+    link->request(RequestClusterTransfer, QString("%1;%2;%3").arg(clusterSecret, group, clusterSelf).toUtf8(), [this, group, owner](QByteArray data) {
+        movingGroups.remove(group.toLower());
+
+        if (data.mid(0, 8).toInt() != ResponseClusterSuccess) {
+            QString reason = data.isEmpty() ? "connection lost" : QString::fromUtf8(data.mid(8));
+            logger->log(Logger::Warning, -1, QString(), "handoff", -1, QString("Cannot hand %1 to %2: %3").arg(group, owner, reason));
+            handoffs.removeAll(group);
+            handoffs.append(group);
+            QTimer::singleShot(HandoffRetryInterval, this, &MainWindow::handOffNextGroup);
+            return;
+        }
+
+        handoffs.removeAll(group);
+        dropGroup(group);
+        writeLog(QString("Cluster: handed %1 to %2").arg(group, owner));
+        handOffNextGroup();
+    });
+}
+
+void MainWindow::importMetadata() {
+    // Servers from before the journal kept users, groups and each group's members in INI files.
+    if (!metadata->isEmpty() || (!QFile::exists("database\\users.dat") && !QFile::exists("database\\groups.dat"))) {
+        return;
+    }
+
+    metadata->startTransaction();
+    metadata->import("users", "database\\users.dat");
+    metadata->import("groups", "database\\groups.dat");
+    foreach (const QString& group, metadata->table("groups")->allKeys()) {
+        metadata->import("members/" + group, "database\\" + group + ".group");
+    }
+    metadata->commitTransaction();
+    metadata->checkpoint();
+
+    qDebug() << "Metadata: imported" << metadata->table("users")->allKeys().size() << "users and" << metadata->table("groups")->allKeys().size() << "groups";
+}
+
+void MainWindow::dropGroup(const QString &group) {
+    QString folder = dataRoots->path(group);
+
+    metadata->startTransaction();
+    groups->remove(group);
+    MetadataTable* members = groupMembers.take(group);
+    if (members) {
+        metadata->drop(members->name());
+    }
+    dataRoots->remove(group);
+    metadata->commitTransaction();
+    contentIndex->remove(group);
+    nameIndex->remove(group);
+    touchGroup(group);
+
+    // Downloads that already opened the files keep reading them.
+    storage->remove(folder, nullptr, nullptr);
+}
+
+void MainWindow::reindexSubtree(const QString &target) {
+    struct Survivor {
+        QString path;
+        bool folder;
+        ContentIndex::Entry hash;
+    };
+
+    // Hashes of the surviving files are kept, as long as the files still match them, rather than taken again.
+    QString key = QDir::fromNativeSeparators(dataRoots->relative(target));
+    ContentIndex::Snapshot hashes = contentIndex->snapshot();
+    QSharedPointer<QList<Survivor>> found(new QList<Survivor>());
+    ioPool->run([target, key, hashes, found]() {
+        QFileInfo info(target);
+        if (!info.exists()) {
+            return;
+        }
+
+        QDir base(target);
+        QList<QFileInfo> infos({info});
+        if (info.isDir()) {
+            QDirIterator it(target, QDir::AllEntries | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                it.next();
+                infos.append(it.fileInfo());
+            }
+        }
+
+        foreach (const QFileInfo& entry, infos) {
+            Survivor survivor{entry.filePath(), entry.isDir(), ContentIndex::Entry{QString(), -1, -1}};
+            if (!survivor.folder) {
+                QString relative = entry.filePath() == target ? key : key + "/" + base.relativeFilePath(entry.filePath());
+                ContentIndex::Entry hash = hashes.value(relative, survivor.hash);
+                if (hash.matches(entry.filePath())) {
+                    survivor.hash = hash;
+                }
+            }
+            found->append(survivor);
+        }
+    }, this, [this, target, found]() {
+        contentIndex->remove(target);
+        nameIndex->remove(target);
+        foreach (const Survivor& survivor, *found) {
+            nameIndex->add(survivor.path, survivor.folder);
+            if (survivor.folder) {
+                continue;
+            }
+
+            if (!survivor.hash.hash.isEmpty()) {
+                contentIndex->add(survivor.path, survivor.hash);
+            } else {
+                contentIndex->index(survivor.path);
+            }
+        }
+    });
+}
+
+QSet<QString> MainWindow::incompleteUploads() const {
+    QSet<QString> incomplete;
+    foreach (const QString& path, partialUploads.keys()) {
+        incomplete.insert(dataRoots->relative(path));
+    }
+    foreach (Connection* connection, clients.keys()) {
+        if (connection->uploadFile()) {
+            incomplete.insert(dataRoots->relative(connection->uploadTarget()));
+        }
+    }
+    return incomplete;
+}
+
+QJsonArray MainWindow::listGroup(const QString &group, const QString &folder, const QSet<QString> &incomplete, const ContentIndex::Snapshot &hashes) {
+    QJsonArray events;
+    QDir root(folder);
+    QDirIterator it(folder, QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QString relative = group + "/" + root.relativeFilePath(it.filePath());
+        if (it.fileInfo().isDir()) {
+            events.append(QJsonObject({{"type", "folder"}, {"path", QDir::toNativeSeparators(relative)}}));
+        } else if (!incomplete.contains(relative)) {
+            QJsonObject event({{"type", "file"}, {"path", QDir::toNativeSeparators(relative)}});
+            ContentIndex::Snapshot::const_iterator entry = hashes.constFind(relative);
+            if (entry != hashes.constEnd() && entry->size == it.fileInfo().size() && entry->modified == it.fileInfo().lastModified().toMSecsSinceEpoch()) {
+                event.insert("hash", entry->hash);
+            }
+            events.append(event);
+        }
+    }
+    return events;
+}
+
+QString MainWindow::checkUploadSize(const QString &path, qint64 size) const {
+    if (maxUploadSize > 0 && size > maxUploadSize) {
+        return QString("Files larger than %1 bytes are not accepted").arg(maxUploadSize);
+    }
+
+    // The staging file reserves the whole size at once; a size the root cannot hold is refused before any of it.
+    QString group = QDir::fromNativeSeparators(path).section('/', 0, 0);
+    qint64 available = dataRoots->bytesAvailable(dataRoots->root(group));
+    if (available >= 0 && size > available) {
+        return "Not enough free space for the file";
+    }
+    return QString();
+}
+
+void MainWindow::expirePartialUploads() {
+    if (partialUploadTimeout <= 0) {
+        return;
+    }
+
+    qint64 now = Connection::now();
+    foreach (const QString& path, partialUploads.keys()) {
+        if (now - partialUploadActivity.value(path, now) < partialUploadTimeout) {
+            continue;
+        }
+
+        logger->log(Logger::Info, -1, partialUploads.value(path), "processUploadRange", -1, QString("Dropping abandoned upload of %1").arg(path));
+        partialUploads.remove(path);
+        partialUploadActivity.remove(path);
+        storage->remove(stagingPath(path), nullptr, nullptr);
+    }
+}
+
+QString MainWindow::stagingPath(const QString &path, const QString &key) const {
+    // On the group's root, so the final rename is atomic, but outside every group folder, so no listing sees it.
+    QString group = QDir::fromNativeSeparators(path).section('/', 0, 0);
+    QString name = key.isEmpty() ? QString(QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Md5).toHex()) : key;
+    return dataRoots->root(group) + QDir::separator() + UploadStagingFolder + QDir::separator() + name;
+}
+
+void MainWindow::openStaging(QSharedPointer<QFile> file, QIODevice::OpenMode mode, qint64 size, QObject *context, const std::function<void(bool)> &done) {
+    // The staging folder is created with the roots, so the open lands on the file's strand ahead of any later commit.
+    storage->open(file, mode, context, [this, file, size, context, done](bool opened) {
+        if (!opened || size <= 0) {
+            done(opened);
+            return;
+        }
+        storage->allocate(file, size, context, done);
+    });
+}
+
+void MainWindow::createStagingFolders() {
+    QStringList folders;
+    foreach (const QString& root, dataRoots->roots()) {
+        folders.append(root + QDir::separator() + UploadStagingFolder);
+    }
+
+    ioPool->run([folders]() {
+        foreach (const QString& folder, folders) {
+            QDir().mkpath(folder);
+        }
+    }, this, nullptr);
+}
+
+void MainWindow::touchGroup(const QString &path) {
+    groupVersions[groupOf(path)]++;
+}
+
+QString MainWindow::groupOf(const QString &path) const {
+    return dataRoots->relative(path).section('/', 0, 0).toLower();
+}
+
+QString MainWindow::checkMoving(const QString &path) const {
+    return movingGroups.contains(groupOf(path)) ? "The group is being moved, try again shortly" : QString();
+}
+
+bool MainWindow::isGroupBusy(const QString &group) const {
+    QString key = group.toLower();
+    foreach (const QString& path, partialUploads.keys()) {
+        if (groupOf(path) == key) {
+            return true;
+        }
+    }
+
+    foreach (Connection* connection, clients.keys()) {
+        if (connection->uploadFile() && groupOf(connection->uploadTarget()) == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MainWindow::onConfigChanged() {
+    config->sync();
+    updateCluster();
+
+    rateLimiter->configure(config);
+    metadata->configure(config);
+    storage->setDurability(Storage::durabilityFromString(config->value("storage/uploadSync", "file").toString()));
+    maxUploadSize = config->value("storage/maxUploadSize", 0).toLongLong();
+    partialUploadTimeout = config->value("storage/partialUploadTimeout", DefaultPartialUploadTimeout).toLongLong();
+    maxConnections = config->value("limits/maxConnections", 0).toInt();
+    maxHeavyRequests = config->value("limits/maxHeavyRequests", DefaultMaxHeavyRequests).toInt();
+
+    QStringList roots = config->value("storage/roots", QStringList() << DataRoots::DefaultRoot).toStringList();
+    QStringList previous = dataRoots->roots();
+    dataRoots->setRoots(roots);
+    if (dataRoots->roots() == previous) {
+        return;
+    }
+    createStagingFolders();
+
+    writeLog(QString("Data roots: %1").arg(dataRoots->roots().join(", ")));
+    if (config->value("storage/rebalance", true).toBool()) {
+        rebalance();
+    }
+}
+
+void MainWindow::rebalance() {
+    if (!groupMoves.isEmpty()) {
+        // Planned again once the moves in progress are done.
+        rebalancePending = true;
+        return;
+    }
+
+    rebalancePending = false;
+    groupMoves = dataRoots->plan();
+    if (!groupMoves.isEmpty()) {
+        writeLog(QString("Rebalancing: %1 groups to move").arg(groupMoves.size()));
+        moveNextGroup();
+    }
+}
+
+void MainWindow::moveNextGroup() {
+    if (groupMoves.isEmpty()) {
+        writeLog("Rebalancing: done");
+        if (rebalancePending) {
+            rebalance();
+        }
+        return;
+    }
+
+    QString group = groupMoves.first().first;
+    QString root = groupMoves.first().second;
+
+    // Open uploads hold files in the old location; wait until they are done.
+    if (isGroupBusy(group)) {
+        QTimer::singleShot(MoveRetryInterval, this, &MainWindow::moveNextGroup);
+        return;
+    }
+
+    QString source = dataRoots->root(group) + QDir::separator() + group;
+    QString target = root + QDir::separator() + group;
+    QString staging = root + QDir::separator() + "." + group + ".moving";
+    QSharedPointer<bool> moved(new bool(false));
+
+    // Writes are refused while the group is copied; reads keep using the old copy.
+    movingGroups.insert(group.toLower());
+    ioPool->run([source, target, staging, moved]() {
+        // Left behind by a move that was interrupted before its placement was saved.
+        QDir(staging).removeRecursively();
+        QDir(target).removeRecursively();
+
+        *moved = DataRoots::copyTree(source, staging) && QDir().rename(staging, target);
+        if (!*moved) {
+            QDir(staging).removeRecursively();
+        }
+    }, this, [this, group, root, source, moved]() {
+        groupMoves.removeFirst();
+        movingGroups.remove(group.toLower());
+
+        if (!*moved) {
+            logger->log(Logger::Warning, -1, QString(), "rebalance", -1, QString("Cannot move %1 to %2").arg(group, root));
+        } else {
+            dataRoots->move(group, root);
+            // Downloads that already opened the old files keep reading them.
+            storage->remove(source, nullptr, nullptr);
+            writeLog(QString("Rebalancing: moved %1 to %2").arg(group, root));
+        }
+
+        moveNextGroup();
+    });
+}
+
+QString MainWindow::authorize(Connection *sender, const QString &filePath) {
+    // Replicas and cluster nodes copy every group.
+    if (replicas.contains(sender) || clusterConnections.contains(sender)) {
+        return filePath.contains("..") ? "Invalid folder path" : QString();
+    }
+
+    QString user = clients.value(sender).second;
+    if (user.isEmpty()) {
+        return "You are not signed in";
+    }
+
+    if (!filePath.contains(QDir::separator()) || filePath.contains("..")) {
+        return "Invalid folder path";
+    }
+
+    QString groupName = filePath.left(filePath.indexOf(QDir::separator()));
+    if (!groups->allKeys().contains(groupName, Qt::CaseInsensitive)) {
+        return groupName + " not exist";
+    }
+
+    MetadataTable* members = groupMembers.value(groupName);
+    if (!members->allKeys().contains(user, Qt::CaseInsensitive)) {
+        return "Access denied";
+    }
+
+    return QString();
+}
+
+void MainWindow::startRequest(Connection *sender, int request) {
+    metrics->requestStarted(sender, request);
+    tracer->begin(sender, Metrics::requestName(request));
+}
+
+void MainWindow::finishRequest(Connection *connection, const QByteArray &response) {
+    QString slow = tracer->end(connection);
+    if (!slow.isEmpty()) {
+        writeLog(connection, "slowRequest", slow, Logger::Warning);
+    }
+    metrics->requestFinished(connection, response);
+    heavyRequests.remove(connection);
+}
+
+void MainWindow::sendTree(Connection *sender, const QString &user, QByteArray successCode) {
+    tracer->mark(sender, "handler");
+
+    FileTree::Roots roots;
+    {
+        Tracer::Scope scope(tracer, sender, "membership");
+        roots = FileTree::roots(groupMembers, user, dataRoots);
+    }
+
+    // Taken before the walk, so a change racing with it makes the tag stale rather than the tree.
+    QString tag = FileTree::tag(serverEpoch, roots, groupVersions);
+    ContentIndex::Snapshot hashes = contentIndex->snapshot();
+
+    // A cluster node only has its own groups; the client merges the trees of all nodes.
+    QString node = clusterSelf;
+    QJsonArray nodes = QJsonArray::fromStringList(clusterRing.nodes());
+
+    // Pool-side timestamps: submitted, started, tree built, serialized.
+    QSharedPointer<QVector<qint64>> marks(new QVector<qint64>(4, tracer->now()));
+    QSharedPointer<QByteArray> responseData(new QByteArray());
+    sender->pauseReading();
+    ioPool->run([tracer = tracer, roots, tag, hashes, node, nodes, responseData, marks]() {
+        (*marks)[1] = tracer->now();
+        QJsonObject tree = FileTree::build(roots, hashes);
+        tree.insert("etag", tag);
+        if (!node.isEmpty()) {
+            tree.insert("node", node);
+            tree.insert("nodes", nodes);
+        }
+        (*marks)[2] = tracer->now();
+        *responseData = QJsonDocument(tree).toJson(QJsonDocument::Compact);
+        (*marks)[3] = tracer->now();
+    }, sender, [this, sender, successCode, responseData, marks]() {
+        tracer->record(sender, "queue", marks->at(0), marks->at(1) - marks->at(0));
+        tracer->record(sender, "getData", marks->at(1), marks->at(2) - marks->at(1));
+        tracer->record(sender, "serialize", marks->at(2), marks->at(3) - marks->at(2));
+
+        responseData->prepend(successCode);
+        sendResponse(sender, *responseData);
+        sender->resumeReading();
+    });
+}
+
+void MainWindow::sendResponse(Connection *connection, QByteArray bytes) {
+    // Responses finish asynchronously, so the client may have gone in the meantime; the answer is dropped.
+    if (!connection || !connection->isOpen()) {
+        logger->log(Logger::Debug, -1, QString(), "sendResponse", -1, "Dropped a response for a closed connection");
+        return;
+    }
+
+    tracer->mark(connection, "handler");
+    {
+        Tracer::Scope scope(tracer, connection, "write");
+        connection->send(bytes);
+    }
+    finishRequest(connection, bytes);
+}
+
+void MainWindow::sendFile(Connection *connection, QString filePath, QByteArray successCode, QByteArray errorCode, qint64 offset, qint64 length) {
+    if (!connection || !connection->isOpen()) {
+        logger->log(Logger::Debug, -1, QString(), "sendFile", -1, "Dropped a download for a closed connection");
+        return;
+    }
+
+    QSharedPointer<QFile> file(new QFile(filePath));
+    tracer->mark(connection, "handler");
+    connection->pauseReading();
+    storage->open(file, QIODevice::ReadOnly, connection, [this, connection, file, successCode, errorCode, offset, length](bool opened) {
+        tracer->mark(connection, "open");
+        if (!connection->isOpen()) {
+            // Closed while the file was being opened; nothing to answer.
+            connection->resumeReading();
+            return;
+        }
+
+        if (opened) {
+            writeLog(connection, "sendFile", "OK!");
+
+            QFileInfo fileInfo(file->fileName());
+            QString fileName(fileInfo.fileName());
+
+            ContentIndex::Entry entry = contentIndex->entry(file->fileName());
+            QString hash = entry.matches(file->fileName()) ? entry.hash : QString();
+
+            // Range headers put the name last so that a long one is what gets cut
+            // off; whole-file headers keep "name,size" and add the hash if it fits.
+            QString fields;
+            if (length >= 0) {
+                fields = QString("%1,%2,%3").arg(file->size()).arg(hash, fileName);
+            } else {
+                fields = QString("%1,%2").arg(fileName).arg(file->size());
+                if (!hash.isEmpty() && (fields + "," + hash).toUtf8().size() <= 128) {
+                    fields += "," + hash;
+                }
+            }
+
+            QByteArray header;
+            header.prepend(fields.toUtf8());
+            header.resize(128);
+            header.prepend(successCode);
+
+            {
+                Tracer::Scope scope(tracer, connection, "write");
+                connection->sendFile(header, file, offset, length);
+            }
+            finishRequest(connection, successCode);
+        } else {
+            QString msg = "Couldn't open the file";
+            writeLog(connection, "sendFile", msg, Logger::Warning);
+
+            QByteArray byteArray = msg.toUtf8();
+            byteArray.prepend(errorCode);
+            sendResponse(connection, byteArray);
+        }
+        connection->resumeReading();
+    });
 }
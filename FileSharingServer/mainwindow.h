@@ -4,6 +4,7 @@
 #include <QMainWindow>
 #include <QSettings>
 #include <QStringListModel>
+#include <QHash>
 #include <QMap>
 #include <QPair>
 #include <QTcpServer>
@@ -13,6 +14,24 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QRegExp>
+#include <QSet>
+
+#include "connection.h"
+#include "contentindex.h"
+#include "dataroots.h"
+#include "hashring.h"
+#include "iopool.h"
+#include "logger.h"
+#include "metadatastore.h"
+#include "metrics.h"
+#include "nameindex.h"
+#include "peerlink.h"
+#include "ratelimiter.h"
+#include "replicaclient.h"
+#include "replicationlog.h"
+#include "storage.h"
+#include "timerwheel.h"
+#include "tracer.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -29,40 +48,171 @@ public:
 
 private slots:
     void writeLog(const QString &log);
+    void writeLog(Connection *sender, const QString &op, const QString &result, Logger::Level level = Logger::Info);
+    void refreshLog();
 
     void newClientConnection();
-    void onClientDisconnected();
+    void addClient(Connection *connection);
+    void onClientDisconnected(Connection *connection);
+    qint64 connectionDeadline(Connection *connection) const;
+    void onConnectionExpired(Connection *connection);
     void onErrorOccurred(QAbstractSocket::SocketError error);
-    void onClientReadyRead();
-
-    void handleMessage(QTcpSocket *sender, QByteArray bytes);
-    void processSignIn(QTcpSocket *sender, QByteArray bytes);
-    void processSignUp(QTcpSocket *sender, QByteArray bytes);
-    void processSignOut(QTcpSocket *sender, QByteArray bytes);
-    void processGet(QTcpSocket *sender, QByteArray bytes);
-    void processCreateGroup(QTcpSocket *sender, QByteArray bytes);
-    void processJoinGroup(QTcpSocket *sender, QByteArray bytes);
-    void processCreateFolder(QTcpSocket *sender, QByteArray bytes);
-    void processUploadFile(QTcpSocket *sender, QByteArray bytes);
-    void processDownloadFile(QTcpSocket *sender, QByteArray bytes);
-    void processDelete(QTcpSocket *sender, QByteArray bytes);
-
-    QJsonObject getData(const QString &path, const QString &leader);
-    void sendResponse(QTcpSocket *socket, QByteArray bytes);
-    void sendFile(QTcpSocket *socket, QString filePath);
-
-    bool isValidGroupName(const QString& groupName);
+
+    void handleMessage(Connection *sender, QByteArray bytes);
+    void processSignIn(Connection *sender, QByteArray bytes);
+    void processSignUp(Connection *sender, QByteArray bytes);
+    void processSignOut(Connection *sender, QByteArray bytes);
+    void processGet(Connection *sender, QByteArray bytes);
+    void processCreateGroup(Connection *sender, QByteArray bytes);
+    void processJoinGroup(Connection *sender, QByteArray bytes);
+    void processCreateFolder(Connection *sender, QByteArray bytes);
+    void onUploadStarted(Connection *sender, QByteArray bytes, qint64 size);
+    void processUploadFile(Connection *sender, QByteArray bytes, qint64 size);
+    void processUploadData(Connection *sender, QByteArray bytes);
+    void processUploadFinished(Connection *sender);
+    void failUpload(Connection *sender, QSharedPointer<QFile> file);
+    void processDownloadFile(Connection *sender, QByteArray bytes);
+    void processDelete(Connection *sender, QByteArray bytes);
+    void processStats(Connection *sender, QByteArray bytes);
+    void processDownloadRange(Connection *sender, QByteArray bytes);
+    void processUploadRange(Connection *sender, QByteArray bytes);
+    void processUploadCancel(Connection *sender, QByteArray bytes);
+    void processUploadHash(Connection *sender, QByteArray bytes);
+    void processReplicate(Connection *sender, QByteArray bytes);
+    void processClusterUsers(Connection *sender, QByteArray bytes);
+    void processClusterGroup(Connection *sender, QByteArray bytes);
+    void processClusterTransfer(Connection *sender, QByteArray bytes);
+    void processPing(Connection *sender, QByteArray bytes);
+    void processSearch(Connection *sender, QByteArray bytes);
+    bool throttle(Connection *sender, int request);
+    void sendRetryLater(Connection *sender, qint64 delay, const QString &msg);
+    static bool isHeavyRequest(int request);
+    static bool isTransferRequest(int request);
+    QString authorize(Connection *sender, const QString &filePath);
+    void touchGroup(const QString &path);
+    QString groupOf(const QString &path) const;
+    QString checkMoving(const QString &path) const;
+    bool isGroupBusy(const QString &group) const;
+
+    void replicate(const QJsonObject &event);
+    void answerReplicas(bool heartbeat = false);
+    void sendReplicationBatch(Connection *sender);
+    void startReplicationSnapshot(Connection *sender);
+    void sendReplicationSnapshot(Connection *sender, int page);
+    bool redirectWrite(Connection *sender, int request);
+    void applyReplicationEvent(const QJsonObject &event, const std::function<void()> &done);
+    void applyReplicatedFile(PeerLink *source, const QString &path, const QString &hash, const std::function<void(bool)> &done);
+    void finishReplicationSnapshot(const std::function<void()> &done);
+    void reindexSubtree(const QString &target);
+    QSet<QString> incompleteUploads() const;
+    QString stagingPath(const QString &path, const QString &key = QString()) const;
+    QString checkUploadSize(const QString &path, qint64 size) const;
+    void expirePartialUploads();
+    void writeUploadRange(Connection *sender, const QString &filePath, const QString &target, qint64 offset, qint64 total, const QByteArray &data);
+    void openStaging(QSharedPointer<QFile> file, QIODevice::OpenMode mode, qint64 size, QObject *context, const std::function<void(bool)> &done);
+    void createStagingFolders();
+    static QJsonArray listGroup(const QString &group, const QString &folder, const QSet<QString> &incomplete, const ContentIndex::Snapshot &hashes);
+
+    QString checkCluster(Connection *sender, const QString &secret);
+    QString localGroup(const QString &group) const;
+    static QString requestGroup(int request, const QByteArray &bytes);
+    bool redirectGroup(Connection *sender, int request, const QByteArray &bytes);
+    void updateCluster();
+    void pushUsers(const QJsonObject &accounts, PeerLink *peer = nullptr);
+    void handOffGroups();
+    void handOffNextGroup();
+    void importMetadata();
+    void dropGroup(const QString &group);
+    void pullGroupEntries(PeerLink *source, const QString &group, QSharedPointer<QJsonArray> entries, int index, const std::function<void(bool)> &done);
+
+    void onConfigChanged();
+    void rebalance();
+    void moveNextGroup();
+
+    void startRequest(Connection *sender, int request);
+    void finishRequest(Connection *connection, const QByteArray &response);
+    void sendTree(Connection *sender, const QString &user, QByteArray successCode);
+    void sendResponse(Connection *connection, QByteArray bytes);
+    void sendFile(Connection *connection, QString filePath, QByteArray successCode, QByteArray errorCode, qint64 offset = 0, qint64 length = -1);
 
 private:
+    static constexpr int MoveRetryInterval = 1000;
+    static constexpr int ReplicationBatchSize = 1000;
+    static constexpr int ReplicationHeartbeat = 10000;
+    static constexpr int HandoffRetryInterval = 5000;
+    static constexpr qint64 DefaultIdleTimeout = 90000;
+    static constexpr qint64 DefaultHandshakeTimeout = 10000;
+    static constexpr qint64 DefaultHeartbeatInterval = 30000;
+    static constexpr int DefaultMaxHeavyRequests = 64;
+    static constexpr int OverloadRetryDelay = 1000;
+    static constexpr int HeavyRetryDelay = 250;
+    static constexpr const char* UploadStagingFolder = ".uploads";
+    static constexpr const char* ReplicaStagingFolder = ".replica";
+    static constexpr qint64 DefaultPartialUploadTimeout = 3600000;
+    static constexpr int PartialUploadCheckInterval = 60000;
+
+    // What the primary knows about each connected replica.
+    struct ReplicaState {
+        quint64 position;
+        bool waiting;
+        QSharedPointer<QJsonArray> snapshot;
+        quint64 snapshotBase;
+    };
+
     Ui::MainWindow *ui;
 
-    QSettings *users;
-    QSettings *groups;
-    QMap<QString, QSettings*> groupMembers;
+    QSettings *config;
+    MetadataStore *metadata;
+    MetadataTable *users;
+    MetadataTable *groups;
+    QMap<QString, MetadataTable*> groupMembers;
+    QHash<QString, quint64> groupVersions;
+    QByteArray serverEpoch;
 
+    Logger *logger;
     QStringListModel *model;
+    quint64 logSequence;
     QTcpServer *server;
-    QMap<QTcpSocket*, QPair<qint64, QString>> clients;
+    IoPool *ioPool;
+    Storage *storage;
+    DataRoots *dataRoots;
+    ContentIndex *contentIndex;
+    NameIndex *nameIndex;
+    Metrics *metrics;
+    Tracer *tracer;
+    QMap<Connection*, QPair<qint64, QString>> clients;
+    QMap<QString, QString> partialUploads;
+    QHash<QString, qint64> partialUploadActivity;
+    qint64 maxUploadSize;
+    qint64 partialUploadTimeout;
+    DataRoots::Moves groupMoves;
+    QSet<QString> movingGroups;
+    bool rebalancePending;
+    ReplicationLog *replicationLog;
+    QHash<Connection*, ReplicaState> replicas;
+    ReplicaClient *replica;
+    QSet<QString> replicaSeen;
+    bool replicaSnapshotting;
+    HashRing clusterRing;
+    QString clusterSelf;
+    QString clusterSecret;
+    QHash<QString, PeerLink*> clusterPeers;
+    QSet<Connection*> clusterConnections;
+    QStringList handoffs;
+    bool handingOff;
+    TimerWheel *idleWheel;
+    qint64 idleTimeout;
+    qint64 handshakeTimeout;
+    qint64 heartbeatInterval;
+    quint64 connectionsReaped;
+    RateLimiter *rateLimiter;
+    int maxConnections;
+    int maxHeavyRequests;
+    QSet<Connection*> overCapacity;
+    QSet<Connection*> heavyRequests;
+    QHash<Connection*, qint64> bytesCharged;
+    QHash<Connection*, qint64> refusedUntil;
+    quint64 requestsThrottled;
 };
 
 #endif // MAINWINDOW_H
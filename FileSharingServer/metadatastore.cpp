@@ -0,0 +1,421 @@
+#include "metadatastore.h"
+
+#include <QDebug>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QtEndian>
+
+MetadataTable::MetadataTable(MetadataStore* store, const QString& name) : store(store), m_name(name) {
+}
+
+QString MetadataTable::name() const {
+    return m_name;
+}
+
+QStringList MetadataTable::allKeys() const {
+    return store->tables.value(m_name).keys();
+}
+
+bool MetadataTable::contains(const QString& key) const {
+    return store->tables.value(m_name).contains(key);
+}
+
+QVariant MetadataTable::value(const QString& key, const QVariant& defaultValue) const {
+    QMap<QString, QMap<QString, QString>>::const_iterator table = store->tables.constFind(m_name);
+    if (table == store->tables.constEnd()) {
+        return defaultValue;
+    }
+
+    QMap<QString, QString>::const_iterator it = table.value().constFind(key);
+    return it != table.value().constEnd() ? QVariant(it.value()) : defaultValue;
+}
+
+void MetadataTable::setValue(const QString& key, const QVariant& value) {
+    QString text = value.toString();
+    QMap<QString, QMap<QString, QString>>::const_iterator table = store->tables.constFind(m_name);
+    if (table != store->tables.constEnd() && table.value().contains(key) && table.value().value(key) == text) {
+        return;
+    }
+
+    store->record(QJsonObject({{"op", "set"}, {"table", m_name}, {"key", key}, {"value", text}}));
+}
+
+void MetadataTable::remove(const QString& key) {
+    if (!contains(key)) {
+        return;
+    }
+
+    store->record(QJsonObject({{"op", "remove"}, {"table", m_name}, {"key", key}}));
+}
+
+void MetadataTable::clear() {
+    store->record(QJsonObject({{"op", "clear"}, {"table", m_name}}));
+}
+
+MetadataStore::MetadataStore(const QString& journalName, const QString& snapshotName, IoPool* pool, QObject* parent) : QObject(parent), journalName(journalName), snapshotName(snapshotName), pool(pool) {
+    journal = new QFile(journalName, this);
+    transactionDepth = 0;
+    m_sequence = 0;
+    flushing = false;
+    committing = false;
+    checkpointPending = false;
+    journalBytes = 0;
+    checkpointSize = DefaultCheckpointSize;
+    m_commits = 0;
+
+    // Changes made within the delay go out with one fsync.
+    commitTimer = new QTimer(this);
+    commitTimer->setSingleShot(true);
+    commitTimer->setInterval(DefaultCommitDelay);
+    connect(commitTimer, &QTimer::timeout, this, &MetadataStore::flush);
+
+    checkpointTimer = new QTimer(this);
+    connect(checkpointTimer, &QTimer::timeout, this, [this]() {
+        if (journalBytes > 0 || !buffer.isEmpty()) {
+            checkpoint();
+        }
+    });
+    checkpointTimer->start(DefaultCheckpointInterval);
+}
+
+MetadataStore::~MetadataStore() {
+    // The I/O pool has finished its jobs by now; whatever is still buffered is written here.
+    if (!buffer.isEmpty() && journal->isOpen()) {
+        journal->write(buffer);
+        IoPool::sync(journal);
+    }
+
+    qDeleteAll(handles);
+}
+
+MetadataStore* MetadataStore::create(QSettings* config, IoPool* pool, QObject* parent) {
+    MetadataStore* store = new MetadataStore("database\\metadata.journal", "database\\metadata.snapshot", pool, parent);
+    store->configure(config);
+    return store;
+}
+
+void MetadataStore::configure(QSettings* config) {
+    commitTimer->setInterval(qMax(0, config->value("metadata/commitDelay", DefaultCommitDelay).toInt()));
+    checkpointSize = config->value("metadata/checkpointSize", DefaultCheckpointSize).toLongLong();
+
+    int interval = config->value("metadata/checkpointInterval", DefaultCheckpointInterval).toInt();
+    if (interval > 0) {
+        checkpointTimer->start(interval);
+    } else {
+        checkpointTimer->stop();
+    }
+}
+
+bool MetadataStore::open() {
+    QFile snapshot(snapshotName);
+    if (snapshot.exists()) {
+        if (!snapshot.open(QIODevice::ReadOnly)) {
+            m_errorString = QString("%1: %2").arg(snapshotName, snapshot.errorString());
+            return false;
+        }
+
+        // The snapshot is replaced atomically, so a damaged one is not a crash artifact and is not skipped.
+        QJsonParseError error;
+        QJsonDocument document = QJsonDocument::fromJson(snapshot.readAll(), &error);
+        if (error.error != QJsonParseError::NoError || !document.isObject()) {
+            m_errorString = QString("%1: %2").arg(snapshotName, error.errorString());
+            return false;
+        }
+
+        QJsonObject image = document.object();
+        m_sequence = image.value("sequence").toVariant().toULongLong();
+        QJsonObject content = image.value("tables").toObject();
+        for (QJsonObject::const_iterator table = content.constBegin(); table != content.constEnd(); ++table) {
+            QMap<QString, QString>& entries = tables[table.key()];
+            QJsonObject values = table.value().toObject();
+            for (QJsonObject::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+                entries.insert(it.key(), it.value().toString());
+            }
+        }
+    }
+
+    if (!journal->open(QIODevice::ReadWrite | QIODevice::Append | QIODevice::Unbuffered)) {
+        m_errorString = QString("%1: %2").arg(journalName, journal->errorString());
+        return false;
+    }
+
+    journal->seek(0);
+    QByteArray contents = journal->readAll();
+    qint64 offset = 0;
+    int replayed = 0;
+    while (contents.size() - offset >= 8) {
+        quint32 length = qFromBigEndian<quint32>(contents.constData() + offset);
+        quint32 sum = qFromBigEndian<quint32>(contents.constData() + offset + 4);
+        if (length > quint64(contents.size() - offset - 8)) {
+            break;
+        }
+
+        QByteArray payload = contents.mid(offset + 8, length);
+        if (checksum(payload) != sum) {
+            break;
+        }
+
+        // Records already folded into the snapshot are left over from a checkpoint interrupted before the truncate.
+        QJsonObject record = QJsonDocument::fromJson(payload).object();
+        quint64 sequence = record.value("sequence").toVariant().toULongLong();
+        if (sequence > m_sequence) {
+            foreach (const QJsonValue& op, record.value("ops").toArray()) {
+                apply(op.toObject());
+            }
+            m_sequence = sequence;
+            replayed++;
+        }
+        offset += 8 + length;
+    }
+
+    if (offset < contents.size()) {
+        qWarning() << "Metadata journal: dropping" << contents.size() - offset << "bytes of a torn record";
+        if (!journal->resize(offset) || !IoPool::sync(journal)) {
+            m_errorString = QString("%1: %2").arg(journalName, journal->errorString());
+            return false;
+        }
+    }
+
+    journalBytes = offset;
+    qDebug() << "Metadata journal: replayed" << replayed << "records up to" << m_sequence;
+    return true;
+}
+
+QString MetadataStore::errorString() const {
+    return m_errorString;
+}
+
+bool MetadataStore::isEmpty() const {
+    return tables.isEmpty() && m_sequence == 0;
+}
+
+MetadataTable* MetadataStore::table(const QString& name) {
+    MetadataTable* handle = handles.value(name);
+    if (!handle) {
+        handle = new MetadataTable(this, name);
+        handles.insert(name, handle);
+    }
+    return handle;
+}
+
+void MetadataStore::drop(const QString& name) {
+    if (tables.contains(name)) {
+        record(QJsonObject({{"op", "drop"}, {"table", name}}));
+    }
+}
+
+void MetadataStore::import(const QString& name, const QString& fileName) {
+    QSettings settings(fileName, QSettings::IniFormat);
+    MetadataTable* target = table(name);
+    foreach (const QString& key, settings.allKeys()) {
+        target->setValue(key, settings.value(key));
+    }
+}
+
+void MetadataStore::startTransaction() {
+    transactionDepth++;
+}
+
+void MetadataStore::commitTransaction() {
+    if (transactionDepth > 0 && --transactionDepth > 0) {
+        return;
+    }
+    if (transaction.isEmpty()) {
+        return;
+    }
+
+    m_sequence++;
+    QJsonObject record({{"sequence", double(m_sequence)}, {"ops", transaction}});
+    transaction = QJsonArray();
+    buffer.append(frame(QJsonDocument(record).toJson(QJsonDocument::Compact)));
+
+    if (!commitTimer->isActive()) {
+        commitTimer->start();
+    }
+}
+
+void MetadataStore::whenDurable(QObject* context, const std::function<void()>& done) {
+    if (!buffer.isEmpty()) {
+        waiters.append(Waiter{context, done});
+    } else if (committing) {
+        inFlight.append(Waiter{context, done});
+    } else {
+        done();
+    }
+}
+
+void MetadataStore::checkpoint() {
+    checkpointPending = true;
+    flush();
+}
+
+quint64 MetadataStore::sequence() const {
+    return m_sequence;
+}
+
+qint64 MetadataStore::journalSize() const {
+    return journalBytes + buffer.size();
+}
+
+quint64 MetadataStore::commits() const {
+    return m_commits;
+}
+
+void MetadataStore::record(const QJsonObject& op) {
+    apply(op);
+    transaction.append(op);
+    if (transactionDepth == 0) {
+        commitTransaction();
+    }
+}
+
+void MetadataStore::apply(const QJsonObject& op) {
+    QString type = op.value("op").toString();
+    QString name = op.value("table").toString();
+
+    if (type == "set") {
+        tables[name].insert(op.value("key").toString(), op.value("value").toString());
+    } else if (type == "remove") {
+        tables[name].remove(op.value("key").toString());
+    } else if (type == "clear") {
+        tables[name].clear();
+    } else if (type == "drop") {
+        tables.remove(name);
+    }
+}
+
+void MetadataStore::flush() {
+    // Records that arrive while a write is running go out together once it is done.
+    if (flushing) {
+        return;
+    }
+    if (buffer.isEmpty()) {
+        if (checkpointPending) {
+            writeCheckpoint();
+        }
+        return;
+    }
+
+    commitTimer->stop();
+    flushing = true;
+    committing = true;
+    QByteArray batch = buffer;
+    buffer.clear();
+    inFlight = waiters;
+    waiters.clear();
+
+    QFile* file = journal;
+    qint64 start = journalBytes;
+    QSharedPointer<QString> error(new QString());
+    pool->run(this, [file, batch, start, error]() {
+        if (file->write(batch) == batch.size() && IoPool::sync(file)) {
+            return;
+        }
+
+        // A partly written batch would hide every record appended after it from replay.
+        *error = file->errorString();
+        file->resize(start);
+    }, this, [this, batch, error]() {
+        flushing = false;
+        committing = false;
+
+        if (!error->isEmpty()) {
+            buffer.prepend(batch);
+            waiters = inFlight + waiters;
+            inFlight.clear();
+            emit failed(QString("Writing %1 failed, retrying: %2").arg(journalName, *error));
+            commitTimer->start(RetryDelay);
+            return;
+        }
+
+        journalBytes += batch.size();
+        m_commits++;
+        if (checkpointSize > 0 && journalBytes >= checkpointSize) {
+            checkpointPending = true;
+        }
+
+        QList<Waiter> durable = inFlight;
+        inFlight.clear();
+        release(durable);
+        flush();
+    });
+}
+
+void MetadataStore::writeCheckpoint() {
+    checkpointPending = false;
+    flushing = true;
+
+    QJsonObject content;
+    for (QMap<QString, QMap<QString, QString>>::const_iterator table = tables.constBegin(); table != tables.constEnd(); ++table) {
+        QJsonObject values;
+        for (QMap<QString, QString>::const_iterator it = table.value().constBegin(); it != table.value().constEnd(); ++it) {
+            values.insert(it.key(), it.value());
+        }
+        content.insert(table.key(), values);
+    }
+    QByteArray image = QJsonDocument(QJsonObject({{"sequence", double(m_sequence)}, {"tables", content}})).toJson(QJsonDocument::Compact);
+
+    QFile* file = journal;
+    QString name = snapshotName;
+    QSharedPointer<QString> error(new QString());
+    pool->run(this, [file, name, image, error]() {
+        QSaveFile snapshot(name);
+        if (!snapshot.open(QIODevice::WriteOnly) || snapshot.write(image) != image.size() || !snapshot.commit()) {
+            *error = QString("%1: %2").arg(name, snapshot.errorString());
+            return;
+        }
+
+        // A crash before the truncate replays records the snapshot already holds, which the sequence check skips.
+        if (!file->resize(0) || !IoPool::sync(file)) {
+            *error = QString("%1: %2").arg(file->fileName(), file->errorString());
+        }
+    }, this, [this, error]() {
+        flushing = false;
+
+        if (!error->isEmpty()) {
+            emit failed(QString("Checkpoint failed: %1").arg(*error));
+        } else {
+            journalBytes = 0;
+        }
+        flush();
+    });
+}
+
+void MetadataStore::release(const QList<Waiter>& waiters) {
+    foreach (const Waiter& waiter, waiters) {
+        if (waiter.context) {
+            waiter.done();
+        }
+    }
+}
+
+QByteArray MetadataStore::frame(const QByteArray& payload) {
+    QByteArray record(8, '\0');
+    qToBigEndian<quint32>(quint32(payload.size()), record.data());
+    qToBigEndian<quint32>(checksum(payload), record.data() + 4);
+    record.append(payload);
+    return record;
+}
+
+quint32 MetadataStore::checksum(const QByteArray& data) {
+    // CRC-32 (IEEE), enough to tell a record cut short or half-written by a crash.
+    static quint32 table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (quint32 i = 0; i < 256; i++) {
+            quint32 value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            table[i] = value;
+        }
+        ready = true;
+    }
+
+    quint32 crc = 0xFFFFFFFFu;
+    for (int i = 0; i < data.size(); i++) {
+        crc = table[(crc ^ quint8(data.at(i))) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
@@ -0,0 +1,131 @@
+#ifndef METADATASTORE_H
+#define METADATASTORE_H
+
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QPointer>
+#include <QSettings>
+#include <QStringList>
+#include <QTimer>
+#include <QVariant>
+
+#include <functional>
+
+#include "iopool.h"
+
+class MetadataStore;
+
+// One table of the metadata store, such as "users" or the members of a group.
+// It offers the part of the QSettings interface the server used before the
+// journal, so call sites read the same. Handles are owned by the store and stay
+// valid after the table is dropped.
+class MetadataTable {
+public:
+    MetadataTable(MetadataStore* store, const QString& name);
+
+    QString name() const;
+    QStringList allKeys() const;
+    bool contains(const QString& key) const;
+    QVariant value(const QString& key, const QVariant& defaultValue = QVariant()) const;
+    void setValue(const QString& key, const QVariant& value);
+    void remove(const QString& key);
+    void clear();
+
+private:
+    MetadataStore* store;
+    QString m_name;
+};
+
+// Users, groups, memberships, group placements and the content index, kept in
+// memory and made durable through a write-ahead journal. Every change is
+// appended as a checksummed record; changes made between startTransaction()
+// and commitTransaction() share one record, so they survive a crash together
+// or not at all. Records are written and fsynced in batches on the I/O pool:
+// whatever arrives while one fsync is running goes out with the next. The
+// journal is folded into a snapshot now and then, and on startup the snapshot
+// is loaded and the journal after it replayed, dropping a record torn by a
+// crash.
+class MetadataStore : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultCommitDelay = 2;
+    static constexpr int DefaultCheckpointInterval = 300000;
+    static constexpr qint64 DefaultCheckpointSize = 4 * 1024 * 1024;
+    static constexpr int RetryDelay = 1000;
+
+    MetadataStore(const QString& journalName, const QString& snapshotName, IoPool* pool, QObject* parent = nullptr);
+    ~MetadataStore();
+
+    static MetadataStore* create(QSettings* config, IoPool* pool, QObject* parent = nullptr);
+
+    void configure(QSettings* config);
+    bool open();
+    QString errorString() const;
+    bool isEmpty() const;
+
+    MetadataTable* table(const QString& name);
+    void drop(const QString& name);
+    void import(const QString& name, const QString& fileName);
+
+    void startTransaction();
+    void commitTransaction();
+    void whenDurable(QObject* context, const std::function<void()>& done);
+    void checkpoint();
+
+    quint64 sequence() const;
+    qint64 journalSize() const;
+    quint64 commits() const;
+
+signals:
+    void failed(QString message);
+
+private:
+    friend class MetadataTable;
+
+    struct Waiter {
+        QPointer<QObject> context;
+        std::function<void()> done;
+    };
+
+    void record(const QJsonObject& op);
+    void apply(const QJsonObject& op);
+    void flush();
+    void writeCheckpoint();
+    void release(const QList<Waiter>& waiters);
+
+    static QByteArray frame(const QByteArray& payload);
+    static quint32 checksum(const QByteArray& data);
+
+    QString journalName;
+    QString snapshotName;
+    IoPool* pool;
+    QFile* journal;
+    QString m_errorString;
+
+    QMap<QString, QMap<QString, QString>> tables;
+    QHash<QString, MetadataTable*> handles;
+
+    int transactionDepth;
+    QJsonArray transaction;
+    quint64 m_sequence;
+
+    QByteArray buffer;
+    QList<Waiter> waiters;
+    QList<Waiter> inFlight;
+    bool flushing;
+    bool committing;
+    bool checkpointPending;
+    qint64 journalBytes;
+    qint64 checkpointSize;
+    quint64 m_commits;
+    QTimer* commitTimer;
+    QTimer* checkpointTimer;
+};
+
+#endif // METADATASTORE_H
@@ -0,0 +1,247 @@
+#include "metrics.h"
+
+#include <QTcpSocket>
+#include <QTextStream>
+
+#include "structs.h"
+
+Metrics::Metrics(QObject* parent) : QObject(parent) {
+    closedBytesReceived = 0;
+    closedBytesSent = 0;
+    server = nullptr;
+    uptime.start();
+
+    Histogram empty;
+    empty.buckets.fill(0, bucketBounds().size());
+    empty.count = 0;
+    empty.errors = 0;
+    empty.sum = 0;
+    histograms.fill(empty, RequestSearch + 1);
+}
+
+bool Metrics::listen(quint16 port) {
+    server = new QTcpServer(this);
+    connect(server, &QTcpServer::newConnection, this, &Metrics::onScrapeConnection);
+    return server->listen(QHostAddress::LocalHost, port);
+}
+
+QString Metrics::errorString() const {
+    return server ? server->errorString() : QString();
+}
+
+void Metrics::setGauges(const std::function<QVector<Gauge>()>& provider) {
+    gauges = provider;
+}
+
+void Metrics::addEndpoint(const QByteArray& path, const QByteArray& contentType, const std::function<QByteArray()>& render) {
+    Endpoint endpoint;
+    endpoint.contentType = contentType;
+    endpoint.render = render;
+    endpoints.insert(path, endpoint);
+}
+
+void Metrics::connectionOpened(Connection* connection) {
+    connections.insert(connection);
+}
+
+void Metrics::connectionClosed(Connection* connection) {
+    if (connections.remove(connection)) {
+        closedBytesReceived += connection->bytesReceived();
+        closedBytesSent += connection->bytesSent();
+    }
+    pending.remove(connection);
+}
+
+void Metrics::requestStarted(Connection* connection, int request) {
+    if (request < 0 || request >= histograms.size()) {
+        return;
+    }
+
+    Pending& entry = pending[connection];
+    entry.request = request;
+    entry.timer.start();
+}
+
+void Metrics::requestFinished(Connection* connection, const QByteArray& response) {
+    QHash<Connection*, Pending>::iterator it = pending.find(connection);
+    if (it == pending.end()) {
+        return;
+    }
+
+    // Only the leading digits of the 8-byte code field are meaningful.
+    int code = 0;
+    for (int i = 0; i < qMin(8, response.size()) && response[i] >= '0' && response[i] <= '9'; i++) {
+        code = code * 10 + (response[i] - '0');
+    }
+
+    qint64 elapsed = it->timer.nsecsElapsed() / 1000;
+    Histogram& histogram = histograms[it->request];
+    pending.erase(it);
+
+    const QVector<qint64>& bounds = bucketBounds();
+    for (int i = 0; i < bounds.size(); i++) {
+        if (elapsed <= bounds[i]) {
+            histogram.buckets[i]++;
+            break;
+        }
+    }
+    histogram.count++;
+    histogram.sum += elapsed;
+
+    // Every error response code is even, every success code odd.
+    if (code % 2 == 0) {
+        histogram.errors++;
+    }
+}
+
+qint64 Metrics::requestElapsed(Connection* connection) const {
+    QHash<Connection*, Pending>::const_iterator it = pending.constFind(connection);
+    return it == pending.constEnd() ? -1 : it->timer.nsecsElapsed() / 1000;
+}
+
+const QVector<qint64>& Metrics::bucketBounds() {
+    static const QVector<qint64> bounds = {
+        500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+    };
+    return bounds;
+}
+
+QByteArray Metrics::requestName(int request) {
+    switch (request) {
+        case RequestNone: return "none";
+        case RequestSignIn: return "sign_in";
+        case RequestSignUp: return "sign_up";
+        case RequestSignOut: return "sign_out";
+        case RequestGet: return "get";
+        case RequestCreateGroup: return "create_group";
+        case RequestJoinGroup: return "join_group";
+        case RequestCreateFolder: return "create_folder";
+        case RequestUploadFile: return "upload_file";
+        case RequestDownloadFile: return "download_file";
+        case RequestDelete: return "delete";
+        case RequestStats: return "stats";
+        case RequestDownloadRange: return "download_range";
+        case RequestUploadRange: return "upload_range";
+        case RequestUploadCancel: return "upload_cancel";
+        case RequestUploadHash: return "upload_hash";
+        case RequestReplicate: return "replicate";
+        case RequestClusterUsers: return "cluster_users";
+        case RequestClusterGroup: return "cluster_group";
+        case RequestClusterTransfer: return "cluster_transfer";
+        case RequestPing: return "ping";
+        case RequestSearch: return "search";
+    }
+    return QByteArray::number(request);
+}
+
+QByteArray Metrics::render() const {
+    QByteArray text;
+    QTextStream out(&text);
+
+    out << "# HELP fileshare_requests_total Requests answered, by request type and outcome.\n";
+    out << "# TYPE fileshare_requests_total counter\n";
+    for (int i = 0; i < histograms.size(); i++) {
+        const Histogram& histogram = histograms[i];
+        QByteArray name = requestName(i);
+        out << "fileshare_requests_total{request=\"" << name << "\",status=\"success\"} " << histogram.count - histogram.errors << "\n";
+        out << "fileshare_requests_total{request=\"" << name << "\",status=\"error\"} " << histogram.errors << "\n";
+    }
+
+    const QVector<qint64>& bounds = bucketBounds();
+    out << "# HELP fileshare_request_duration_seconds Time from receiving a request to queueing its response.\n";
+    out << "# TYPE fileshare_request_duration_seconds histogram\n";
+    for (int i = 0; i < histograms.size(); i++) {
+        const Histogram& histogram = histograms[i];
+        QByteArray name = requestName(i);
+        quint64 cumulative = 0;
+        for (int b = 0; b < bounds.size(); b++) {
+            cumulative += histogram.buckets[b];
+            out << "fileshare_request_duration_seconds_bucket{request=\"" << name << "\",le=\"" << QByteArray::number(bounds[b] / 1e6) << "\"} " << cumulative << "\n";
+        }
+        out << "fileshare_request_duration_seconds_bucket{request=\"" << name << "\",le=\"+Inf\"} " << histogram.count << "\n";
+        out << "fileshare_request_duration_seconds_sum{request=\"" << name << "\"} " << QByteArray::number(histogram.sum / 1e6, 'f', 6) << "\n";
+        out << "fileshare_request_duration_seconds_count{request=\"" << name << "\"} " << histogram.count << "\n";
+    }
+
+    qint64 bytesReceived = closedBytesReceived;
+    qint64 bytesSent = closedBytesSent;
+    int uploads = 0;
+    int downloads = 0;
+    int queued = 0;
+    foreach (Connection* connection, connections) {
+        bytesReceived += connection->bytesReceived();
+        bytesSent += connection->bytesSent();
+        uploads += connection->uploadFile() ? 1 : 0;
+        downloads += connection->isSendingFile() ? 1 : 0;
+        queued += connection->queuedResponses();
+    }
+
+    out << "# HELP fileshare_received_bytes_total Bytes read from client connections.\n";
+    out << "# TYPE fileshare_received_bytes_total counter\n";
+    out << "fileshare_received_bytes_total " << bytesReceived << "\n";
+    out << "# HELP fileshare_sent_bytes_total Bytes written to client connections.\n";
+    out << "# TYPE fileshare_sent_bytes_total counter\n";
+    out << "fileshare_sent_bytes_total " << bytesSent << "\n";
+
+    QVector<Gauge> values = {
+        {"fileshare_uptime_seconds", "Seconds since the server started.", uptime.elapsed() / 1000},
+        {"fileshare_active_connections", "Open client connections.", connections.size()},
+        {"fileshare_uploads_in_flight", "Uploads currently being received.", uploads},
+        {"fileshare_downloads_in_flight", "Downloads currently being sent.", downloads},
+        {"fileshare_send_queue_depth", "Responses queued behind the socket buffers of all connections.", queued},
+    };
+    if (gauges) {
+        values += gauges();
+    }
+
+    foreach (const Gauge& gauge, values) {
+        out << "# HELP " << gauge.name << " " << gauge.help << "\n";
+        out << "# TYPE " << gauge.name << " gauge\n";
+        out << gauge.name << " " << gauge.value << "\n";
+    }
+
+    out.flush();
+    return text;
+}
+
+void Metrics::onScrapeConnection() {
+    while (server->hasPendingConnections()) {
+        QTcpSocket* socket = server->nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+
+        // Registered paths get their own document, anything else the exposition.
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            if (socket->bytesAvailable() > MaxScrapeRequestSize) {
+                socket->abort();
+                return;
+            }
+
+            QByteArray request = socket->peek(socket->bytesAvailable());
+            if (!request.contains("\r\n\r\n")) {
+                return;
+            }
+            socket->readAll();
+
+            QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+            QByteArray path = requestLine.size() > 1 ? requestLine[1] : QByteArray();
+
+            QByteArray body;
+            QByteArray contentType;
+            QHash<QByteArray, Endpoint>::const_iterator it = endpoints.constFind(path);
+            if (it != endpoints.constEnd()) {
+                body = it->render();
+                contentType = it->contentType;
+            } else {
+                body = render();
+                contentType = "text/plain; version=0.0.4";
+            }
+
+            QByteArray response = "HTTP/1.0 200 OK\r\n"
+                                  "Content-Type: " + contentType + "\r\n"
+                                  "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                                  "Connection: close\r\n\r\n";
+            socket->write(response + body);
+            socket->disconnectFromHost();
+        });
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QTcpServer>
+#include <QVector>
+#include <functional>
+
+#include "connection.h"
+
+// Request counters, latency histograms and traffic totals for the server,
+// rendered in the Prometheus text exposition format. The same text is
+// returned for RequestStats and served over plain HTTP on a loopback port,
+// which other diagnostics can share through addEndpoint().
+// Latency runs from the moment a request is framed until its response is
+// queued on the connection; each connection has at most one request in flight.
+class Metrics : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr quint16 DefaultPort = 9464;
+    static constexpr qint64 MaxScrapeRequestSize = 8 * 1024;
+
+    struct Gauge {
+        QByteArray name;
+        QByteArray help;
+        qint64 value;
+    };
+
+    explicit Metrics(QObject* parent = nullptr);
+
+    bool listen(quint16 port);
+    QString errorString() const;
+
+    void setGauges(const std::function<QVector<Gauge>()>& provider);
+    void addEndpoint(const QByteArray& path, const QByteArray& contentType, const std::function<QByteArray()>& render);
+
+    void connectionOpened(Connection* connection);
+    void connectionClosed(Connection* connection);
+    void requestStarted(Connection* connection, int request);
+    void requestFinished(Connection* connection, const QByteArray& response);
+    qint64 requestElapsed(Connection* connection) const;
+
+    QByteArray render() const;
+
+    static QByteArray requestName(int request);
+
+private slots:
+    void onScrapeConnection();
+
+private:
+    struct Histogram {
+        QVector<quint64> buckets;
+        quint64 count;
+        quint64 errors;
+        qint64 sum;
+    };
+
+    struct Pending {
+        int request;
+        QElapsedTimer timer;
+    };
+
+    struct Endpoint {
+        QByteArray contentType;
+        std::function<QByteArray()> render;
+    };
+
+    static const QVector<qint64>& bucketBounds();
+
+    QVector<Histogram> histograms;
+    QHash<Connection*, Pending> pending;
+    QSet<Connection*> connections;
+    qint64 closedBytesReceived;
+    qint64 closedBytesSent;
+    QElapsedTimer uptime;
+
+    QTcpServer* server;
+    std::function<QVector<Gauge>()> gauges;
+    QHash<QByteArray, Endpoint> endpoints;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,251 @@
+#include "nameindex.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSharedPointer>
+
+#include <algorithm>
+
+NameIndex::NameIndex(DataRoots* roots, IoPool* pool, QObject* parent) : QObject(parent), roots(roots), pool(pool) {
+    scanning = false;
+}
+
+void NameIndex::scan() {
+    typedef QList<QPair<QString, bool>> Found;
+    QSharedPointer<Found> found(new Found());
+
+    QList<QPair<QString, QString>> groups;
+    foreach (const QString& directory, roots->roots()) {
+        foreach (const QFileInfo& info, QDir(directory).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+            // Dot-prefixed folders are groups being moved in, and copies left on a root the group has left are stale.
+            if (!info.fileName().startsWith('.') && roots->root(info.fileName()) == directory) {
+                groups.append(qMakePair(directory, info.fileName()));
+            }
+        }
+    }
+
+    scanning = true;
+    removedWhileScanning.clear();
+    pool->run([groups, found]() {
+        for (const QPair<QString, QString>& group : groups) {
+            QDir root(group.first);
+            QString folder = root.filePath(group.second);
+            found->append(qMakePair(group.second, true));
+
+            QDirIterator it(folder, QDir::AllEntries | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                it.next();
+                found->append(qMakePair(root.relativeFilePath(it.filePath()), it.fileInfo().isDir()));
+            }
+        }
+    }, this, [this, found]() {
+        foreach (const auto& entry, *found) {
+            // Whatever was deleted while the walk ran stays deleted.
+            bool removed = false;
+            foreach (const QString& path, removedWhileScanning) {
+                if (entry.first == path || entry.first.startsWith(path + "/")) {
+                    removed = true;
+                    break;
+                }
+            }
+            if (!removed && !ids.contains(entry.first)) {
+                insert(entry.first, entry.second);
+            }
+        }
+        scanning = false;
+        removedWhileScanning.clear();
+    });
+}
+
+void NameIndex::add(const QString& path, bool folder) {
+    QString key = normalize(path);
+    if (key.isEmpty()) {
+        return;
+    }
+
+    // Parents are added too, for paths that arrive before their folder does.
+    QString parent = key.section('/', 0, -2);
+    while (!parent.isEmpty() && !ids.contains(parent)) {
+        insert(parent, true);
+        parent = parent.section('/', 0, -2);
+    }
+
+    QMap<QString, int>::const_iterator it = ids.constFind(key);
+    if (it != ids.constEnd()) {
+        entries[it.value()].folder = folder;
+        return;
+    }
+    insert(key, folder);
+}
+
+void NameIndex::remove(const QString& path) {
+    QString key = normalize(path);
+    if (scanning) {
+        removedWhileScanning.insert(key);
+    }
+
+    // Everything below a folder sorts right after "folder/".
+    QString prefix = key + "/";
+    QMap<QString, int>::iterator it = ids.lowerBound(prefix);
+    while (it != ids.end() && it.key().startsWith(prefix)) {
+        int id = it.value();
+        it = ids.erase(it);
+        erase(id);
+    }
+
+    it = ids.find(key);
+    if (it != ids.end()) {
+        int id = it.value();
+        ids.erase(it);
+        erase(id);
+    }
+}
+
+int NameIndex::size() const {
+    return ids.size();
+}
+
+QVector<NameIndex::Hit> NameIndex::search(const QString& query, const QSet<QString>& groups, const QSet<QString>& exclude, int offset, int limit, int* total) const {
+    QVector<Hit> hits;
+    QString needle = query.trimmed().toLower();
+    if (total) {
+        *total = 0;
+    }
+    if (needle.isEmpty() || groups.isEmpty()) {
+        return hits;
+    }
+
+    auto consider = [&](int id) {
+        const Entry& entry = entries.at(id);
+        if (!entry.name.contains(needle) || !groups.contains(entry.path.section('/', 0, 0).toLower()) || exclude.contains(entry.path)) {
+            return;
+        }
+        hits.append(Hit{entry.path, entry.path.section('/', -1), entry.folder, score(entry.name, needle)});
+    };
+
+    if (needle.size() >= 3) {
+        // Every match contains all of the query's trigrams, so the rarest one is enough to find them.
+        const QSet<int>* rarest = nullptr;
+        foreach (quint64 trigram, trigrams(needle)) {
+            QHash<quint64, QSet<int>>::const_iterator it = postings.constFind(trigram);
+            if (it == postings.constEnd()) {
+                return hits;
+            }
+            if (!rarest || it->size() < rarest->size()) {
+                rarest = &it.value();
+            }
+        }
+        foreach (int id, *rarest) {
+            consider(id);
+        }
+    } else {
+        for (QMultiMap<QString, int>::const_iterator it = names.lowerBound(needle); it != names.constEnd() && it.key().startsWith(needle); ++it) {
+            consider(it.value());
+        }
+    }
+
+    if (total) {
+        *total = hits.size();
+    }
+
+    offset = qMax(0, offset);
+    limit = qBound(0, limit, MaxPageSize);
+    if (offset >= hits.size()) {
+        return QVector<Hit>();
+    }
+
+    // Best score first, then shorter names, then shallower paths.
+    auto better = [](const Hit& left, const Hit& right) {
+        if (left.score != right.score) {
+            return left.score < right.score;
+        }
+        if (left.name.size() != right.name.size()) {
+            return left.name.size() < right.name.size();
+        }
+        int leftDepth = left.path.count('/');
+        int rightDepth = right.path.count('/');
+        if (leftDepth != rightDepth) {
+            return leftDepth < rightDepth;
+        }
+        return left.path < right.path;
+    };
+
+    int end = qMin(hits.size(), offset + limit);
+    std::partial_sort(hits.begin(), hits.begin() + end, hits.end(), better);
+    return hits.mid(offset, end - offset);
+}
+
+QString NameIndex::normalize(const QString& path) const {
+    QString key = QDir::fromNativeSeparators(roots->relative(path));
+    while (key.endsWith('/')) {
+        key.chop(1);
+    }
+    return key;
+}
+
+QVector<quint64> NameIndex::trigrams(const QString& name) {
+    QVector<quint64> result;
+    for (int i = 0; i + 3 <= name.size(); i++) {
+        result.append((quint64(name.at(i).unicode()) << 32) | (quint64(name.at(i + 1).unicode()) << 16) | name.at(i + 2).unicode());
+    }
+    return result;
+}
+
+int NameIndex::score(const QString& name, const QString& query) {
+    if (name == query) {
+        return 0;
+    }
+    if (name.startsWith(query)) {
+        return 1;
+    }
+
+    // A match at the start of a word ("report" in "q3-report.pdf") beats one inside a word.
+    int index = name.indexOf(query);
+    while (index > 0) {
+        if (!name.at(index - 1).isLetterOrNumber()) {
+            return 2;
+        }
+        index = name.indexOf(query, index + 1);
+    }
+    return 3;
+}
+
+void NameIndex::insert(const QString& path, bool folder) {
+    Entry entry;
+    entry.path = path;
+    entry.name = path.section('/', -1).toLower();
+    entry.folder = folder;
+
+    int id;
+    if (!freeIds.isEmpty()) {
+        id = freeIds.takeLast();
+        entries[id] = entry;
+    } else {
+        id = entries.size();
+        entries.append(entry);
+    }
+
+    ids.insert(path, id);
+    names.insert(entry.name, id);
+    foreach (quint64 trigram, trigrams(entry.name)) {
+        postings[trigram].insert(id);
+    }
+}
+
+void NameIndex::erase(int id) {
+    Entry& entry = entries[id];
+    names.remove(entry.name, id);
+    foreach (quint64 trigram, trigrams(entry.name)) {
+        QHash<quint64, QSet<int>>::iterator it = postings.find(trigram);
+        if (it != postings.end()) {
+            it->remove(id);
+            if (it->isEmpty()) {
+                postings.erase(it);
+            }
+        }
+    }
+
+    entry = Entry();
+    freeIds.append(id);
+}
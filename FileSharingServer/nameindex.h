@@ -0,0 +1,70 @@
+#ifndef NAMEINDEX_H
+#define NAMEINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QVector>
+
+#include "dataroots.h"
+#include "iopool.h"
+
+// File and folder names under the data roots, for search. Every name is
+// broken into trigrams, so a query of three characters or more only looks at
+// the entries sharing its rarest trigram; shorter queries match name prefixes
+// through a sorted map. The index is built by one walk at startup and then
+// kept current by add() and remove() as the server changes the tree, so a
+// search never touches the disk. Paths are relative to their data root and use
+// '/', as in the content index.
+class NameIndex : public QObject {
+    Q_OBJECT
+
+public:
+    struct Hit {
+        QString path;
+        QString name;
+        bool folder;
+        int score;
+    };
+
+    static constexpr int DefaultPageSize = 20;
+    static constexpr int MaxPageSize = 100;
+
+    NameIndex(DataRoots* roots, IoPool* pool, QObject* parent = nullptr);
+
+    void scan();
+    void add(const QString& path, bool folder);
+    void remove(const QString& path);
+    int size() const;
+
+    QVector<Hit> search(const QString& query, const QSet<QString>& groups, const QSet<QString>& exclude, int offset, int limit, int* total) const;
+
+    QString normalize(const QString& path) const;
+
+private:
+    struct Entry {
+        QString path;
+        QString name;
+        bool folder;
+    };
+
+    static QVector<quint64> trigrams(const QString& name);
+    static int score(const QString& name, const QString& query);
+
+    void insert(const QString& path, bool folder);
+    void erase(int id);
+
+    DataRoots* roots;
+    IoPool* pool;
+    bool scanning;
+    QSet<QString> removedWhileScanning;
+
+    QVector<Entry> entries;
+    QVector<int> freeIds;
+    QMap<QString, int> ids;
+    QMultiMap<QString, int> names;
+    QHash<quint64, QSet<int>> postings;
+};
+
+#endif // NAMEINDEX_H
@@ -0,0 +1,188 @@
+#include "peerlink.h"
+
+#include <QDataStream>
+
+PeerLink::PeerLink(const QString& host, quint16 port, Storage* storage, QObject* parent) : QObject(parent), host(host), port(port), storage(storage) {
+    connected = false;
+
+    socket = new QTcpSocket(this);
+    connect(socket, &QTcpSocket::connected, this, &PeerLink::onConnected);
+    connect(socket, &QTcpSocket::disconnected, this, &PeerLink::onDisconnected);
+    connect(socket, &QTcpSocket::readyRead, this, &PeerLink::onReadyRead);
+    connect(socket, &QAbstractSocket::errorOccurred, this, &PeerLink::onErrorOccurred);
+
+    reconnectTimer.setSingleShot(true);
+    connect(&reconnectTimer, &QTimer::timeout, this, &PeerLink::connectToPeer);
+
+    connect(&heartbeatTimer, &QTimer::timeout, this, &PeerLink::onHeartbeat);
+}
+
+QString PeerLink::address() const {
+    return QString("%1:%2").arg(host).arg(port);
+}
+
+bool PeerLink::isConnected() const {
+    return connected;
+}
+
+void PeerLink::start() {
+    connectToPeer();
+}
+
+void PeerLink::request(Request type, const QByteArray& payload, const std::function<void(QByteArray)>& done) {
+    if (!connected) {
+        done(QByteArray());
+        return;
+    }
+
+    QByteArray typeArray = QByteArray::number(type);
+    typeArray.resize(8);
+
+    QDataStream socketStream(socket);
+    socketStream.setVersion(QDataStream::Qt_5_15);
+    socketStream << typeArray + payload;
+
+    pending.enqueue(done);
+}
+
+void PeerLink::fetch(const QString& path, const QString& fileName, QObject* context, const std::function<void(bool)>& done) {
+    QSharedPointer<QFile> file(new QFile(fileName));
+    QPointer<QObject> guard(context);
+    storage->open(file, QIODevice::WriteOnly, this, [this, file, path, guard, done](bool opened) {
+        if (!opened) {
+            if (guard) {
+                done(false);
+            }
+            return;
+        }
+        fetchRange(file, path, 0, QString(), guard, done);
+    });
+}
+
+void PeerLink::connectToPeer() {
+    if (socket->state() != QAbstractSocket::UnconnectedState) {
+        return;
+    }
+    socket->connectToHost(host, port);
+}
+
+void PeerLink::onConnected() {
+    connected = true;
+    lastReceived.start();
+    heartbeatTimer.start(HeartbeatInterval);
+    emit stateChanged(true);
+}
+
+void PeerLink::onDisconnected() {
+    QQueue<std::function<void(QByteArray)>> failed;
+    failed.swap(pending);
+    heartbeatTimer.stop();
+
+    if (connected) {
+        connected = false;
+        emit stateChanged(false);
+    }
+
+    while (!failed.isEmpty()) {
+        failed.dequeue()(QByteArray());
+    }
+
+    scheduleReconnect();
+}
+
+void PeerLink::onErrorOccurred(QAbstractSocket::SocketError error) {
+    Q_UNUSED(error);
+
+    if (socket->state() == QAbstractSocket::UnconnectedState) {
+        scheduleReconnect();
+    }
+}
+
+void PeerLink::onReadyRead() {
+    QDataStream socketStream(socket);
+    socketStream.setVersion(QDataStream::Qt_5_15);
+
+    forever {
+        socketStream.startTransaction();
+
+        QByteArray data;
+        socketStream >> data;
+
+        if (!socketStream.commitTransaction()) {
+            return;
+        }
+
+        lastReceived.start();
+        if (pending.isEmpty()) {
+            continue;
+        }
+        pending.dequeue()(data);
+    }
+}
+
+void PeerLink::onHeartbeat() {
+    if (!connected) {
+        return;
+    }
+
+    if (pending.isEmpty()) {
+        request(RequestPing, QByteArray(), [](QByteArray) {});
+        return;
+    }
+
+    if (lastReceived.elapsed() > qint64(HeartbeatInterval) * DeadIntervals) {
+        // Half-open: the peer is gone but no FIN or RST ever arrived.
+        socket->abort();
+    }
+}
+
+void PeerLink::fetchRange(const QSharedPointer<QFile>& file, const QString& path, qint64 offset, const QString& hash, QPointer<QObject> context, const std::function<void(bool)>& done) {
+    auto finish = [file, context, done](bool fetched) {
+        file->close();
+        if (context) {
+            done(fetched);
+        }
+    };
+
+    QByteArray payload = QString("%1,%2,%3").arg(offset).arg(RangeSize).arg(path).toUtf8();
+    request(RequestDownloadRange, payload, [=](QByteArray data) {
+        if (data.mid(0, 8).toInt() != ResponseDownloadRangeSuccess) {
+            finish(false);
+            return;
+        }
+
+        QString header = QString::fromUtf8(data.mid(8, 128));
+        QByteArray bytes = data.mid(8 + 128);
+        qint64 size = header.section(',', 0, 0).toLongLong();
+        QString rangeHash = header.section(',', 1, 1);
+
+        // A different hash means the file was replaced between two ranges; a later change brings the new one.
+        if (!hash.isEmpty() && !rangeHash.isEmpty() && hash != rangeHash) {
+            finish(false);
+            return;
+        }
+
+        storage->write(file, offset, bytes, this, [=](bool written) {
+            if (!written) {
+                finish(false);
+                return;
+            }
+
+            qint64 next = offset + bytes.size();
+            if (next < size && !bytes.isEmpty()) {
+                fetchRange(file, path, next, hash.isEmpty() ? rangeHash : hash, context, done);
+                return;
+            }
+
+            storage->sync(file, this, [=](bool synced) {
+                finish(synced && next == size);
+            });
+        });
+    });
+}
+
+void PeerLink::scheduleReconnect() {
+    if (!reconnectTimer.isActive()) {
+        reconnectTimer.start(RetryDelay);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef PEERLINK_H
+#define PEERLINK_H
+
+#include <QFile>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <functional>
+
+#include "storage.h"
+#include "structs.h"
+
+// A server's own connection to another server, over the protocol clients use.
+// Requests are answered strictly in order, so each response goes to the oldest
+// waiting callback. A dropped link fails every waiting request with an empty
+// response and is retried after RetryDelay. File content is pulled with ranged
+// downloads into a local file. An idle link sends a ping every
+// HeartbeatInterval so the other end does not close it as idle, and a link that
+// has requests waiting but has heard nothing for a few intervals is dropped as
+// dead rather than waited on forever.
+class PeerLink : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int RetryDelay = 2000;
+    static constexpr qint64 RangeSize = 1024 * 1024;
+    static constexpr int HeartbeatInterval = 20000;
+    static constexpr int DeadIntervals = 3;
+
+    PeerLink(const QString& host, quint16 port, Storage* storage, QObject* parent = nullptr);
+
+    QString address() const;
+    bool isConnected() const;
+
+    void start();
+    void request(Request type, const QByteArray& payload, const std::function<void(QByteArray)>& done);
+    void fetch(const QString& path, const QString& fileName, QObject* context, const std::function<void(bool)>& done);
+
+signals:
+    void stateChanged(bool connected);
+
+private slots:
+    void connectToPeer();
+    void onConnected();
+    void onDisconnected();
+    void onErrorOccurred(QAbstractSocket::SocketError error);
+    void onReadyRead();
+    void onHeartbeat();
+
+private:
+    void fetchRange(const QSharedPointer<QFile>& file, const QString& path, qint64 offset, const QString& hash, QPointer<QObject> context, const std::function<void(bool)>& done);
+    void scheduleReconnect();
+
+    QTcpSocket* socket;
+    QTimer reconnectTimer;
+    QTimer heartbeatTimer;
+    QElapsedTimer lastReceived;
+    QString host;
+    quint16 port;
+    Storage* storage;
+    bool connected;
+
+    QQueue<std::function<void(QByteArray)>> pending;
+};
+
+#endif // PEERLINK_H
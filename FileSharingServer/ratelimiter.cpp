@@ -0,0 +1,118 @@
+#include "ratelimiter.h"
+
+#include <cmath>
+
+RateLimiter::RateLimiter(QObject* parent) : QObject(parent) {
+    for (int scope = 0; scope < ScopeCount; scope++) {
+        for (int kind = 0; kind < KindCount; kind++) {
+            limits[scope][kind] = {0, 0};
+        }
+    }
+    clock.start();
+
+    connect(&pruneTimer, &QTimer::timeout, this, &RateLimiter::prune);
+    pruneTimer.start(PruneInterval);
+}
+
+RateLimiter* RateLimiter::create(QSettings* config, QObject* parent) {
+    RateLimiter* limiter = new RateLimiter(parent);
+    limiter->configure(config);
+    return limiter;
+}
+
+void RateLimiter::configure(QSettings* config) {
+    static const char* scopes[ScopeCount] = {"connection", "user", "address"};
+    static const char* kinds[KindCount] = {"Requests", "Bytes"};
+
+    // limits/userRequests=20 with limits/userRequestsBurst=40, and so on; the burst defaults to two seconds' worth.
+    for (int scope = 0; scope < ScopeCount; scope++) {
+        for (int kind = 0; kind < KindCount; kind++) {
+            QString key = QString("limits/%1%2").arg(scopes[scope]).arg(kinds[kind]);
+            double rate = config->value(key, 0).toDouble();
+            double burst = config->value(key + "Burst", rate * 2).toDouble();
+            setLimit(Scope(scope), Kind(kind), rate, burst);
+        }
+    }
+}
+
+void RateLimiter::setLimit(Scope scope, Kind kind, double rate, double burst) {
+    Limit& limit = limits[scope][kind];
+    limit.rate = qMax(0.0, rate);
+    limit.burst = qMax(1.0, burst);
+    if (limit.rate == 0) {
+        buckets[scope][kind].clear();
+    }
+}
+
+qint64 RateLimiter::acquire(Kind kind, const QStringList& keys, double cost) {
+    qint64 wait = 0;
+    for (int scope = 0; scope < ScopeCount && scope < keys.size(); scope++) {
+        const Limit& limit = limits[scope][kind];
+        if (limit.rate == 0 || keys.at(scope).isEmpty()) {
+            continue;
+        }
+
+        // Whatever the cost, a full bucket lets the request through.
+        Bucket& entry = bucket(Scope(scope), kind, keys.at(scope));
+        double needed = qMin(cost, limit.burst);
+        if (entry.tokens < needed) {
+            wait = qMax(wait, qint64(std::ceil((needed - entry.tokens) * 1000 / limit.rate)));
+        }
+    }
+
+    if (wait > 0) {
+        return wait;
+    }
+    charge(kind, keys, cost);
+    return 0;
+}
+
+void RateLimiter::charge(Kind kind, const QStringList& keys, double amount) {
+    if (amount <= 0) {
+        return;
+    }
+
+    for (int scope = 0; scope < ScopeCount && scope < keys.size(); scope++) {
+        if (limits[scope][kind].rate == 0 || keys.at(scope).isEmpty()) {
+            continue;
+        }
+        bucket(Scope(scope), kind, keys.at(scope)).tokens -= amount;
+    }
+}
+
+void RateLimiter::forget(Scope scope, const QString& key) {
+    for (int kind = 0; kind < KindCount; kind++) {
+        buckets[scope][kind].remove(key);
+    }
+}
+
+void RateLimiter::prune() {
+    qint64 now = clock.elapsed();
+    for (int scope = 0; scope < ScopeCount; scope++) {
+        for (int kind = 0; kind < KindCount; kind++) {
+            const Limit& limit = limits[scope][kind];
+            QHash<QString, Bucket>::iterator it = buckets[scope][kind].begin();
+            while (it != buckets[scope][kind].end()) {
+                if (it->tokens + (now - it->updated) * limit.rate / 1000 >= limit.burst) {
+                    it = buckets[scope][kind].erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+}
+
+RateLimiter::Bucket& RateLimiter::bucket(Scope scope, Kind kind, const QString& key) {
+    const Limit& limit = limits[scope][kind];
+    qint64 now = clock.elapsed();
+
+    QHash<QString, Bucket>::iterator it = buckets[scope][kind].find(key);
+    if (it == buckets[scope][kind].end()) {
+        return buckets[scope][kind].insert(key, {limit.burst, now}).value();
+    }
+
+    it->tokens = qMin(limit.burst, it->tokens + (now - it->updated) * limit.rate / 1000);
+    it->updated = now;
+    return it.value();
+}
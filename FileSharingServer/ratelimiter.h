@@ -0,0 +1,70 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QSettings>
+#include <QStringList>
+#include <QTimer>
+
+// Token buckets for requests and for bytes, kept per connection, per user and
+// per source address. A bucket holds up to its burst and refills at its rate;
+// a scope whose rate is 0 is not limited. Requests are admitted only when
+// every bucket they fall into has a token left. Bytes are charged after they
+// have moved, so a bucket can go into debt, and byte-heavy requests wait until
+// it is paid off. Buckets that have filled up again are dropped now and then,
+// since a fresh bucket is just as full.
+class RateLimiter : public QObject {
+    Q_OBJECT
+
+public:
+    enum Scope {
+        PerConnection,
+        PerUser,
+        PerAddress,
+        ScopeCount,
+    };
+
+    enum Kind {
+        Requests,
+        Bytes,
+        KindCount,
+    };
+
+    static constexpr int PruneInterval = 60000;
+
+    explicit RateLimiter(QObject* parent = nullptr);
+
+    static RateLimiter* create(QSettings* config, QObject* parent = nullptr);
+    void configure(QSettings* config);
+
+    void setLimit(Scope scope, Kind kind, double rate, double burst);
+
+    qint64 acquire(Kind kind, const QStringList& keys, double cost);
+    void charge(Kind kind, const QStringList& keys, double amount);
+    void forget(Scope scope, const QString& key);
+
+private slots:
+    void prune();
+
+private:
+    struct Limit {
+        double rate;
+        double burst;
+    };
+
+    struct Bucket {
+        double tokens;
+        qint64 updated;
+    };
+
+    Bucket& bucket(Scope scope, Kind kind, const QString& key);
+
+    Limit limits[ScopeCount][KindCount];
+    QHash<QString, Bucket> buckets[ScopeCount][KindCount];
+    QElapsedTimer clock;
+    QTimer pruneTimer;
+};
+
+#endif // RATELIMITER_H
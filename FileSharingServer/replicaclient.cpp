@@ -0,0 +1,134 @@
+#include "replicaclient.h"
+
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QTimer>
+
+ReplicaClient::ReplicaClient(const QString& host, quint16 port, const QString& secret, const QString& stateFile, Storage* storage, QObject* parent) : QObject(parent), secret(secret) {
+    state = new QSettings(stateFile, QSettings::IniFormat, this);
+    cursor = state->value("cursor").toString();
+    applied = state->value("position", 0).toULongLong();
+    head = applied;
+    batchPosition = applied;
+    batchIndex = 0;
+    pendingSince = 0;
+    generation = 0;
+
+    m_link = new PeerLink(host, port, storage, this);
+    connect(m_link, &PeerLink::stateChanged, this, &ReplicaClient::onLinkStateChanged);
+}
+
+void ReplicaClient::setApplier(const Applier& applier) {
+    this->applier = applier;
+}
+
+void ReplicaClient::start() {
+    m_link->start();
+}
+
+QString ReplicaClient::primary() const {
+    return m_link->address();
+}
+
+bool ReplicaClient::isConnected() const {
+    return m_link->isConnected();
+}
+
+qint64 ReplicaClient::lagEvents() const {
+    return head > applied ? qint64(head - applied) : 0;
+}
+
+qint64 ReplicaClient::lagMilliseconds() const {
+    return pendingSince > 0 ? QDateTime::currentMSecsSinceEpoch() - pendingSince : 0;
+}
+
+PeerLink* ReplicaClient::link() const {
+    return m_link;
+}
+
+void ReplicaClient::onLinkStateChanged(bool connected) {
+    if (connected) {
+        emit stateChanged(true);
+        poll();
+        return;
+    }
+
+    // The batch is asked for again after reconnecting; applying an event twice is harmless.
+    generation++;
+    batch = QJsonArray();
+    batchIndex = 0;
+    emit stateChanged(false);
+}
+
+void ReplicaClient::poll() {
+    if (!m_link->isConnected()) {
+        return;
+    }
+
+    int current = generation;
+    m_link->request(RequestReplicate, (secret + ";" + cursor).toUtf8(), [this, current](QByteArray data) {
+        if (current != generation || data.isEmpty()) {
+            return;
+        }
+
+        if (data.mid(0, 8).toInt() != ResponseReplicateSuccess) {
+            emit errorOccurred(QString::fromUtf8(data.mid(8)));
+            QTimer::singleShot(PeerLink::RetryDelay, this, [this, current]() {
+                if (current == generation) {
+                    poll();
+                }
+            });
+            return;
+        }
+
+        onBatch(data.mid(8));
+    });
+}
+
+void ReplicaClient::onBatch(const QByteArray& data) {
+    QJsonObject response = QJsonDocument::fromJson(data).object();
+    batchCursor = response.value("cursor").toString();
+    batchPosition = response.value("position").toVariant().toULongLong();
+    head = response.value("head").toVariant().toULongLong();
+    batch = response.value("events").toArray();
+    batchIndex = 0;
+
+    if (pendingSince == 0 && head > applied) {
+        qint64 time = batch.isEmpty() ? 0 : batch.first().toObject().value("time").toVariant().toLongLong();
+        pendingSince = time > 0 ? time : QDateTime::currentMSecsSinceEpoch();
+    }
+
+    applyNext();
+}
+
+void ReplicaClient::applyNext() {
+    if (batchIndex >= batch.size()) {
+        cursor = batchCursor;
+        applied = batchPosition;
+        state->setValue("cursor", cursor);
+        state->setValue("position", applied);
+
+        if (applied >= head) {
+            pendingSince = 0;
+        } else if (!batch.isEmpty()) {
+            // The next unapplied event is at most as old as the last one applied.
+            qint64 time = batch.last().toObject().value("time").toVariant().toLongLong();
+            pendingSince = time > 0 ? time : pendingSince;
+        }
+
+        batch = QJsonArray();
+        poll();
+        return;
+    }
+
+    QJsonObject event = batch.at(batchIndex++).toObject();
+    int current = generation;
+    applier(event, [this, current]() {
+        // Queued so that a long batch of events applied synchronously does not recurse.
+        QMetaObject::invokeMethod(this, [this, current]() {
+            if (current == generation) {
+                applyNext();
+            }
+        }, Qt::QueuedConnection);
+    });
+}
@@ -0,0 +1,66 @@
+#ifndef REPLICACLIENT_H
+#define REPLICACLIENT_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QSettings>
+
+#include <functional>
+
+#include "peerlink.h"
+#include "storage.h"
+
+// A replica's link to its primary. The replica asks for the changes after its
+// cursor with RequestReplicate and the primary answers with a batch once there
+// is one. Events are handed to the applier one at a time, and the next batch is
+// only requested once the whole batch has been applied, so the primary never
+// queues more than one batch per replica. File content is pulled with ranged
+// downloads on the same link. The cursor is saved after every batch, so a
+// restarted replica resumes where it stopped.
+class ReplicaClient : public QObject {
+    Q_OBJECT
+
+public:
+    typedef std::function<void(const QJsonObject&, const std::function<void()>&)> Applier;
+
+    ReplicaClient(const QString& host, quint16 port, const QString& secret, const QString& stateFile, Storage* storage, QObject* parent = nullptr);
+
+    void setApplier(const Applier& applier);
+    void start();
+
+    QString primary() const;
+    bool isConnected() const;
+    qint64 lagEvents() const;
+    qint64 lagMilliseconds() const;
+    PeerLink* link() const;
+
+signals:
+    void stateChanged(bool connected);
+    void errorOccurred(QString message);
+
+private slots:
+    void onLinkStateChanged(bool connected);
+
+private:
+    void poll();
+    void onBatch(const QByteArray& data);
+    void applyNext();
+
+    PeerLink* m_link;
+    QString secret;
+    QSettings* state;
+    Applier applier;
+    int generation;
+
+    QString cursor;
+    QString batchCursor;
+    QJsonArray batch;
+    int batchIndex;
+    quint64 applied;
+    quint64 batchPosition;
+    quint64 head;
+    qint64 pendingSince;
+};
+
+#endif // REPLICACLIENT_H
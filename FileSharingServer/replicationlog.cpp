@@ -0,0 +1,50 @@
+#include "replicationlog.h"
+
+#include <QDateTime>
+
+ReplicationLog::ReplicationLog(int capacity, QObject* parent) : QObject(parent) {
+    this->capacity = qMax(1, capacity);
+    m_head = 0;
+    m_headTime = QDateTime::currentMSecsSinceEpoch();
+}
+
+quint64 ReplicationLog::head() const {
+    return m_head;
+}
+
+qint64 ReplicationLog::headTime() const {
+    return m_headTime;
+}
+
+bool ReplicationLog::covers(quint64 seq) const {
+    // Everything after seq must still be in the log.
+    quint64 first = m_head - events.size() + 1;
+    return seq <= m_head && seq + 1 >= first;
+}
+
+QJsonArray ReplicationLog::since(quint64 seq, int limit) const {
+    QJsonArray batch;
+    if (!covers(seq)) {
+        return batch;
+    }
+
+    quint64 first = m_head - events.size() + 1;
+    for (int i = int(seq + 1 - first); i < events.size() && batch.size() < limit; i++) {
+        batch.append(events.at(i));
+    }
+    return batch;
+}
+
+void ReplicationLog::append(QJsonObject event) {
+    m_head++;
+    m_headTime = QDateTime::currentMSecsSinceEpoch();
+    event.insert("seq", qint64(m_head));
+    event.insert("time", m_headTime);
+
+    events.enqueue(event);
+    while (events.size() > capacity) {
+        events.dequeue();
+    }
+
+    emit appended();
+}
@@ -0,0 +1,39 @@
+#ifndef REPLICATIONLOG_H
+#define REPLICATIONLOG_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QQueue>
+
+// The primary's recent changes, numbered from 1 in the order they were made.
+// Only the last `capacity` events are kept; a replica that falls further
+// behind, or one that last synced with an earlier run of the primary, starts
+// over from a snapshot instead. Events are JSON objects with "seq", "time"
+// (milliseconds since the epoch) and "type" plus type-specific fields.
+class ReplicationLog : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultCapacity = 100000;
+
+    explicit ReplicationLog(int capacity, QObject* parent = nullptr);
+
+    quint64 head() const;
+    qint64 headTime() const;
+    bool covers(quint64 seq) const;
+    QJsonArray since(quint64 seq, int limit) const;
+
+    void append(QJsonObject event);
+
+signals:
+    void appended();
+
+private:
+    int capacity;
+    quint64 m_head;
+    qint64 m_headTime;
+    QQueue<QJsonObject> events;
+};
+
+#endif // REPLICATIONLOG_H
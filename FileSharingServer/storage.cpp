@@ -0,0 +1,246 @@
+#include "storage.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef USE_IO_URING
+#include "uringstorage.h"
+#endif
+
+Storage::Storage(IoPool* pool, QObject* parent) : QObject(parent), pool(pool), m_durability(SyncFile) {
+}
+
+Storage::~Storage() {
+}
+
+Storage* Storage::create(QSettings* config, IoPool* pool, QObject* parent) {
+    QString backend = config->value("storage/backend", "portable").toString();
+    Durability durability = durabilityFromString(config->value("storage/uploadSync", "file").toString());
+
+#ifdef USE_IO_URING
+    if (backend.compare("uring", Qt::CaseInsensitive) == 0) {
+        UringStorage* storage = new UringStorage(pool, config->value("storage/uringQueueDepth", UringStorage::DefaultQueueDepth).toInt(), parent);
+        if (storage->isValid()) {
+            storage->setDurability(durability);
+            return storage;
+        }
+
+        qDebug() << "io_uring is unavailable, using the portable storage backend";
+        delete storage;
+    }
+#else
+    if (backend.compare("uring", Qt::CaseInsensitive) == 0) {
+        qDebug() << "Built without io_uring support, using the portable storage backend";
+    }
+#endif
+
+    Storage* storage = new Storage(pool, parent);
+    storage->setDurability(durability);
+    return storage;
+}
+
+QString Storage::name() const {
+    return "portable";
+}
+
+Storage::Durability Storage::durabilityFromString(const QString& name) {
+    if (name.compare("none", Qt::CaseInsensitive) == 0) {
+        return SyncNone;
+    }
+    if (name.compare("full", Qt::CaseInsensitive) == 0) {
+        return SyncFull;
+    }
+    return SyncFile;
+}
+
+Storage::Durability Storage::durability() const {
+    return m_durability;
+}
+
+void Storage::setDurability(Durability durability) {
+    m_durability = durability;
+}
+
+void Storage::open(const QSharedPointer<QFile>& file, QIODevice::OpenMode mode, QObject* context, const std::function<void(bool)>& done) {
+    QSharedPointer<bool> opened(new bool(false));
+    pool->run(file.data(), [file, mode, opened]() {
+        *opened = file->open(mode);
+    }, context, [done, opened]() {
+        done(*opened);
+    });
+}
+
+void Storage::read(const QSharedPointer<QFile>& file, qint64 offset, qint64 length, QObject* context, const std::function<void(QByteArray)>& done) {
+    QSharedPointer<QByteArray> bytes(new QByteArray());
+    pool->run(file.data(), [file, offset, length, bytes]() {
+        if (file->isOpen() && file->seek(offset)) {
+            *bytes = file->read(length);
+        }
+    }, context, [done, bytes]() {
+        done(*bytes);
+    });
+}
+
+void Storage::write(const QSharedPointer<QFile>& file, qint64 offset, const QByteArray& bytes, QObject* context, const std::function<void(bool)>& done) {
+    QSharedPointer<bool> written(new bool(false));
+    pool->run(file.data(), [file, offset, bytes, written]() {
+        if (file->isOpen() && file->seek(offset)) {
+            *written = file->write(bytes) == bytes.size();
+        }
+    }, context, [done, written]() {
+        done(*written);
+    });
+}
+
+void Storage::sync(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done) {
+    QSharedPointer<bool> synced(new bool(false));
+    pool->run(file.data(), [file, synced]() {
+        if (file->isOpen()) {
+            *synced = IoPool::sync(file.data());
+        }
+    }, context, [done, synced]() {
+        done(*synced);
+    });
+}
+
+void Storage::remove(const QString& path, QObject* context, const std::function<void(bool)>& done) {
+    QSharedPointer<bool> removed(new bool(true));
+    pool->run([path, removed]() {
+        QFileInfo info(path);
+        if (info.isDir()) {
+            *removed = QDir(path).removeRecursively();
+        } else if (info.exists() || info.isSymLink()) {
+            *removed = QFile::remove(path);
+        }
+    }, context, [done, removed]() {
+        if (done) {
+            done(*removed);
+        }
+    });
+}
+
+void Storage::link(const QString& source, const QString& target, QObject* context, const std::function<void(bool)>& done) {
+    QSharedPointer<bool> linked(new bool(false));
+    pool->run([source, target, linked]() {
+        // Different filesystems cannot share an inode; fall back to a copy.
+        *linked = hardLink(source, target) || QFile::copy(source, target);
+    }, context, [done, linked]() {
+        done(*linked);
+    });
+}
+
+void Storage::allocate(const QSharedPointer<QFile>& file, qint64 size, QObject* context, const std::function<void(bool)>& done) {
+    QSharedPointer<bool> allocated(new bool(true));
+    pool->run(file.data(), [file, size, allocated]() {
+#ifdef Q_OS_LINUX
+        // Reserving every block up front keeps concurrent uploads from interleaving on disk
+        // and runs out of space now rather than halfway through. The size still grows with the writes.
+        if (file->isOpen() && size > 0 && ::fallocate(file->handle(), FALLOC_FL_KEEP_SIZE, 0, size) != 0) {
+            *allocated = errno == EOPNOTSUPP || errno == ENOSYS;
+        }
+#else
+        Q_UNUSED(file);
+        Q_UNUSED(size);
+#endif
+    }, context, [done, allocated]() {
+        done(*allocated);
+    });
+}
+
+void Storage::drain(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done) {
+    // Runs after every write queued for the file, as they share its strand.
+    QSharedPointer<bool> drained(new bool(false));
+    pool->run(file.data(), [file, drained]() {
+        *drained = file->isOpen() && file->flush();
+    }, context, [done, drained]() {
+        done(*drained);
+    });
+}
+
+void Storage::close(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done) {
+    // Drained first, native writes included, and closed on the file's strand; the result says whether it all reached the file.
+    drain(file, this, [this, file, context, done](bool drained) {
+        pool->run(file.data(), [file]() {
+            file->close();
+        }, context, [done, drained]() {
+            if (done) {
+                done(drained);
+            }
+        });
+    });
+}
+
+void Storage::commit(const QSharedPointer<QFile>& file, const QString& target, QObject* context, const std::function<void(bool)>& done) {
+    Durability durability = m_durability;
+    auto install = [this, file, target, durability, context, done](bool ready) {
+        QSharedPointer<bool> installed(new bool(false));
+        pool->run(file.data(), [file, target, durability, ready, installed]() {
+            bool flushed = file->flush();
+            file->close();
+            if (!ready || !flushed) {
+                return;
+            }
+
+            // QFile::rename() refuses an existing target, so of two uploads racing for one name the second fails.
+            *installed = QFile::rename(file->fileName(), target);
+
+            // The file is already visible under its name, so a failed folder fsync is not an upload failure.
+            if (*installed && durability == SyncFull && !syncDirectory(QFileInfo(target).path())) {
+                qWarning() << "Cannot sync the folder of" << target;
+            }
+        }, context, [done, installed]() {
+            done(*installed);
+        });
+    };
+
+    if (durability == SyncNone) {
+        drain(file, context, install);
+    } else {
+        sync(file, context, install);
+    }
+}
+
+bool Storage::hardLink(const QString& source, const QString& target) {
+#ifdef Q_OS_WIN
+    return CreateHardLinkW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(target).utf16()),
+                           reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(source).utf16()), nullptr);
+#else
+    return ::link(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0;
+#endif
+}
+
+// Unlike QFile::rename(), overwrites the target in one step, so readers see the old file or the new one but never neither.
+bool Storage::replaceFile(const QString& source, const QString& target) {
+#ifdef Q_OS_WIN
+    return MoveFileExW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(source).utf16()),
+                       reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(target).utf16()), MOVEFILE_REPLACE_EXISTING);
+#else
+    return ::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0;
+#endif
+}
+
+bool Storage::syncDirectory(const QString& path) {
+#ifdef Q_OS_WIN
+    // NTFS journals the rename itself.
+    Q_UNUSED(path);
+    return true;
+#else
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
@@ -0,0 +1,59 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <QObject>
+#include <QSettings>
+#include <QSharedPointer>
+#include <QFile>
+#include <functional>
+
+#include "iopool.h"
+
+// Asynchronous file operations used by uploads, downloads and deletes.
+// This base class is the portable backend: every operation runs as a blocking
+// QFile call on the I/O pool, serialized per file. Platform backends override
+// the operations they can do natively and fall back to these otherwise.
+// Uploads are written to a staging file and commit() moves it into place, after
+// syncing it as far as the durability setting asks.
+class Storage : public QObject {
+    Q_OBJECT
+
+public:
+    enum Durability {
+        SyncNone,
+        SyncFile,
+        SyncFull,
+    };
+
+    explicit Storage(IoPool* pool, QObject* parent = nullptr);
+    virtual ~Storage();
+
+    static Storage* create(QSettings* config, IoPool* pool, QObject* parent = nullptr);
+
+    virtual QString name() const;
+
+    static Durability durabilityFromString(const QString& name);
+    Durability durability() const;
+    void setDurability(Durability durability);
+
+    virtual void open(const QSharedPointer<QFile>& file, QIODevice::OpenMode mode, QObject* context, const std::function<void(bool)>& done);
+    virtual void read(const QSharedPointer<QFile>& file, qint64 offset, qint64 length, QObject* context, const std::function<void(QByteArray)>& done);
+    virtual void write(const QSharedPointer<QFile>& file, qint64 offset, const QByteArray& bytes, QObject* context, const std::function<void(bool)>& done);
+    virtual void sync(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done);
+    virtual void remove(const QString& path, QObject* context, const std::function<void(bool)>& done);
+    virtual void link(const QString& source, const QString& target, QObject* context, const std::function<void(bool)>& done);
+    virtual void allocate(const QSharedPointer<QFile>& file, qint64 size, QObject* context, const std::function<void(bool)>& done);
+    virtual void drain(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done);
+    void close(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done);
+    void commit(const QSharedPointer<QFile>& file, const QString& target, QObject* context, const std::function<void(bool)>& done);
+
+    static bool hardLink(const QString& source, const QString& target);
+    static bool replaceFile(const QString& source, const QString& target);
+    static bool syncDirectory(const QString& path);
+
+protected:
+    IoPool* pool;
+    Durability m_durability;
+};
+
+#endif // STORAGE_H
@@ -0,0 +1,49 @@
+#include "tcpconnection.h"
+
+TcpConnection::TcpConnection(QTcpSocket* socket, Storage* storage, QObject* parent) : Connection(socket->socketDescriptor(), storage, parent), m_socket(socket) {
+    m_socket->setParent(this);
+    m_socket->setReadBufferSize(ReadBufferSize);
+
+    connect(m_socket, &QTcpSocket::readyRead, this, &TcpConnection::onReadyRead);
+    connect(m_socket, &QTcpSocket::bytesWritten, this, &TcpConnection::onBytesWritten);
+    connect(m_socket, &QTcpSocket::disconnected, this, &TcpConnection::onDisconnected);
+}
+
+TcpConnection::~TcpConnection() {
+}
+
+QTcpSocket* TcpConnection::socket() const {
+    return m_socket;
+}
+
+QString TcpConnection::peerAddress() const {
+    return m_socket->peerAddress().toString();
+}
+
+bool TcpConnection::isOpen() const {
+    return m_socket->isOpen();
+}
+
+void TcpConnection::closeSocket() {
+    m_socket->close();
+}
+
+void TcpConnection::abort() {
+    m_socket->abort();
+}
+
+qint64 TcpConnection::bytesAvailable() {
+    return m_socket->bytesAvailable();
+}
+
+qint64 TcpConnection::readData(char* data, qint64 maxSize) {
+    return m_socket->read(data, maxSize);
+}
+
+void TcpConnection::writeData(const QByteArray& bytes) {
+    m_socket->write(bytes);
+}
+
+qint64 TcpConnection::bytesToWrite() const {
+    return m_socket->bytesToWrite();
+}
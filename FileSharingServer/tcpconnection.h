@@ -0,0 +1,32 @@
+#ifndef TCPCONNECTION_H
+#define TCPCONNECTION_H
+
+#include <QTcpSocket>
+
+#include "connection.h"
+
+class TcpConnection : public Connection {
+    Q_OBJECT
+
+public:
+    TcpConnection(QTcpSocket* socket, Storage* storage, QObject* parent = nullptr);
+    ~TcpConnection();
+
+    QTcpSocket* socket() const;
+
+    QString peerAddress() const override;
+    bool isOpen() const override;
+    void abort() override;
+
+protected:
+    qint64 bytesAvailable() override;
+    qint64 readData(char* data, qint64 maxSize) override;
+    void writeData(const QByteArray& bytes) override;
+    qint64 bytesToWrite() const override;
+    void closeSocket() override;
+
+private:
+    QTcpSocket* m_socket;
+};
+
+#endif // TCPCONNECTION_H
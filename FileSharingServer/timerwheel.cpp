@@ -0,0 +1,65 @@
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(int tick, int slots, const Deadline& deadline, QObject* parent) : QObject(parent), tick(qMax(10, tick)), deadline(deadline) {
+    wheel.resize(qMax(2, slots));
+    cursor = Connection::now() / this->tick;
+
+    connect(&timer, &QTimer::timeout, this, &TimerWheel::advance);
+    timer.start(this->tick);
+}
+
+void TimerWheel::add(Connection* connection) {
+    remove(connection);
+    schedule(connection, deadline(connection));
+}
+
+void TimerWheel::remove(Connection* connection) {
+    QHash<Connection*, int>::iterator it = slotOf.find(connection);
+    if (it != slotOf.end()) {
+        wheel[it.value()].remove(connection);
+        slotOf.erase(it);
+    }
+}
+
+int TimerWheel::size() const {
+    return slotOf.size();
+}
+
+void TimerWheel::advance() {
+    qint64 now = Connection::now();
+    qint64 target = now / tick;
+
+    // A stalled event loop catches up on the ticks it missed, at most one full turn.
+    qint64 first = qMax(cursor + 1, target - wheel.size() + 1);
+    for (qint64 current = first; current <= target; current++) {
+        cursor = current;
+        QSet<Connection*> due;
+        due.swap(wheel[int(current % wheel.size())]);
+
+        foreach (Connection* connection, due) {
+            if (!slotOf.contains(connection)) {
+                // Removed by the expiry of another connection in the same slot.
+                continue;
+            }
+
+            qint64 when = deadline(connection);
+            if (when > now) {
+                schedule(connection, when);
+                continue;
+            }
+
+            slotOf.remove(connection);
+            emit expired(connection);
+        }
+    }
+    cursor = target;
+}
+
+void TimerWheel::schedule(Connection* connection, qint64 deadline) {
+    qint64 ticks = (deadline - Connection::now() + tick - 1) / tick;
+    ticks = qBound<qint64>(1, ticks, wheel.size() - 1);
+
+    int slot = int((cursor + ticks) % wheel.size());
+    wheel[slot].insert(connection);
+    slotOf.insert(connection, slot);
+}
@@ -0,0 +1,52 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+
+#include <functional>
+
+#include "connection.h"
+
+// A hashed timing wheel of connection deadlines. Each connection sits in the
+// slot of the tick its deadline falls on, and each tick only looks at the
+// connections in one slot. Activity never touches the wheel: when a slot comes
+// up, the deadline is asked for again and a connection that has been active
+// meanwhile is simply moved to a later slot. Deadlines further away than one
+// turn of the wheel are parked in the last slot and looked at again then.
+class TimerWheel : public QObject {
+    Q_OBJECT
+
+public:
+    typedef std::function<qint64(Connection*)> Deadline;
+
+    static constexpr int DefaultTick = 1000;
+    static constexpr int DefaultSlots = 512;
+
+    TimerWheel(int tick, int slots, const Deadline& deadline, QObject* parent = nullptr);
+
+    void add(Connection* connection);
+    void remove(Connection* connection);
+    int size() const;
+
+signals:
+    void expired(Connection* connection);
+
+private slots:
+    void advance();
+
+private:
+    void schedule(Connection* connection, qint64 deadline);
+
+    QTimer timer;
+    int tick;
+    Deadline deadline;
+    QVector<QSet<Connection*>> wheel;
+    QHash<Connection*, int> slotOf;
+    qint64 cursor;
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,173 @@
+#include "tracer.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+
+Tracer::Scope::Scope(Tracer* tracer, Connection* connection, const char* phase) : tracer(tracer), connection(connection), phase(phase) {
+    start = tracer->isEnabled() ? tracer->now() : 0;
+}
+
+Tracer::Scope::~Scope() {
+    if (tracer->isEnabled()) {
+        tracer->record(connection, phase, start, tracer->now() - start);
+    }
+}
+
+Tracer::Tracer(bool enabled, int bufferSize, qint64 slowThreshold, QObject* parent) : QObject(parent), enabled(enabled) {
+    this->slowThreshold = slowThreshold * 1000;
+    capacity = qMax(1, bufferSize);
+    next = 0;
+    clock.start();
+}
+
+Tracer* Tracer::create(QSettings* config, QObject* parent) {
+    return new Tracer(config->value("trace/enabled", false).toBool(),
+                      config->value("trace/bufferSize", DefaultBufferSize).toInt(),
+                      config->value("trace/slowThreshold", DefaultSlowThreshold).toLongLong(),
+                      parent);
+}
+
+bool Tracer::isEnabled() const {
+    return enabled;
+}
+
+qint64 Tracer::now() const {
+    return clock.nsecsElapsed() / 1000;
+}
+
+void Tracer::begin(Connection* connection, const QByteArray& name) {
+    if (!enabled) {
+        return;
+    }
+
+    Active& request = active[connection];
+    request.name = name;
+    request.start = now();
+    request.lastMark = request.start;
+    request.phases.clear();
+}
+
+void Tracer::record(Connection* connection, const char* phase, qint64 start, qint64 duration) {
+    if (!enabled) {
+        return;
+    }
+
+    QHash<Connection*, Active>::iterator it = active.find(connection);
+    if (it == active.end()) {
+        return;
+    }
+
+    Event event;
+    event.name = phase;
+    event.request = false;
+    event.track = connection->descriptor();
+    event.start = start;
+    event.duration = qMax<qint64>(0, duration);
+    it->phases.append(event);
+    it->lastMark = qMax(it->lastMark, event.start + event.duration);
+}
+
+void Tracer::mark(Connection* connection, const char* phase) {
+    if (!enabled) {
+        return;
+    }
+
+    QHash<Connection*, Active>::iterator it = active.find(connection);
+    if (it == active.end()) {
+        return;
+    }
+
+    qint64 start = it->lastMark;
+    record(connection, phase, start, now() - start);
+}
+
+QString Tracer::end(Connection* connection) {
+    if (!enabled) {
+        return QString();
+    }
+
+    QHash<Connection*, Active>::iterator it = active.find(connection);
+    if (it == active.end()) {
+        return QString();
+    }
+
+    Event request;
+    request.name = it->name;
+    request.request = true;
+    request.track = connection->descriptor();
+    request.start = it->start;
+    request.duration = now() - it->start;
+
+    append(request);
+    foreach (const Event& phase, it->phases) {
+        append(phase);
+    }
+
+    QString summary;
+    if (request.duration >= slowThreshold) {
+        QStringList phases;
+        foreach (const Event& phase, it->phases) {
+            phases.append(QString("%1=%2").arg(QString(phase.name)).arg(phase.duration / 1000.0, 0, 'f', 3));
+        }
+        summary = QString("slow %1 %2 ms: %3").arg(QString(request.name)).arg(request.duration / 1000.0, 0, 'f', 3).arg(phases.join(' '));
+    }
+
+    active.erase(it);
+    return summary;
+}
+
+void Tracer::discard(Connection* connection) {
+    active.remove(connection);
+}
+
+void Tracer::append(const Event& event) {
+    if (window.size() < capacity) {
+        window.append(event);
+    } else {
+        window[next] = event;
+    }
+    next = (next + 1) % capacity;
+}
+
+QByteArray Tracer::toChromeJson() const {
+    QJsonArray events;
+    QSet<qint64> tracks;
+
+    // Oldest first: once the window has wrapped, the oldest event sits at next.
+    int start = window.size() < capacity ? 0 : next;
+    for (int i = 0; i < window.size(); i++) {
+        const Event& event = window[(start + i) % window.size()];
+
+        QJsonObject object;
+        object.insert("name", QString(event.name));
+        object.insert("cat", event.request ? "request" : "phase");
+        object.insert("ph", "X");
+        object.insert("ts", event.start);
+        object.insert("dur", event.duration);
+        object.insert("pid", 1);
+        object.insert("tid", event.track);
+        events.append(object);
+
+        tracks.insert(event.track);
+    }
+
+    foreach (qint64 track, tracks) {
+        QJsonObject args;
+        args.insert("name", QString("connection %1").arg(track));
+
+        QJsonObject object;
+        object.insert("name", "thread_name");
+        object.insert("ph", "M");
+        object.insert("pid", 1);
+        object.insert("tid", track);
+        object.insert("args", args);
+        events.append(object);
+    }
+
+    QJsonObject document;
+    document.insert("traceEvents", events);
+    document.insert("displayTimeUnit", "ms");
+    return QJsonDocument(document).toJson(QJsonDocument::Compact);
+}
@@ -0,0 +1,82 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSettings>
+#include <QVector>
+
+#include "connection.h"
+
+// Opt-in per-request tracing. A request span runs from the moment a request
+// is framed until its response is queued, and handlers record timed phases
+// inside it (handler, disk walk, serialization, writes, ...). mark() closes a
+// phase that started where the previous one ended. Finished spans
+// go into a fixed-size window that can be exported as Chrome trace-event JSON
+// for chrome://tracing or Perfetto; each connection is shown as its own track.
+// Phases measured on the I/O pool are timed there with now() and recorded from
+// the completion callback, so the tracer itself is only touched by the event loop.
+class Tracer : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultBufferSize = 65536;
+    static constexpr int DefaultSlowThreshold = 500;
+
+    // Records the enclosing block as a phase of the connection's current request.
+    class Scope {
+    public:
+        Scope(Tracer* tracer, Connection* connection, const char* phase);
+        ~Scope();
+
+    private:
+        Tracer* tracer;
+        Connection* connection;
+        const char* phase;
+        qint64 start;
+    };
+
+    Tracer(bool enabled, int bufferSize, qint64 slowThreshold, QObject* parent = nullptr);
+
+    static Tracer* create(QSettings* config, QObject* parent);
+
+    bool isEnabled() const;
+    qint64 now() const;
+
+    void begin(Connection* connection, const QByteArray& name);
+    void record(Connection* connection, const char* phase, qint64 start, qint64 duration);
+    void mark(Connection* connection, const char* phase);
+    QString end(Connection* connection);
+    void discard(Connection* connection);
+
+    QByteArray toChromeJson() const;
+
+private:
+    struct Event {
+        QByteArray name;
+        bool request;
+        qint64 track;
+        qint64 start;
+        qint64 duration;
+    };
+
+    struct Active {
+        QByteArray name;
+        qint64 start;
+        qint64 lastMark;
+        QVector<Event> phases;
+    };
+
+    void append(const Event& event);
+
+    bool enabled;
+    qint64 slowThreshold;
+    QElapsedTimer clock;
+    QHash<Connection*, Active> active;
+    QVector<Event> window;
+    int capacity;
+    int next;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,241 @@
+#include "uringstorage.h"
+
+#include <QTimer>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+UringStorage::UringStorage(IoPool* pool, int queueDepth, QObject* parent) : Storage(pool, parent) {
+    this->queueDepth = queueDepth > 0 ? queueDepth : DefaultQueueDepth;
+    valid = false;
+    eventFd = -1;
+    inflight = 0;
+    submitScheduled = false;
+    notifier = nullptr;
+
+    if (io_uring_queue_init(this->queueDepth, &ring, 0) < 0) {
+        return;
+    }
+
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0 || io_uring_register_eventfd(&ring, eventFd) < 0) {
+        if (eventFd >= 0) {
+            ::close(eventFd);
+            eventFd = -1;
+        }
+        io_uring_queue_exit(&ring);
+        return;
+    }
+
+    notifier = new QSocketNotifier(eventFd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &UringStorage::onCompletion);
+
+    valid = true;
+}
+
+UringStorage::~UringStorage() {
+    if (!valid) {
+        return;
+    }
+
+    io_uring_submit(&ring);
+    while (inflight > 0) {
+        io_uring_cqe* cqe = nullptr;
+        if (io_uring_wait_cqe(&ring, &cqe) < 0) {
+            break;
+        }
+
+        delete static_cast<Operation*>(io_uring_cqe_get_data(cqe));
+        io_uring_cqe_seen(&ring, cqe);
+        inflight--;
+    }
+
+    io_uring_queue_exit(&ring);
+    ::close(eventFd);
+}
+
+bool UringStorage::isValid() const {
+    return valid;
+}
+
+QString UringStorage::name() const {
+    return QString("io_uring(%1)").arg(queueDepth);
+}
+
+void UringStorage::open(const QSharedPointer<QFile>& file, QIODevice::OpenMode mode, QObject* context, const std::function<void(bool)>& done) {
+    int flags = O_CLOEXEC;
+    if ((mode & QIODevice::ReadWrite) == QIODevice::ReadWrite) {
+        flags |= O_RDWR | O_CREAT;
+    } else if (mode & QIODevice::WriteOnly) {
+        flags |= O_WRONLY | O_CREAT | O_TRUNC;
+    } else {
+        flags |= O_RDONLY;
+    }
+
+    Operation* operation = new Operation();
+    operation->file = file;
+    operation->path = QFile::encodeName(file->fileName());
+    operation->mode = mode;
+    operation->context = context;
+    operation->complete = [this, done](int result, Operation* operation) {
+        if (result == -EINVAL || result == -EOPNOTSUPP) {
+            Storage::open(operation->file, operation->mode, operation->context, done);
+            return;
+        }
+
+        bool opened = result >= 0 && operation->file->open(result, operation->mode, QFileDevice::AutoCloseHandle);
+        if (result >= 0 && !opened) {
+            ::close(result);
+        }
+        if (operation->context) {
+            done(opened);
+        }
+    };
+
+    io_uring_sqe* sqe = nextSqe(operation);
+    if (sqe) {
+        io_uring_prep_openat(sqe, AT_FDCWD, operation->path.constData(), flags, 0644);
+    }
+}
+
+void UringStorage::read(const QSharedPointer<QFile>& file, qint64 offset, qint64 length, QObject* context, const std::function<void(QByteArray)>& done) {
+    Operation* operation = new Operation();
+    operation->file = file;
+    operation->buffer.resize(length);
+    operation->context = context;
+    operation->complete = [done](int result, Operation* operation) {
+        if (operation->context) {
+            operation->buffer.resize(result > 0 ? result : 0);
+            done(operation->buffer);
+        }
+    };
+
+    io_uring_sqe* sqe = nextSqe(operation);
+    if (sqe) {
+        io_uring_prep_read(sqe, file->handle(), operation->buffer.data(), length, offset);
+    }
+}
+
+void UringStorage::write(const QSharedPointer<QFile>& file, qint64 offset, const QByteArray& bytes, QObject* context, const std::function<void(bool)>& done) {
+    Operation* operation = new Operation();
+    operation->file = file;
+    operation->buffer = bytes;
+    operation->context = context;
+    operation->complete = [done](int result, Operation* operation) {
+        if (operation->context) {
+            done(result == operation->buffer.size());
+        }
+    };
+
+    io_uring_sqe* sqe = nextSqe(operation);
+    if (sqe) {
+        io_uring_prep_write(sqe, file->handle(), operation->buffer.constData(), operation->buffer.size(), offset);
+    }
+}
+
+void UringStorage::sync(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done) {
+    Operation* operation = new Operation();
+    operation->file = file;
+    operation->context = context;
+    operation->complete = [done](int result, Operation* operation) {
+        if (operation->context) {
+            done(result == 0);
+        }
+    };
+
+    io_uring_sqe* sqe = nextSqe(operation);
+    if (sqe) {
+        io_uring_prep_fsync(sqe, file->handle(), 0);
+        // Writes to the file may still be in flight; the fsync has to wait for them.
+        io_uring_sqe_set_flags(sqe, IOSQE_IO_DRAIN);
+    }
+}
+
+void UringStorage::drain(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done) {
+    Operation* operation = new Operation();
+    operation->file = file;
+    operation->context = context;
+    operation->complete = [done](int result, Operation* operation) {
+        if (operation->context) {
+            done(result == 0);
+        }
+    };
+
+    io_uring_sqe* sqe = nextSqe(operation);
+    if (sqe) {
+        // A no-op that only completes once the writes queued before it have.
+        io_uring_prep_nop(sqe);
+        io_uring_sqe_set_flags(sqe, IOSQE_IO_DRAIN);
+    }
+}
+
+void UringStorage::remove(const QString& path, QObject* context, const std::function<void(bool)>& done) {
+    Operation* operation = new Operation();
+    operation->path = QFile::encodeName(path);
+    operation->context = context;
+    operation->complete = [this, path, done](int result, Operation* operation) {
+        if (result != 0 && result != -ENOENT) {
+            // Directories, and kernels without IORING_OP_UNLINKAT, go through the pool.
+            Storage::remove(path, operation->context, done);
+            return;
+        }
+
+        if (operation->context && done) {
+            done(true);
+        }
+    };
+
+    io_uring_sqe* sqe = nextSqe(operation);
+    if (sqe) {
+        io_uring_prep_unlinkat(sqe, AT_FDCWD, operation->path.constData(), 0);
+    }
+}
+
+io_uring_sqe* UringStorage::nextSqe(Operation* operation) {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    if (!sqe) {
+        io_uring_submit(&ring);
+        sqe = io_uring_get_sqe(&ring);
+    }
+
+    if (!sqe) {
+        QMetaObject::invokeMethod(this, [operation]() {
+            operation->complete(-EBUSY, operation);
+            delete operation;
+        }, Qt::QueuedConnection);
+        return nullptr;
+    }
+
+    io_uring_sqe_set_data(sqe, operation);
+    inflight++;
+
+    if (!submitScheduled) {
+        submitScheduled = true;
+        QTimer::singleShot(0, this, &UringStorage::submit);
+    }
+
+    return sqe;
+}
+
+void UringStorage::submit() {
+    submitScheduled = false;
+    io_uring_submit(&ring);
+}
+
+void UringStorage::onCompletion() {
+    eventfd_t value;
+    eventfd_read(eventFd, &value);
+
+    io_uring_cqe* cqe = nullptr;
+    while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+        Operation* operation = static_cast<Operation*>(io_uring_cqe_get_data(cqe));
+        int result = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        inflight--;
+
+        operation->complete(result, operation);
+        delete operation;
+    }
+}
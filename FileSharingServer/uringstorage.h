@@ -0,0 +1,61 @@
+#ifndef URINGSTORAGE_H
+#define URINGSTORAGE_H
+
+#include <QSocketNotifier>
+#include <QPointer>
+
+#include <liburing.h>
+
+#include "storage.h"
+
+// Linux storage backend built on io_uring. Operations are queued as SQEs from
+// the event-loop thread and submitted together once per loop iteration, and
+// completions are reaped when the ring's eventfd becomes readable, so a burst
+// of transfers costs one io_uring_enter() instead of one syscall per chunk.
+// Recursive deletes have no io_uring equivalent and use the portable path.
+class UringStorage : public Storage {
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultQueueDepth = 256;
+
+    UringStorage(IoPool* pool, int queueDepth, QObject* parent = nullptr);
+    ~UringStorage();
+
+    bool isValid() const;
+
+    QString name() const override;
+
+    void open(const QSharedPointer<QFile>& file, QIODevice::OpenMode mode, QObject* context, const std::function<void(bool)>& done) override;
+    void read(const QSharedPointer<QFile>& file, qint64 offset, qint64 length, QObject* context, const std::function<void(QByteArray)>& done) override;
+    void write(const QSharedPointer<QFile>& file, qint64 offset, const QByteArray& bytes, QObject* context, const std::function<void(bool)>& done) override;
+    void sync(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done) override;
+    void drain(const QSharedPointer<QFile>& file, QObject* context, const std::function<void(bool)>& done) override;
+    void remove(const QString& path, QObject* context, const std::function<void(bool)>& done) override;
+
+private slots:
+    void submit();
+    void onCompletion();
+
+private:
+    struct Operation {
+        QSharedPointer<QFile> file;
+        QByteArray path;
+        QByteArray buffer;
+        QIODevice::OpenMode mode;
+        QPointer<QObject> context;
+        std::function<void(int, Operation*)> complete;
+    };
+
+    io_uring_sqe* nextSqe(Operation* operation);
+
+    io_uring ring;
+    bool valid;
+    int eventFd;
+    int queueDepth;
+    int inflight;
+    bool submitScheduled;
+    QSocketNotifier* notifier;
+};
+
+#endif // URINGSTORAGE_H